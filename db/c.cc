@@ -14,6 +14,7 @@
 #include "leveldb/options.h"
 #include "leveldb/status.h"
 #include "leveldb/write_batch.h"
+#include "port/port.h"
 
 using leveldb::Cache;
 using leveldb::Comparator;
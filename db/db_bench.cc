@@ -5,13 +5,16 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include "db/db_impl.h"
 #include "db/version_set.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -23,6 +26,8 @@
 //   Actual benchmarks:
 //      fillseq       -- write N values in sequential key order in async mode
 //      fillrandom    -- write N values in random key order in async mode
+//      fillrandommt  -- fillrandom in --threads threads (4 if 1), with the
+//                       plain and then the pipelined write path
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
 //      fill100K      -- write N/1000 100K values in random order in async mode
@@ -31,11 +36,19 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      readrandommt  -- readrandom in 1, 2, 4, ... up to --threads (16 if 1)
+//                       threads, N reads each, to show how reads scale
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
-//      crc32c        -- repeated crc32c of 4K of data
+//      seekmissing   -- N random seeks to missing keys whose prefixes
+//                       (see --prefix_size) are missing too
+//      crc32c        -- repeated crc32c of 4K of data, with the portable
+//                       and (if the CPU has SSE4.2) the hardware code
 //      acquireload   -- load N*1000 times
+//      cachelookup   -- N lookups of random blocks per thread in a block
+//                       cache shared by --threads threads, where about
+//                       one lookup in five misses and inserts the block
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -88,6 +101,19 @@ static int FLAGS_write_buffer_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// The block cache is split into 2^FLAGS_cache_shard_bits shards, and
+// uses CLOCK instead of LRU eviction if FLAGS_clock_cache is true
+static int FLAGS_cache_shard_bits = 4;
+static bool FLAGS_clock_cache = false;
+
+// If true, index and filter blocks are loaded through the block cache,
+// where FLAGS_cache_high_pri_pool_ratio of the capacity is reserved for them
+static bool FLAGS_cache_index_and_filter_blocks = false;
+static double FLAGS_cache_high_pri_pool_ratio = 0.0;
+
+// If true, new tables get a partitioned index and partitioned filters
+static bool FLAGS_partition_index_and_filters = false;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -95,6 +121,48 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, the bloom filter keeps all probes for a key in one cache line
+static bool FLAGS_cache_local_bloom = false;
+
+// If true, new tables get one filter over all their keys
+static bool FLAGS_whole_table_filter = false;
+
+// If positive, the first prefix_size bytes of a key are its prefix for
+// the filters, and seeks are prefix seeks
+static int FLAGS_prefix_size = 0;
+
+// Number of key-range subcompactions a large compaction is split into
+// (initialized to default value by "main")
+static int FLAGS_max_subcompactions = 0;
+
+// Number of compactions run at the same time, and whether memtables are
+// flushed by a background job of their own
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+static int FLAGS_max_background_flushes = 0;
+
+// Number of write buffers held in memory, and whether a flush writes the
+// queued ones into one table
+// (initialized to default value by "main")
+static int FLAGS_max_write_buffer_number = 0;
+static bool FLAGS_merge_write_buffers = false;
+
+// Level-0 files at which writes are paced and stopped, and the pace in
+// bytes per second
+// (initialized to default value by "main")
+static int FLAGS_level0_slowdown_writes_trigger = 0;
+static int FLAGS_level0_stop_writes_trigger = 0;
+static int FLAGS_delayed_write_rate = 0;
+
+// If true, the writers of a group insert their batches into the memtable
+// in parallel
+// (initialized to default value by "main")
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// If true, use the pipelined write path
+// (initialized to default value by "main")
+static bool FLAGS_enable_pipelined_write = false;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -203,6 +271,11 @@ class Stats {
     seconds_ = (finish_ - start_) * 1e-6;
   }
 
+  // Actual elapsed time, not the sum of per-thread elapsed times
+  double ElapsedSeconds() const {
+    return (finish_ - start_) * 1e-6;
+  }
+
   void AddMessage(Slice msg) {
     AppendWithSpace(&message_, msg);
   }
@@ -303,7 +376,10 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* lookup_cache_;  // Shared by the threads of cachelookup
+  uint32_t (*crc_extend_)(uint32_t, const char*, size_t);  // Run by crc32c
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -388,10 +464,16 @@ class Benchmark {
 
  public:
   Benchmark()
-  : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
-    filter_policy_(FLAGS_bloom_bits >= 0
-                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                   : NULL),
+  : cache_(FLAGS_cache_size >= 0 ? NewBlockCache(FLAGS_cache_size) : NULL),
+    lookup_cache_(NULL),
+    crc_extend_(&crc32c::Extend),
+    filter_policy_(FLAGS_bloom_bits < 0 ? NULL
+                   : FLAGS_cache_local_bloom
+                   ? NewCacheLocalBloomFilterPolicy(FLAGS_bloom_bits)
+                   : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+    prefix_extractor_(FLAGS_prefix_size > 0
+                      ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                      : NULL),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
@@ -413,7 +495,9 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete lookup_cache_;
     delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -453,6 +537,10 @@ class Benchmark {
       } else if (name == Slice("fillrandom")) {
         fresh_db = true;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillrandommt")) {
+        WriteRandomPipelined(num_threads > 1 ? num_threads : 4);
+      } else if (name == Slice("readrandommt")) {
+        ReadRandomScaling(num_threads > 1 ? num_threads : 16);
       } else if (name == Slice("overwrite")) {
         fresh_db = false;
         method = &Benchmark::WriteRandom;
@@ -476,6 +564,8 @@ class Benchmark {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
+      } else if (name == Slice("seekmissing")) {
+        method = &Benchmark::SeekMissing;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
       } else if (name == Slice("readrandomsmall")) {
@@ -491,9 +581,14 @@ class Benchmark {
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
-        method = &Benchmark::Crc32c;
+        Crc32cEach(num_threads);
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
+      } else if (name == Slice("cachelookup")) {
+        delete lookup_cache_;
+        lookup_cache_ = NewBlockCache(
+            FLAGS_cache_size >= 0 ? FLAGS_cache_size : 8 << 20);
+        method = &Benchmark::CacheLookup;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -565,8 +660,9 @@ class Benchmark {
     }
   }
 
-  void RunBenchmark(int n, Slice name,
-                    void (Benchmark::*method)(ThreadState*)) {
+  // Returns the elapsed seconds of the run
+  double RunBenchmark(int n, Slice name,
+                      void (Benchmark::*method)(ThreadState*)) {
     SharedState shared;
     shared.total = n;
     shared.num_initialized = 0;
@@ -599,11 +695,72 @@ class Benchmark {
       arg[0].thread->stats.Merge(arg[i].thread->stats);
     }
     arg[0].thread->stats.Report(name);
+    const double seconds = arg[0].thread->stats.ElapsedSeconds();
 
     for (int i = 0; i < n; i++) {
       delete arg[i].thread;
     }
     delete[] arg;
+    return seconds;
+  }
+
+  // Runs readrandom in 1, 2, 4, ... max_threads threads on the current
+  // database, and reports each throughput relative to one thread.
+  void ReadRandomScaling(int max_threads) {
+    double base = 0;
+    for (int n = 1; ; n = std::min(2 * n, max_threads)) {
+      char name[32];
+      _snprintf_s(name, sizeof(name), "readrandom%d", n);
+      const double seconds = RunBenchmark(n, name, &Benchmark::ReadRandom);
+      const double reads_per_sec = static_cast<double>(n) * reads_ / seconds;
+      if (n == 1) {
+        base = reads_per_sec;
+      }
+      fprintf(stdout, "%-12s : %.2fx the reads/sec of one thread\n",
+              name, reads_per_sec / base);
+      fflush(stdout);
+      if (n == max_threads) {
+        break;
+      }
+    }
+  }
+
+  // Runs fillrandom in n threads on a fresh database with the plain and
+  // then the pipelined write path, and reports the throughput gain.
+  void WriteRandomPipelined(int n) {
+    if (FLAGS_use_existing_db) {
+      fprintf(stdout, "%-12s : skipped (--use_existing_db is true)\n",
+              "fillrandommt");
+      return;
+    }
+    const bool pipelined = FLAGS_enable_pipelined_write;
+    double seconds[2];
+    for (int i = 0; i < 2; i++) {
+      FLAGS_enable_pipelined_write = (i == 1);
+      delete db_;
+      db_ = NULL;
+      DestroyDB(FLAGS_db, Options());
+      Open();
+      seconds[i] = RunBenchmark(n, (i == 0 ? "fillrandommt" : "pipelined"),
+                                &Benchmark::WriteRandom);
+    }
+    FLAGS_enable_pipelined_write = pipelined;
+    fprintf(stdout, "%-12s : %+.1f%% throughput with %d threads\n",
+            "pipelined", (seconds[0] / seconds[1] - 1) * 100, n);
+    fflush(stdout);
+  }
+
+  // Runs the crc32c benchmark once per implementation.
+  void Crc32cEach(int n) {
+    crc_extend_ = &crc32c::ExtendPortable;
+    RunBenchmark(n, "crc32c", &Benchmark::Crc32c);
+    if (crc32c::IsHardwareAccelerated()) {
+      crc_extend_ = &crc32c::ExtendHardware;
+      RunBenchmark(n, "crc32c_hw", &Benchmark::Crc32c);
+    } else {
+      fprintf(stdout, "%-12s : skipped (no SSE4.2 on this CPU)\n",
+              "crc32c_hw");
+    }
   }
 
   void Crc32c(ThreadState* thread) {
@@ -614,7 +771,7 @@ class Benchmark {
     int64_t bytes = 0;
     uint32_t crc = 0;
     while (bytes < 500 * 1048576) {
-      crc = crc32c::Value(data.data(), size);
+      crc = (*crc_extend_)(0, data.data(), size);
       thread->stats.FinishedSingleOp();
       bytes += size;
     }
@@ -641,6 +798,45 @@ class Benchmark {
     if (ptr == NULL) exit(1); // Disable unused variable warning.
   }
 
+  static Cache* NewBlockCache(size_t capacity) {
+    if (FLAGS_clock_cache) {
+      return NewClockCache(capacity, Options().block_size,
+                           FLAGS_cache_shard_bits,
+                           FLAGS_cache_high_pri_pool_ratio);
+    }
+    return NewLRUCache(capacity, FLAGS_cache_shard_bits,
+                       FLAGS_cache_high_pri_pool_ratio);
+  }
+
+  static void DeleteCachedBlock(const Slice& key, void* value) {
+  }
+
+  void CacheLookup(ThreadState* thread) {
+    const size_t block_size = Options().block_size;
+    const int blocks = static_cast<int>(
+        (FLAGS_cache_size >= 0 ? FLAGS_cache_size : 8 << 20) / block_size);
+    const int key_space = blocks + blocks / 4 + 1;
+    int64_t hits = 0;
+    char key[8];
+    for (int i = 0; i < reads_; i++) {
+      EncodeFixed64(key, thread->rand.Next() % key_space);
+      Cache::Handle* handle = lookup_cache_->Lookup(Slice(key, sizeof(key)));
+      if (handle != NULL) {
+        hits++;
+      } else {
+        handle = lookup_cache_->Insert(Slice(key, sizeof(key)), NULL,
+                                       block_size, &DeleteCachedBlock);
+      }
+      lookup_cache_->Release(handle);
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    _snprintf_s(msg, sizeof(msg), "(%.1f%% hits, %s cache)",
+             reads_ > 0 ? hits * 100.0 / reads_ : 0.0,
+             FLAGS_clock_cache ? "clock" : "lru");
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -693,9 +889,26 @@ class Benchmark {
     Options options;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.cache_index_and_filter_blocks =
+        FLAGS_cache_index_and_filter_blocks;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_open_files = FLAGS_open_files;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_background_flushes = FLAGS_max_background_flushes;
+    options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+    options.merge_write_buffers = FLAGS_merge_write_buffers;
+    options.level0_slowdown_writes_trigger =
+        FLAGS_level0_slowdown_writes_trigger;
+    options.level0_stop_writes_trigger = FLAGS_level0_stop_writes_trigger;
+    options.delayed_write_rate = FLAGS_delayed_write_rate;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
     options.filter_policy = filter_policy_;
+    options.prefix_extractor = prefix_extractor_;
+    options.whole_table_filter = FLAGS_whole_table_filter;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -812,6 +1025,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_seek = (prefix_extractor_ != NULL);
     std::string value;
     int found = 0;
     for (int i = 0; i < reads_; i++) {
@@ -829,6 +1043,31 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void SeekMissing(ThreadState* thread) {
+    ReadOptions options;
+    options.prefix_seek = (prefix_extractor_ != NULL);
+    // A '.' sorts before any digit, so the target falls between two keys
+    const int dot = (FLAGS_prefix_size > 0 && FLAGS_prefix_size <= 16)
+                    ? FLAGS_prefix_size - 1 : 15;
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      Iterator* iter = db_->NewIterator(options);
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      _snprintf_s(key, sizeof(key), "%016d", k);
+      key[dot] = '.';
+      iter->Seek(key);
+      if (iter->Valid() && iter->key().starts_with(Slice(key, dot + 1))) {
+        found++;
+      }
+      delete iter;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    _snprintf_s(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
@@ -927,6 +1166,21 @@ class Benchmark {
 void test_mode(int argc, char** argv) {
     FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
+  FLAGS_max_background_flushes = leveldb::Options().max_background_flushes;
+  FLAGS_max_write_buffer_number = leveldb::Options().max_write_buffer_number;
+  FLAGS_merge_write_buffers = leveldb::Options().merge_write_buffers;
+  FLAGS_level0_slowdown_writes_trigger =
+      leveldb::Options().level0_slowdown_writes_trigger;
+  FLAGS_level0_stop_writes_trigger =
+      leveldb::Options().level0_stop_writes_trigger;
+  FLAGS_delayed_write_rate =
+      static_cast<int>(leveldb::Options().delayed_write_rate);
+  FLAGS_allow_concurrent_memtable_write =
+      leveldb::Options().allow_concurrent_memtable_write;
+  FLAGS_enable_pipelined_write = leveldb::Options().enable_pipelined_write;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -955,10 +1209,62 @@ void test_mode(int argc, char** argv) {
       FLAGS_write_buffer_size = n;
     } else if (sscanf_s(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf_s(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shard_bits = n;
+    } else if (sscanf_s(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = (n != 0);
+    } else if (sscanf_s(argv[i], "--cache_index_and_filter_blocks=%d%c",
+                        &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = (n != 0);
+    } else if (sscanf_s(argv[i], "--cache_high_pri_pool_ratio=%lf%c",
+                        &d, &junk) == 1) {
+      FLAGS_cache_high_pri_pool_ratio = d;
+    } else if (sscanf_s(argv[i], "--partition_index_and_filters=%d%c",
+                        &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = (n != 0);
     } else if (sscanf_s(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf_s(argv[i], "--cache_local_bloom=%d%c",
+                        &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_cache_local_bloom = (n != 0);
+    } else if (sscanf_s(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
+    } else if (sscanf_s(argv[i], "--whole_table_filter=%d%c",
+                        &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_whole_table_filter = (n != 0);
     } else if (sscanf_s(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf_s(argv[i], "--max_subcompactions=%d%c",
+                        &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf_s(argv[i], "--max_background_compactions=%d%c",
+                        &n, &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf_s(argv[i], "--max_background_flushes=%d%c",
+                        &n, &junk) == 1) {
+      FLAGS_max_background_flushes = n;
+    } else if (sscanf_s(argv[i], "--max_write_buffer_number=%d%c",
+                        &n, &junk) == 1) {
+      FLAGS_max_write_buffer_number = n;
+    } else if (sscanf_s(argv[i], "--merge_write_buffers=%d%c",
+                        &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_merge_write_buffers = (n != 0);
+    } else if (sscanf_s(argv[i], "--level0_slowdown_writes_trigger=%d%c",
+                        &n, &junk) == 1) {
+      FLAGS_level0_slowdown_writes_trigger = n;
+    } else if (sscanf_s(argv[i], "--level0_stop_writes_trigger=%d%c",
+                        &n, &junk) == 1) {
+      FLAGS_level0_stop_writes_trigger = n;
+    } else if (sscanf_s(argv[i], "--delayed_write_rate=%d%c",
+                        &n, &junk) == 1) {
+      FLAGS_delayed_write_rate = n;
+    } else if (sscanf_s(argv[i], "--allow_concurrent_memtable_write=%d%c",
+                        &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = (n != 0);
+    } else if (sscanf_s(argv[i], "--enable_pipelined_write=%d%c",
+                        &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = (n != 0);
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -43,11 +43,25 @@ struct DBImpl::Writer {
   WriteBatch* batch;
   bool sync;
   bool done;
+  bool grouped;       // Taken into the group of another writer
+  WriteGroup* group;  // Set when the group is logged and batch is to be
+                      // inserted into the memtable by this writer
+  Writer* next;       // Next writer of the same group
   port::CondVar cv;
 
   explicit Writer(port::Mutex* mu) : cv(mu) { }
 };
 
+// The writers whose batches went into one log record
+struct DBImpl::WriteGroup {
+  Writer* leader;
+  Writer* last_writer;            // Reached from leader through next
+  SequenceNumber last_sequence;   // Of the last batch of the group
+  MemTable* mem;                  // Memtable the batches go into
+  int pending_inserts;            // Writers still inserting their batches
+  Status insert_status;           // First error met by those writers
+};
+
 struct DBImpl::CompactionState {
   Compaction* const compaction;
 
@@ -71,16 +85,96 @@ struct DBImpl::CompactionState {
 
   uint64_t total_bytes;
 
+  // User key range [*begin,*end) merged by a subcompaction.  NULL means
+  // the range is unbounded on that side.
+  const std::string* begin;
+  const std::string* end;
+  Compaction::Position position;
+
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        total_bytes(0),
+        begin(NULL),
+        end(NULL) {
+  }
+};
+
+// A key range of a split compaction, merged by a job of the LOW pool, or
+// by the compaction itself if no job picked it up first.
+struct DBImpl::Subcompaction {
+  CompactionState* state;
+  Status status;
+  int* running;  // Subcompactions not done yet, protected by db->mutex_
+};
+
+// An immutable memtable waiting to be flushed, with the log that holds
+// its writes.
+struct DBImpl::ImmutableMemTable {
+  MemTable* mem;
+  uint64_t log_number;          // Log file that holds the writes of mem
+  bool flushing;                // Picked by a CompactMemTable()
+};
+
+// The memtables and the version a read looks at, pinned together by a
+// single reference count that is changed without holding mutex_.
+struct DBImpl::SuperVersion {
+  MemTable* mem;
+  std::vector<MemTable*> imm;   // Immutable memtables, newest first
+  Version* current;
+  uintptr_t number;             // super_version_number_ when installed
+  port::AtomicPointer refs;     // Kept as an integer
+
+  // Look key up in the memtables, newest first
+  bool GetFromMemTables(const LookupKey& key, std::string* value,
+                        Status* s) const {
+    if (mem->Get(key, value, s)) {
+      return true;
+    }
+    for (size_t i = 0; i < imm.size(); i++) {
+      if (imm[i]->Get(key, value, s)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Ref() {
+    AddRefs(1);
+  }
+
+  // Drop a reference and return true if it was the last one.
+  bool Unref() {
+    return AddRefs(-1) == 0;
+  }
+
+ private:
+  uintptr_t AddRefs(intptr_t delta) {
+    while (true) {
+      void* old = refs.Acquire_Load();
+      void* val = reinterpret_cast<void*>(
+          reinterpret_cast<uintptr_t>(old) + delta);
+      if (refs.CompareAndSwap(old, val)) {
+        return reinterpret_cast<uintptr_t>(val);
+      }
+    }
   }
 };
 
+// Stands in the thread-local slot for the SuperVersion its thread is
+// reading through, so that InstallSuperVersion() does not take it back.
+static char super_version_in_use;
+static void* const kSuperVersionInUse = &super_version_in_use;
+
+// Slowest pace of writes, in bytes per second
+static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+// Longest a paced writer sleeps before it looks at the pace again
+static const uint64_t kMaxDelaySliceMicros = 100000;
+
 // Fix user-supplied options to be reasonable
 template <class T,class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -90,13 +184,26 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* itransform,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
+  result.prefix_extractor = (src.prefix_extractor != NULL) ? itransform : NULL;
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.max_subcompactions, 1,                           64);
+  ClipToRange(&result.max_background_compactions, 1,                   64);
+  ClipToRange(&result.max_background_flushes, 0,                       64);
+  ClipToRange(&result.max_write_buffer_number, 2,                     64);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              config::kL0_CompactionTrigger, 1000);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger, 1000);
+  if (result.delayed_write_rate < kMinDelayedWriteRate) {
+    result.delayed_write_rate = kMinDelayedWriteRate;
+  }
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -108,7 +215,12 @@ Options SanitizeOptions(const std::string& dbname,
     }
   }
   if (result.block_cache == NULL) {
-    result.block_cache = NewLRUCache(8 << 20);
+    if (result.cache_index_and_filter_blocks) {
+      // Keep index and filter blocks ahead of data blocks
+      result.block_cache = NewLRUCache(8 << 20, 4, 0.5);
+    } else {
+      result.block_cache = NewLRUCache(8 << 20);
+    }
   }
   return result;
 }
@@ -117,8 +229,10 @@ DBImpl::DBImpl(const Options& options, const std::string& dbname)
     : env_(options.env),
       internal_comparator_(options.comparator),
       internal_filter_policy_(options.filter_policy),
+      internal_prefix_extractor_(options.prefix_extractor),
       options_(SanitizeOptions(
-          dbname, &internal_comparator_, &internal_filter_policy_, options)),
+          dbname, &internal_comparator_, &internal_filter_policy_,
+          &internal_prefix_extractor_, options)),
       owns_info_log_(options_.info_log != options.info_log),
       owns_cache_(options_.block_cache != options.block_cache),
       dbname_(dbname),
@@ -126,12 +240,26 @@ DBImpl::DBImpl(const Options& options, const std::string& dbname)
       shutting_down_(NULL),
       bg_cv_(&mutex_),
       mem_(new MemTable(internal_comparator_)),
-      imm_(NULL),
+      super_version_(NULL),
+      super_version_number_(NULL),
+      local_super_version_(&DBImpl::UnrefLocalSuperVersion),
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
       tmp_batch_(new WriteBatch),
-      bg_compaction_scheduled_(false),
+      bg_flushes_scheduled_(0),
+      bg_compactions_scheduled_(0),
+      bg_subcompactions_scheduled_(0),
+      flushes_running_(0),
+      compactions_running_(0),
+      applying_edit_(false),
+      write_controller_(options_.delayed_write_rate),
+      write_stopped_(false),
+      stall_l0_files_(0),
+      stall_pending_bytes_(0),
+      stall_delayed_micros_(0),
+      stall_stopped_micros_(0),
+      stall_memtable_micros_(0),
       manual_compaction_(NULL),
       consecutive_compaction_errors_(0) {
   mem_->Ref();
@@ -143,15 +271,41 @@ DBImpl::DBImpl(const Options& options, const std::string& dbname)
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
+
+  // Flushes run in the HIGH pool and compactions in the LOW one; make sure
+  // the pools are large enough for the jobs this DB may run at once.
+  if (env_->GetBackgroundThreads(Env::LOW) <
+      options_.max_background_compactions) {
+    env_->SetBackgroundThreads(options_.max_background_compactions, Env::LOW);
+  }
+  if (env_->GetBackgroundThreads(Env::HIGH) <
+      options_.max_background_flushes) {
+    env_->SetBackgroundThreads(options_.max_background_flushes, Env::HIGH);
+  }
 }
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  while (bg_flushes_scheduled_ > 0 || bg_compactions_scheduled_ > 0 ||
+         bg_subcompactions_scheduled_ > 0) {
     bg_cv_.Wait();
   }
+
+  // Release the SuperVersions before the versions they refer to
+  std::vector<void*> cached;
+  local_super_version_.Scrape(&cached, NULL);
+  for (size_t i = 0; i < cached.size(); i++) {
+    SuperVersion* sv = reinterpret_cast<SuperVersion*>(cached[i]);
+    if (cached[i] != kSuperVersionInUse && sv->Unref()) {
+      CleanupSuperVersion(sv);
+    }
+  }
+  if (super_version_ != NULL && super_version_->Unref()) {
+    CleanupSuperVersion(super_version_);
+  }
+  super_version_ = NULL;
   mutex_.Unlock();
 
   if (db_lock_ != NULL) {
@@ -160,7 +314,9 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != NULL) mem_->Unref();
-  if (imm_ != NULL) imm_->Unref();
+  for (size_t i = 0; i < imm_.size(); i++) {
+    imm_[i].mem->Unref();
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -453,27 +609,39 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
-  meta.number = versions_->NewFileNumber();
-  pending_outputs_.insert(meta.number);
   Iterator* iter = mem->NewIterator();
+  Status s = BuildLevel0Table(iter, &meta);
+  delete iter;
+  pending_outputs_.erase(meta.number);
+  AddLevel0Table(s, meta, env_->NowMicros() - start_micros, edit, base);
+  return s;
+}
+
+Status DBImpl::BuildLevel0Table(Iterator* iter, FileMetaData* meta) {
+  mutex_.AssertHeld();
+  meta->number = versions_->NewFileNumber();
+  pending_outputs_.insert(meta->number);
   Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long) meta.number);
+      (unsigned long long) meta->number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, meta);
     mutex_.Lock();
   }
 
   Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s",
-      (unsigned long long) meta.number,
-      (unsigned long long) meta.file_size,
+      (unsigned long long) meta->number,
+      (unsigned long long) meta->file_size,
       s.ToString().c_str());
-  delete iter;
-  pending_outputs_.erase(meta.number);
-
+  return s;
+}
 
+void DBImpl::AddLevel0Table(const Status& s, const FileMetaData& meta,
+                            uint64_t micros, VersionEdit* edit,
+                            Version* base) {
+  mutex_.AssertHeld();
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
   int level = 0;
@@ -488,41 +656,125 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   }
 
   CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros;
+  stats.micros = micros;
   stats.bytes_written = meta.file_size;
   stats_[level].Add(stats);
-  return s;
+}
+
+void DBImpl::UpdateHasImm() {
+  mutex_.AssertHeld();
+  MemTable* oldest = NULL;
+  for (size_t i = 0; i < imm_.size(); i++) {
+    if (!imm_[i].flushing) {
+      oldest = imm_[i].mem;
+      break;
+    }
+  }
+  has_imm_.Release_Store(oldest);
+}
+
+int DBImpl::PendingFlushes() {
+  mutex_.AssertHeld();
+  int pending = 0;
+  for (size_t i = 0; i < imm_.size(); i++) {
+    if (!imm_[i].flushing) {
+      pending++;
+    }
+  }
+  if (options_.merge_write_buffers && pending > 1) {
+    pending = 1;
+  }
+  return pending;
 }
 
 Status DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != NULL);
+  assert(HasImmToFlush());
+  const uint64_t start_micros = env_->NowMicros();
 
-  // Save the contents of the memtable as a new Table
-  VersionEdit edit;
-  Version* base = versions_->current();
-  base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
-  base->Unref();
+  // Pick the oldest memtable no other flush has picked, and with
+  // merge_write_buffers the newer ones that follow it
+  size_t first = 0;
+  while (imm_[first].flushing) {
+    first++;
+  }
+  std::vector<MemTable*> picked;
+  for (size_t i = first; i < imm_.size() && !imm_[i].flushing; i++) {
+    imm_[i].flushing = true;
+    picked.push_back(imm_[i].mem);
+    if (!options_.merge_write_buffers) {
+      break;
+    }
+  }
+  UpdateHasImm();
+  flushes_running_++;
 
-  if (s.ok() && shutting_down_.Acquire_Load()) {
-    s = Status::IOError("Deleting DB during memtable compaction");
+  // Save the contents of the memtables as a new Table
+  FileMetaData meta;
+  std::vector<Iterator*> list;
+  for (size_t i = 0; i < picked.size(); i++) {
+    list.push_back(picked[i]->NewIterator());
+  }
+  Iterator* iter =
+      NewMergingIterator(&internal_comparator_, &list[0], list.size());
+  Status s = BuildLevel0Table(iter, &meta);
+  delete iter;
+  const uint64_t micros = env_->NowMicros() - start_micros;
+
+  // Tables are added in the order of their memtables, so that the log
+  // files the version keeps cover every memtable not flushed yet.  Wait
+  // for the flushes of the older memtables.
+  while (s.ok()) {
+    if (shutting_down_.Acquire_Load()) {
+      s = Status::IOError("Deleting DB during memtable compaction");
+    } else if (imm_.front().mem == picked[0]) {
+      if (!applying_edit_) {
+        break;
+      }
+      bg_cv_.Wait();
+    } else if (!imm_.front().flushing) {
+      s = Status::IOError("Flush of an older memtable failed");
+    } else {
+      bg_cv_.Wait();
+    }
   }
 
-  // Replace immutable memtable with the generated Table
+  // Replace the immutable memtables with the generated Table
   if (s.ok()) {
+    applying_edit_ = true;
+    VersionEdit edit;
+    AddLevel0Table(s, meta, micros, &edit, versions_->current());
+    // Earlier logs no longer needed
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
+    edit.SetLogNumber(picked.size() < imm_.size() ?
+                      imm_[picked.size()].log_number : logfile_number_);
     s = versions_->LogAndApply(&edit, &mutex_);
+    applying_edit_ = false;
   }
+  pending_outputs_.erase(meta.number);
+  flushes_running_--;
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = NULL;
-    has_imm_.Release_Store(NULL);
+    for (size_t i = 0; i < picked.size(); i++) {
+      assert(imm_.front().mem == picked[i]);
+      imm_.front().mem->Unref();
+      imm_.pop_front();
+    }
+    UpdateHasImm();
+    InstallSuperVersion();
     DeleteObsoleteFiles();
+  } else {
+    // Leave the memtables to another flush
+    for (size_t i = 0; i < imm_.size(); i++) {
+      if (std::find(picked.begin(), picked.end(), imm_[i].mem) !=
+          picked.end()) {
+        imm_[i].flushing = false;
+      }
+    }
+    UpdateHasImm();
   }
+  bg_cv_.SignalAll();
 
   return s;
 }
@@ -585,30 +837,217 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != NULL && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       bg_cv_.Wait();
     }
-    if (imm_ != NULL) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
   return s;
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (applying_edit_) {
+    bg_cv_.Wait();
+  }
+  applying_edit_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  applying_edit_ = false;
+  bg_cv_.SignalAll();
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  return s;
+}
+
+DBImpl::SuperVersion* DBImpl::GetSuperVersion() {
+  SuperVersion* sv = reinterpret_cast<SuperVersion*>(
+      local_super_version_.Swap(kSuperVersionInUse));
+  assert(sv != kSuperVersionInUse);
+  const uintptr_t number =
+      reinterpret_cast<uintptr_t>(super_version_number_.Acquire_Load());
+  if (sv != NULL && sv->number == number) {
+    return sv;
+  }
+
+  // Nothing cached, or a SuperVersion that is about to be taken back
+  if (sv != NULL) {
+    UnrefSuperVersion(sv);
+  }
+  mutex_.Lock();
+  sv = super_version_;
+  sv->Ref();
+  mutex_.Unlock();
+  return sv;
+}
+
+void DBImpl::ReturnSuperVersion(SuperVersion* sv) {
+  // Keep the reference in the thread's cache, unless a newer SuperVersion
+  // was installed meanwhile and the cache was emptied
+  if (!local_super_version_.CompareAndSwap(kSuperVersionInUse, sv)) {
+    UnrefSuperVersion(sv);
+  }
+}
+
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->mem->Ref();
+  for (size_t i = imm_.size(); i > 0; i--) {
+    sv->imm.push_back(imm_[i - 1].mem);
+    imm_[i - 1].mem->Ref();
+  }
+  sv->current = versions_->current();
+  sv->current->Ref();
+  sv->refs.NoBarrier_Store(reinterpret_cast<void*>(1));  // Held by the DB
+  SuperVersion* old = super_version_;
+  sv->number = (old != NULL ? old->number + 1 : 0);
+  super_version_ = sv;
+  super_version_number_.Release_Store(reinterpret_cast<void*>(sv->number));
+
+  // Take back the cached references, which would otherwise keep the old
+  // memtables and table files alive until their threads read again
+  std::vector<void*> cached;
+  local_super_version_.Scrape(&cached, NULL);
+  for (size_t i = 0; i < cached.size(); i++) {
+    SuperVersion* s = reinterpret_cast<SuperVersion*>(cached[i]);
+    if (cached[i] != kSuperVersionInUse && s->Unref()) {
+      CleanupSuperVersion(s);
+    }
+  }
+  if (old != NULL && old->Unref()) {
+    CleanupSuperVersion(old);
+  }
+  RecalculateWriteStall();
+}
+
+void DBImpl::RecalculateWriteStall() {
+  mutex_.AssertHeld();
+  const int l0_files = versions_->NumLevelFiles(0);
+  const uint64_t pending = versions_->PendingCompactionBytes();
+  const uint64_t soft = options_.soft_pending_compaction_bytes_limit;
+  const uint64_t hard = options_.hard_pending_compaction_bytes_limit;
+  write_stopped_ = (l0_files >= options_.level0_stop_writes_trigger ||
+                    (hard > 0 && pending >= hard));
+  const uint64_t old_rate = write_controller_.delayed_write_rate();
+  uint64_t rate = old_rate;
+  if (write_stopped_ ||
+      l0_files >= options_.level0_slowdown_writes_trigger ||
+      (soft > 0 && pending >= soft)) {
+    // Slow down while the backlog grows, harder when writes are about to
+    // stop, and speed up while it shrinks.  A slowdown starts at the pace
+    // the last one ended with.
+    if (write_controller_.IsDelayed()) {
+      const bool near_stop =
+          (l0_files >= options_.level0_stop_writes_trigger - 2 ||
+           (hard > 0 && pending >= hard / 4 * 3));
+      if (l0_files > stall_l0_files_ || pending > stall_pending_bytes_) {
+        rate = rate / 5 * (near_stop ? 3 : 4);
+      } else if (l0_files < stall_l0_files_ || pending < stall_pending_bytes_) {
+        rate = rate / 4 * 5;
+      }
+    }
+    write_controller_.set_delayed(true);
+  } else if (write_controller_.IsDelayed()) {
+    // Compactions caught up; the next slowdown can start a little faster
+    rate = rate / 4 * 5;
+    write_controller_.set_delayed(false);
+  }
+  rate = std::min(std::max(rate, kMinDelayedWriteRate),
+                  options_.delayed_write_rate);
+  if (rate != old_rate) {
+    Log(options_.info_log, "Writes paced to %llu bytes/s: "
+        "%d level-0 files, %llu bytes of compaction pending\n",
+        (unsigned long long) rate, l0_files, (unsigned long long) pending);
+    write_controller_.set_delayed_write_rate(rate);
+  }
+  stall_l0_files_ = l0_files;
+  stall_pending_bytes_ = pending;
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  if (sv->Unref()) {
+    MutexLock l(&mutex_);
+    CleanupSuperVersion(sv);
+  }
+}
+
+void DBImpl::CleanupSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  sv->mem->Unref();
+  for (size_t i = 0; i < sv->imm.size(); i++) {
+    sv->imm[i]->Unref();
+  }
+  sv->current->Unref();
+  delete sv;
+}
+
+void DBImpl::UnrefLocalSuperVersion(void* ptr) {
+  // Called when a reader thread exits.  The DB holds a reference to its
+  // current SuperVersion, and InstallSuperVersion() takes the cached ones
+  // back before it drops the reference to the old one, so this is never
+  // the last reference.
+  if (ptr != kSuperVersionInUse) {
+    SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+    const bool last = sv->Unref();
+    assert(!last);
+    (void)last;
+  }
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.Acquire_Load()) {
+  if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
-  } else if (imm_ == NULL &&
-             manual_compaction_ == NULL &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    bg_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    return;
+  }
+  const bool dedicated_flush = (options_.max_background_flushes > 0);
+  if (dedicated_flush) {
+    // One job per flush that can start, besides the running ones
+    const int wanted = flushes_running_ + PendingFlushes();
+    while (bg_flushes_scheduled_ < options_.max_background_flushes &&
+           bg_flushes_scheduled_ < wanted) {
+      bg_flushes_scheduled_++;
+      env_->Schedule(&DBImpl::BGFlush, this, Env::HIGH);
+    }
   }
+  while (bg_compactions_scheduled_ < options_.max_background_compactions &&
+         ((HasImmToFlush() && !dedicated_flush) ||
+          manual_compaction_ != NULL ||
+          versions_->NeedsCompaction())) {
+    bg_compactions_scheduled_++;
+    env_->Schedule(&DBImpl::BGWork, this, Env::LOW);
+  }
+}
+
+void DBImpl::BGFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(bg_flushes_scheduled_ > 0);
+  // Another job may have picked the memtables already
+  if (!shutting_down_.Acquire_Load() && HasImmToFlush()) {
+    Status s = CompactMemTable();
+    if (s.ok()) {
+      // Success
+      consecutive_compaction_errors_ = 0;
+    } else if (shutting_down_.Acquire_Load()) {
+      // Ignore errors found during shutting down
+    } else {
+      BackgroundError(s);
+    }
+  }
+
+  bg_flushes_scheduled_--;
+
+  // The new level-0 file may call for a compaction
+  MaybeScheduleCompaction();
+  bg_cv_.SignalAll();
 }
 
 void DBImpl::BGWork(void* db) {
@@ -617,52 +1056,80 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
+  assert(bg_compactions_scheduled_ > 0);
+  bool worked = false;
   if (!shutting_down_.Acquire_Load()) {
-    Status s = BackgroundCompaction();
+    Status s = BackgroundCompaction(&worked);
     if (s.ok()) {
       // Success
       consecutive_compaction_errors_ = 0;
     } else if (shutting_down_.Acquire_Load()) {
       // Error most likely due to shutdown; do not wait
     } else {
-      // Wait a little bit before retrying background compaction in
-      // case this is an environmental problem and we do not want to
-      // chew up resources for failed compactions for the duration of
-      // the problem.
-      bg_cv_.SignalAll();  // In case a waiter can proceed despite the error
-      Log(options_.info_log, "Waiting after background compaction error: %s",
-          s.ToString().c_str());
-      mutex_.Unlock();
-      ++consecutive_compaction_errors_;
-      int seconds_to_sleep = 1;
-      for (int i = 0; i < 3 && i < consecutive_compaction_errors_ - 1; ++i) {
-        seconds_to_sleep *= 2;
-      }
-      env_->SleepForMicroseconds(seconds_to_sleep * 1000000);
-      mutex_.Lock();
+      BackgroundError(s);
     }
   }
 
-  bg_compaction_scheduled_ = false;
+  bg_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A job that found
+  // nothing it could do does not, or jobs would keep running while the
+  // work left waits on the inputs of a running compaction; that
+  // compaction reschedules when it is done.
+  if (worked) {
+    MaybeScheduleCompaction();
+  }
   bg_cv_.SignalAll();
 }
 
-Status DBImpl::BackgroundCompaction() {
+void DBImpl::BackgroundError(const Status& s) {
   mutex_.AssertHeld();
+  // Wait a little bit before retrying background compaction in
+  // case this is an environmental problem and we do not want to
+  // chew up resources for failed compactions for the duration of
+  // the problem.
+  bg_cv_.SignalAll();  // In case a waiter can proceed despite the error
+  Log(options_.info_log, "Waiting after background compaction error: %s",
+      s.ToString().c_str());
+  mutex_.Unlock();
+  ++consecutive_compaction_errors_;
+  int seconds_to_sleep = 1;
+  for (int i = 0; i < 3 && i < consecutive_compaction_errors_ - 1; ++i) {
+    seconds_to_sleep *= 2;
+  }
+  env_->SleepForMicroseconds(seconds_to_sleep * 1000000);
+  mutex_.Lock();
+}
 
-  if (imm_ != NULL) {
+Status DBImpl::BackgroundCompaction(bool* worked) {
+  mutex_.AssertHeld();
+  *worked = false;
+
+  if (!imm_.empty() && options_.max_background_flushes == 0) {
+    if (!HasImmToFlush()) {
+      return Status::OK();
+    }
+    *worked = true;
     return CompactMemTable();
   }
 
+  // Pick from a version that no pending edit is about to change
+  while (applying_edit_) {
+    bg_cv_.Wait();
+  }
+  if (shutting_down_.Acquire_Load()) {
+    return Status::OK();
+  }
+
   Compaction* c;
   bool is_manual = (manual_compaction_ != NULL);
   InternalKey manual_end;
   if (is_manual) {
+    if (compactions_running_ > 0) {
+      // Manual compactions run alone
+      return Status::OK();
+    }
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == NULL);
@@ -679,6 +1146,11 @@ Status DBImpl::BackgroundCompaction() {
     c = versions_->PickCompaction();
   }
 
+  if (c != NULL) {
+    compactions_running_++;
+  }
+  *worked = (c != NULL || is_manual);
+
   Status status;
   if (c == NULL) {
     // Nothing to do
@@ -689,7 +1161,7 @@ Status DBImpl::BackgroundCompaction() {
     c->edit()->DeleteFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
                        f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    status = LogAndApply(c->edit());
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number),
@@ -704,7 +1176,10 @@ Status DBImpl::BackgroundCompaction() {
     c->ReleaseInputs();
     DeleteObsoleteFiles();
   }
-  delete c;
+  if (c != NULL) {
+    delete c;
+    compactions_running_--;
+  }
 
   if (status.ok()) {
     // Done
@@ -846,7 +1321,7 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
         level + 1,
         out.number, out.file_size, out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -868,38 +1343,181 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
 
+  // Split the compaction into key ranges, each of them given at least
+  // a couple of output files' worth of input.
+  int64_t input_bytes = 0;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      input_bytes += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  const int64_t min_range_bytes =
+      2 * static_cast<int64_t>(compact->compaction->MaxOutputFileSize());
+  const int max_ranges = static_cast<int>(std::min<int64_t>(
+      options_.max_subcompactions, input_bytes / min_range_bytes));
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSplitPoints(max_ranges, &boundaries);
+
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  Status status;
+  if (boundaries.empty()) {
+    status = DoCompactionRange(compact, &imm_micros);
+  } else {
+    // Ranges 1..n are queued for the LOW pool while this thread merges
+    // range 0 and keeps compacting the memtable.  The ranges no pool
+    // thread has taken by then are merged here too, so a compaction never
+    // waits on jobs queued behind it in a busy pool.
+    const int n = static_cast<int>(boundaries.size()) + 1;
+    Log(options_.info_log, "Compaction split into %d subcompactions", n);
+    std::vector<Subcompaction> subs(n);
+    int running = n - 1;
+    for (int i = 0; i < n; i++) {
+      CompactionState* state = new CompactionState(compact->compaction);
+      state->smallest_snapshot = compact->smallest_snapshot;
+      state->begin = (i == 0 ? NULL : &boundaries[i - 1]);
+      state->end = (i == n - 1 ? NULL : &boundaries[i]);
+      subs[i].state = state;
+      subs[i].running = &running;
+    }
+    mutex_.Lock();
+    for (int i = 1; i < n; i++) {
+      queued_subcompactions_.push_back(&subs[i]);
+      bg_subcompactions_scheduled_++;
+      env_->Schedule(&DBImpl::BGSubcompaction, this, Env::LOW);
+    }
+    mutex_.Unlock();
+    subs[0].status = DoCompactionRange(subs[0].state, &imm_micros);
+
+    mutex_.Lock();
+    for (std::deque<Subcompaction*>::iterator it =
+             queued_subcompactions_.begin();
+         it != queued_subcompactions_.end(); ) {
+      Subcompaction* sub = *it;
+      if (sub->running != &running) {
+        ++it;
+        continue;
+      }
+      queued_subcompactions_.erase(it);
+      mutex_.Unlock();
+      sub->status = DoCompactionRange(sub->state, &imm_micros);
+      mutex_.Lock();
+      running--;
+      it = queued_subcompactions_.begin();
+    }
+    while (running > 0) {
+      if (HasImmToFlush()) {
+        const uint64_t imm_start = env_->NowMicros();
+        CompactMemTable();
+        bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+        imm_micros += (env_->NowMicros() - imm_start);
+      } else {
+        bg_cv_.Wait();
+      }
+    }
+    mutex_.Unlock();
+
+    // Gather the outputs of all ranges, in key order, so they are
+    // installed with one VersionEdit and released by CleanupCompaction().
+    for (int i = 0; i < n; i++) {
+      CompactionState* state = subs[i].state;
+      if (status.ok()) {
+        status = subs[i].status;
+      }
+      if (state->builder != NULL) {
+        state->builder->Abandon();
+        delete state->builder;
+      }
+      delete state->outfile;
+      compact->outputs.insert(compact->outputs.end(),
+                              state->outputs.begin(), state->outputs.end());
+      compact->total_bytes += state->total_bytes;
+      delete state;
+    }
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  stats.bytes_read = input_bytes;
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  mutex_.Lock();
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log,
+      "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::BGSubcompaction(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundSubcompactionCall();
+}
+
+void DBImpl::BackgroundSubcompactionCall() {
+  MutexLock l(&mutex_);
+  assert(bg_subcompactions_scheduled_ > 0);
+  // The compaction may have merged the range itself already
+  if (!queued_subcompactions_.empty()) {
+    Subcompaction* sub = queued_subcompactions_.front();
+    queued_subcompactions_.pop_front();
+    mutex_.Unlock();
+    sub->status = DoCompactionRange(sub->state, NULL);
+    mutex_.Lock();
+    // sub belongs to the compaction, which may return once this is zero
+    --*sub->running;
+  }
+  bg_subcompactions_scheduled_--;
+  bg_cv_.SignalAll();
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact,
+                                 int64_t* imm_micros) {
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
+  if (compact->begin != NULL) {
+    InternalKey start(*compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
-    // Prioritize immutable compaction work
-    if (has_imm_.NoBarrier_Load() != NULL) {
+    // Prioritize immutable compaction work, unless a flush job got to it
+    // first
+    if (imm_micros != NULL && HasImmToFlush()) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
+      if (HasImmToFlush()) {
         CompactMemTable();
         bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->end != NULL && ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key, *compact->end) >= 0) {
+      // Reached the range of the next subcompaction
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->position) &&
         compact->builder != NULL) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
         break;
       }
     }
-
     // Handle key/value, add to state, etc.
     bool drop = false;
     if (!ParseInternalKey(key, &ikey)) {
@@ -922,7 +1540,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;    // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(
+                     ikey.user_key, &compact->position)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -941,7 +1560,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->position),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -983,75 +1603,34 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   }
   delete input;
   input = NULL;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
-namespace {
-struct IterState {
-  port::Mutex* mu;
-  Version* version;
-  MemTable* mem;
-  MemTable* imm;
-};
-
-static void CleanupIteratorState(void* arg1, void* arg2) {
-  IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != NULL) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
-  delete state;
+void DBImpl::UnrefIteratorSuperVersion(void* db, void* sv) {
+  reinterpret_cast<DBImpl*>(db)->UnrefSuperVersion(
+      reinterpret_cast<SuperVersion*>(sv));
 }
-}  // namespace
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot) {
-  IterState* cleanup = new IterState;
-  mutex_.Lock();
+  SuperVersion* sv = GetSuperVersion();
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != NULL) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  list.push_back(sv->mem->NewIterator());
+  for (size_t i = 0; i < sv->imm.size(); i++) {
+    list.push_back(sv->imm[i]->NewIterator());
   }
-  versions_->current()->AddIterators(options, &list);
+  sv->current->AddIterators(options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
 
-  cleanup->mu = &mutex_;
-  cleanup->mem = mem_;
-  cleanup->imm = imm_;
-  cleanup->version = versions_->current();
-  internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
-
-  mutex_.Unlock();
+  // The iterator keeps a reference of its own; the one from
+  // GetSuperVersion() goes back to the thread's cache
+  sv->Ref();
+  internal_iter->RegisterCleanup(&DBImpl::UnrefIteratorSuperVersion, this, sv);
+  ReturnSuperVersion(sv);
   return internal_iter;
 }
 
@@ -1069,7 +1648,7 @@ Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
   Status s;
-  MutexLock l(&mutex_);
+  SuperVersion* sv = GetSuperVersion();
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
@@ -1077,39 +1656,104 @@ Status DBImpl::Get(const ReadOptions& options,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != NULL) imm->Ref();
-  current->Ref();
-
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
+  // First look in the memtable, then in the immutable memtables (if any).
+  LookupKey lkey(key, snapshot);
+  if (sv->GetFromMemTables(lkey, value, &s)) {
+    // Done
+  } else {
+    s = sv->current->Get(options, lkey, value, &stats);
+    have_stat_update = true;
+  }
+
+  // Only a read that went through more than one file charges a seek
+  if (have_stat_update && stats.seek_file != NULL) {
+    MutexLock l(&mutex_);
+    if (sv->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnSuperVersion(sv);
+  return s;
+}
+
+namespace {
+// Orders indexes into a key array by the user keys they refer to
+struct KeyIndexComparator {
+  const Comparator* ucmp;
+  const Slice* keys;
+  KeyIndexComparator(const Comparator* c, const Slice* k)
+      : ucmp(c), keys(k) { }
+  bool operator()(int a, int b) const {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  }
+};
+}  // namespace
+
+void DBImpl::MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                      std::string* values, Status* statuses) {
+  if (n <= 0) {
+    return;
+  }
+
+  // Visit the keys in sorted order, so that lookups that land in the
+  // same table follow each other and find its table and blocks cached.
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            KeyIndexComparator(user_comparator(), keys));
+
+  SuperVersion* sv = GetSuperVersion();
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  std::vector<Version::GetStats> stats;
+  int prev = -1;
+  for (int j = 0; j < n; j++) {
+    const int i = order[j];
+    if (prev >= 0 && user_comparator()->Compare(keys[i], keys[prev]) == 0) {
+      // Repeated key: same snapshot, same answer
+      values[i] = values[prev];
+      statuses[i] = statuses[prev];
+      continue;
+    }
+    prev = i;
+
+    Status s;
+    LookupKey lkey(keys[i], snapshot);
+    if (sv->GetFromMemTables(lkey, &values[i], &s)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+      Version::GetStats file_stats;
+      s = sv->current->Get(options, lkey, &values[i], &file_stats);
+      if (file_stats.seek_file != NULL) {
+        stats.push_back(file_stats);
+      }
     }
-    mutex_.Lock();
+    statuses[i] = s;
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  if (!stats.empty()) {
+    MutexLock l(&mutex_);
+    bool schedule = false;
+    for (size_t i = 0; i < stats.size(); i++) {
+      if (sv->current->UpdateStats(stats[i])) {
+        schedule = true;
+      }
+    }
+    if (schedule) {
+      MaybeScheduleCompaction();
+    }
   }
-  mem->Unref();
-  if (imm != NULL) imm->Unref();
-  current->Unref();
-  return s;
+  ReturnSuperVersion(sv);
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
@@ -1146,15 +1790,25 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   w.batch = my_batch;
   w.sync = options.sync;
   w.done = false;
+  w.grouped = false;
+  w.group = NULL;
+  w.next = NULL;
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
-    w.cv.Wait();
+  while (!w.done && (w.grouped || &w != writers_.front())) {
+    if (w.group != NULL) {
+      InsertFollowerBatch(&w);
+    } else {
+      w.cv.Wait();
+    }
   }
   if (w.done) {
     return w.status;
   }
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(&w);
+  }
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(my_batch == NULL);
@@ -1164,6 +1818,19 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     WriteBatch* updates = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
+    if (write_controller_.IsDelayed()) {
+      write_controller_.Charge(env_->NowMicros(),
+                               WriteBatchInternal::ByteSize(updates));
+    }
+
+    // When the group holds the batches of several writers, each of them
+    // inserts its own batch into the memtable once the group is logged.
+    const bool insert_concurrently =
+        (updates == tmp_batch_ && options_.allow_concurrent_memtable_write);
+    WriteGroup group;
+    if (insert_concurrently) {
+      GatherGroup(last_writer, WriteBatchInternal::Sequence(updates), &group);
+    }
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1175,11 +1842,14 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
       if (status.ok() && options.sync) {
         status = logfile_->Sync();
       }
-      if (status.ok()) {
+      if (status.ok() && !insert_concurrently) {
         status = WriteBatchInternal::InsertInto(updates, mem_);
       }
       mutex_.Lock();
     }
+    if (status.ok() && insert_concurrently) {
+      status = InsertGroupConcurrently(&group);
+    }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
@@ -1204,6 +1874,92 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   return status;
 }
 
+// Write with two stages, each with a leader of its own: the writer at the
+// front of writers_ appends a group to the log, then hands writers_ over
+// to the next group and waits in memtable_groups_ for the groups logged
+// before to be inserted into the memtable.  The last sequence is
+// published in log order, once a group is in the memtable.
+// REQUIRES: mutex_ is held
+// REQUIRES: w is at the front of the writer queue
+Status DBImpl::PipelinedWrite(Writer* w) {
+  mutex_.AssertHeld();
+  // May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(w->batch == NULL);
+  Writer* last_writer = w;
+  WriteGroup group;
+  group.leader = w;
+  group.last_writer = w;
+  if (status.ok() && w->batch != NULL) {  // NULL batch is for compactions
+    // The groups still to be inserted have taken sequence numbers that
+    // are not published yet.
+    SequenceNumber last_sequence = memtable_groups_.empty() ?
+        versions_->LastSequence() : memtable_groups_.back()->last_sequence;
+    WriteBatch* updates = BuildBatchGroup(&last_writer);
+    WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+    GatherGroup(last_writer, last_sequence + 1, &group);
+    if (write_controller_.IsDelayed()) {
+      write_controller_.Charge(env_->NowMicros(),
+                               WriteBatchInternal::ByteSize(updates));
+    }
+
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+    if (status.ok() && w->sync) {
+      status = logfile_->Sync();
+    }
+    mutex_.Lock();
+    if (updates == tmp_batch_) tmp_batch_->Clear();
+    if (status.ok()) {
+      memtable_groups_.push_back(&group);
+    }
+  }
+
+  // Let the next group write the log
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready == last_writer) break;
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  if (status.ok() && w->batch != NULL) {
+    while (memtable_groups_.front() != &group) {
+      w->cv.Wait();
+    }
+    if (last_writer != w && options_.allow_concurrent_memtable_write) {
+      status = InsertGroupConcurrently(&group);
+    } else {
+      mutex_.Unlock();
+      for (Writer* x = w; status.ok(); x = x->next) {
+        if (x->batch != NULL) {
+          status = WriteBatchInternal::InsertInto(x->batch, group.mem);
+        }
+        if (x == last_writer) break;
+      }
+      mutex_.Lock();
+    }
+    versions_->SetLastSequence(group.last_sequence);
+    memtable_groups_.pop_front();
+    if (!memtable_groups_.empty()) {
+      memtable_groups_.front()->leader->cv.Signal();
+    } else {
+      bg_cv_.SignalAll();  // Wakeup a writer waiting to switch memtables
+    }
+  }
+
+  // The other writers of the group, if any, are done.  When the group
+  // was not logged they get the error.
+  for (Writer* ready = w; ready != last_writer; ) {
+    ready = ready->next;
+    ready->status = status;
+    ready->done = true;
+    ready->cv.Signal();
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-NULL batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1253,6 +2009,80 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   return result;
 }
 
+// Gathers the writers from the front of the writer queue through
+// last_writer into group, and gives each batch its own sequence numbers,
+// following the order of the batches in the log record of the group,
+// which starts at "sequence".
+// REQUIRES: mutex_ is held
+void DBImpl::GatherGroup(Writer* last_writer, SequenceNumber sequence,
+                         WriteGroup* group) {
+  mutex_.AssertHeld();
+  group->leader = writers_.front();
+  group->last_writer = last_writer;
+  std::deque<Writer*>::iterator iter = writers_.begin();
+  while (true) {
+    Writer* w = *iter;
+    w->grouped = (w != group->leader);
+    if (w->batch != NULL) {
+      WriteBatchInternal::SetSequence(w->batch, sequence);
+      sequence += WriteBatchInternal::Count(w->batch);
+    }
+    if (w == last_writer) break;
+    ++iter;
+    w->next = *iter;
+  }
+  group->last_sequence = sequence - 1;
+  group->mem = mem_;
+  group->pending_inserts = 0;
+}
+
+// Inserts the batch of w, a follower of a group, into the memtable of
+// its group alongside the other writers of the group.
+// REQUIRES: mutex_ is held
+void DBImpl::InsertFollowerBatch(Writer* w) {
+  mutex_.AssertHeld();
+  WriteGroup* group = w->group;
+  w->group = NULL;
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, group->mem);
+  mutex_.Lock();
+  if (!s.ok() && group->insert_status.ok()) {
+    group->insert_status = s;
+  }
+  group->pending_inserts--;
+  if (group->pending_inserts == 0) {
+    group->leader->cv.Signal();
+  }
+}
+
+// Hands the batches of group to their writers, inserts the batch of the
+// leader meanwhile and waits for the others.
+// REQUIRES: mutex_ is held
+Status DBImpl::InsertGroupConcurrently(WriteGroup* group) {
+  mutex_.AssertHeld();
+  Writer* leader = group->leader;
+  for (Writer* w = leader; w != group->last_writer; ) {
+    w = w->next;
+    if (w->batch != NULL) {
+      w->group = group;
+      group->pending_inserts++;
+      w->cv.Signal();
+    }
+  }
+
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(leader->batch,
+                                                        group->mem);
+  mutex_.Lock();
+  while (group->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  if (s.ok()) {
+    s = group->insert_status;
+  }
+  return s;
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
 Status DBImpl::MakeRoomForWrite(bool force) {
@@ -1265,31 +2095,48 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (
-        allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+    } else if (allow_delay && write_controller_.IsDelayed()) {
+      // We are getting close to stopping writes until compactions catch
+      // up.  Rather than delaying a single write by several seconds when
+      // writes stop, pace all writes to the rate the write controller
+      // allows to reduce latency variance.  Also, the delay hands over
+      // some CPU to the compaction thread in case it is sharing the same
+      // core as the writer.
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
+      const uint64_t start = env_->NowMicros();
+      uint64_t now = start;
+      uint64_t delay = write_controller_.GetDelay(now);
+      while (delay > 0 && bg_error_.ok() && !shutting_down_.Acquire_Load()) {
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(
+            static_cast<int>(std::min(delay, kMaxDelaySliceMicros)));
+        mutex_.Lock();
+        now = env_->NowMicros();
+        delay = write_controller_.GetDelay(now);
+      }
+      stall_delayed_micros_ += now - start;
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != NULL) {
+    } else if (imm_.size() >=
+               static_cast<size_t>(options_.max_write_buffer_number - 1)) {
       // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+      // ones are still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
-      // There are too many level-0 files.
-      Log(options_.info_log, "Too many L0 files; waiting...\n");
+      stall_memtable_micros_ += env_->NowMicros() - start;
+    } else if (write_stopped_) {
+      // There are too many level-0 files or too many bytes to compact.
+      Log(options_.info_log, "Too many L0 files or pending compaction "
+          "bytes; waiting...\n");
+      const uint64_t start = env_->NowMicros();
+      bg_cv_.Wait();
+      stall_stopped_micros_ += env_->NowMicros() - start;
+    } else if (!memtable_groups_.empty()) {
+      // Groups of the pipelined write logged to the current log are still
+      // to be inserted into the current memtable.
       bg_cv_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
@@ -1304,15 +2151,21 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       }
       delete log_;
       delete logfile_;
+      ImmutableMemTable imm;
+      imm.mem = mem_;
+      imm.log_number = logfile_number_;
+      imm.flushing = false;
+      imm_.push_back(imm);
+      UpdateHasImm();
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.Release_Store(imm_);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
+      bg_cv_.SignalAll();  // Wakeup a compaction waiting on subcompactions
     }
   }
   return s;
@@ -1363,10 +2216,59 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
         value->append(buf);
       }
     }
+    _snprintf_s(buf, sizeof(buf),
+             "Write stalls(sec): %.3f paced, %.3f stopped, %.3f memtable\n",
+             stall_delayed_micros_ / 1e6,
+             stall_stopped_micros_ / 1e6,
+             stall_memtable_micros_ / 1e6);
+    value->append(buf);
     return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "block-cache-usage") {
+    char buf[50];
+    _snprintf_s(buf, sizeof(buf), "%llu",
+                static_cast<unsigned long long>(
+                    options_.block_cache->TotalCharge()));
+    *value = buf;
+    return true;
+  } else if (in == "table-readers-mem") {
+    char buf[50];
+    _snprintf_s(buf, sizeof(buf), "%llu",
+                static_cast<unsigned long long>(
+                    table_cache_->ApproximateMemoryUsage()));
+    *value = buf;
+    return true;
+  } else if (in == "stall-micros") {
+    char buf[50];
+    _snprintf_s(buf, sizeof(buf), "%llu",
+                static_cast<unsigned long long>(stall_delayed_micros_ +
+                                                stall_stopped_micros_ +
+                                                stall_memtable_micros_));
+    *value = buf;
+    return true;
+  } else if (in == "actual-delayed-write-rate") {
+    char buf[50];
+    _snprintf_s(buf, sizeof(buf), "%llu",
+                static_cast<unsigned long long>(
+                    write_controller_.IsDelayed() ?
+                    write_controller_.delayed_write_rate() : 0));
+    *value = buf;
+    return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    _snprintf_s(buf, sizeof(buf), "%llu",
+                static_cast<unsigned long long>(
+                    versions_->PendingCompactionBytes()));
+    *value = buf;
+    return true;
+  } else if (in == "num-immutable-mem-table") {
+    char buf[50];
+    _snprintf_s(buf, sizeof(buf), "%llu",
+                static_cast<unsigned long long>(imm_.size()));
+    *value = buf;
+    return true;
   }
 
   return false;
@@ -1412,6 +2314,22 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+void DB::MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                  std::string* values, Status* statuses) {
+  ReadOptions read_options = options;
+  const Snapshot* snapshot = NULL;
+  if (read_options.snapshot == NULL) {
+    snapshot = GetSnapshot();
+    read_options.snapshot = snapshot;
+  }
+  for (int i = 0; i < n; i++) {
+    statuses[i] = Get(read_options, keys[i], &values[i]);
+  }
+  if (snapshot != NULL) {
+    ReleaseSnapshot(snapshot);
+  }
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -1435,6 +2353,7 @@ Status DB::Open(const Options& options, const std::string& dbname,
       s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
     }
     if (s.ok()) {
+      impl->InstallSuperVersion();
       impl->DeleteObsoleteFiles();
       impl->MaybeScheduleCompaction();
     }
@@ -10,13 +10,16 @@
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
+struct FileMetaData;
 class MemTable;
 class TableCache;
 class Version;
@@ -35,6 +38,8 @@ class DBImpl : public DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual void MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                        std::string* values, Status* statuses);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
@@ -62,11 +67,36 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct Subcompaction;
   struct Writer;
+  struct WriteGroup;
+  struct SuperVersion;
+  struct ImmutableMemTable;
 
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot);
 
+  // Return the current SuperVersion with a reference the caller must
+  // give back with ReturnSuperVersion().  Normally it comes from the
+  // calling thread's cache and mutex_ is not locked.
+  SuperVersion* GetSuperVersion();
+  void ReturnSuperVersion(SuperVersion* sv);
+
+  // Make mem_, imm_ and the current version what new reads look at, and
+  // take back the SuperVersions the threads cache.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Decide from the level-0 files and the compaction debt of the current
+  // version whether writes are paced or stopped, and adjust the pace.
+  void RecalculateWriteStall() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Drop a reference to sv, and its memtables and version with the last
+  // one.  Locks mutex_ only in that case.
+  void UnrefSuperVersion(SuperVersion* sv);
+  void CleanupSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void UnrefLocalSuperVersion(void* sv);
+  static void UnrefIteratorSuperVersion(void* db, void* sv);
+
   Status NewDB();
 
   // Recover the descriptor from persistent storage.  May do a significant
@@ -79,11 +109,26 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void DeleteObsoleteFiles();
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
+  // Compact the oldest immutable memtable that no other flush has picked
+  // (with merge_write_buffers, all of them) to a level-0 table, and drop
+  // it once its table and every older one are added to the version.
+  // REQUIRES: HasImmToFlush()
   Status CompactMemTable()
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Does some immutable memtable wait for a flush to pick it?
+  bool HasImmToFlush() const EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return has_imm_.NoBarrier_Load() != NULL;
+  }
+  void UpdateHasImm() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Number of flushes that can start on the memtables not picked yet.
+  int PendingFlushes() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Apply *edit to the current version.  Waits for the edit of another
+  // background job to be applied first.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status RecoverLogFile(uint64_t log_number,
                         VersionEdit* edit,
                         SequenceNumber* max_sequence)
@@ -92,18 +137,46 @@ class DBImpl : public DB {
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Write the entries of iter to a new table described by *meta, whose
+  // number the caller must erase from pending_outputs_.
+  Status BuildLevel0Table(Iterator* iter, FileMetaData* meta)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Add the table built by BuildLevel0Table() to *edit, at the level
+  // base picks for it (level-0 if base is NULL).
+  void AddLevel0Table(const Status& s, const FileMetaData& meta,
+                      uint64_t micros, VersionEdit* edit, Version* base)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer);
+  void GatherGroup(Writer* last_writer, SequenceNumber sequence,
+                   WriteGroup* group) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void InsertFollowerBatch(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status InsertGroupConcurrently(WriteGroup* group)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status PipelinedWrite(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlush(void* db);
+  void BackgroundFlushCall();
   static void BGWork(void* db);
   void BackgroundCall();
-  Status BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Run one compaction.  *worked is set to false if there was nothing
+  // to do, or nothing that could run along with the running compactions.
+  Status BackgroundCompaction(bool* worked) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void BackgroundError(const Status& s) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the key range of *compact into its outputs.  imm_micros is NULL
+  // for the subcompactions that leave memtable compactions to the thread
+  // running DoCompactionWork(), else it accumulates the time spent on them.
+  Status DoCompactionRange(CompactionState* compact, int64_t* imm_micros);
+  static void BGSubcompaction(void* db);
+  void BackgroundSubcompactionCall();
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
@@ -114,6 +187,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalKeySliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   bool owns_cache_;
@@ -130,8 +204,17 @@ class DBImpl : public DB {
   port::AtomicPointer shutting_down_;
   port::CondVar bg_cv_;          // Signalled when background work finishes
   MemTable* mem_;
-  MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  std::deque<ImmutableMemTable> imm_;  // Memtables to flush, oldest first
+  // Oldest memtable of imm_ that no flush has picked, or NULL.  So bg
+  // threads can detect flush work without locking mutex_.
+  port::AtomicPointer has_imm_;
+  SuperVersion* super_version_;  // mem_, imm_ and current version for reads
+  port::AtomicPointer super_version_number_;  // Of super_version_
+
+  // The SuperVersion each reader thread keeps a reference to, so that
+  // Get() and NewIterator() need not lock mutex_ to pin the memtables
+  // and the version.  InstallSuperVersion() takes them all back.
+  ThreadLocalPtr local_super_version_;
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
@@ -140,14 +223,52 @@ class DBImpl : public DB {
   std::deque<Writer*> writers_;
   WriteBatch* tmp_batch_;
 
+  // With the pipelined write, the groups whose log record is written and
+  // that wait for their turn to be inserted into the memtable, in the
+  // order they were logged.
+  std::deque<WriteGroup*> memtable_groups_;
+
   SnapshotList snapshots_;
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_;
 
-  // Has a background compaction been scheduled or is running?
-  bool bg_compaction_scheduled_;
+  // Background jobs scheduled or running.  Memtable flushes have jobs
+  // of their own so that they do not queue up behind long compactions.
+  int bg_flushes_scheduled_;
+  int bg_compactions_scheduled_;
+
+  // Subcompactions waiting for a LOW pool job, oldest first, and the jobs
+  // scheduled for them.  A job finds the queue empty if the compaction
+  // merged the range itself.
+  std::deque<Subcompaction*> queued_subcompactions_;
+  int bg_subcompactions_scheduled_;
+
+  // Number of memtable flushes running.
+  int flushes_running_;
+
+  // Number of compactions picked and not finished yet.  A manual
+  // compaction only runs when this is zero.
+  int compactions_running_;
+
+  // Is some thread applying a VersionEdit?  LogAndApply() releases mutex_
+  // while it writes the MANIFEST.  Compactions are only picked when no
+  // edit is pending.
+  bool applying_edit_;
+
+  // Writes are paced by write_controller_, or stopped, while compactions
+  // fall behind.  The level-0 files and compaction debt seen by the last
+  // RecalculateWriteStall() tell whether the backlog grows or shrinks.
+  WriteController write_controller_;
+  bool write_stopped_;
+  int stall_l0_files_;
+  uint64_t stall_pending_bytes_;
+
+  // Micros writers spent paced, stopped, and waiting for a memtable flush
+  uint64_t stall_delayed_micros_;
+  uint64_t stall_stopped_micros_;
+  uint64_t stall_memtable_micros_;
 
   // Information for a manual compaction
   struct ManualCompaction {
@@ -196,6 +317,7 @@ class DBImpl : public DB {
 extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
                                const InternalFilterPolicy* ipolicy,
+                               const InternalKeySliceTransform* itransform,
                                const Options& src);
 
 }  // namespace leveldb
@@ -10,6 +10,7 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -72,6 +73,9 @@ class SpecialEnv : public EnvWrapper {
   // Force write to manifest files to fail while this pointer is non-NULL
   port::AtomicPointer manifest_write_error_;
 
+  // Compaction jobs (the LOW pool) wait while this pointer is non-NULL.
+  port::AtomicPointer delay_compactions_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
@@ -85,6 +89,7 @@ class SpecialEnv : public EnvWrapper {
     count_random_reads_ = false;
     manifest_sync_error_.Release_Store(NULL);
     manifest_write_error_.Release_Store(NULL);
+    delay_compactions_.Release_Store(NULL);
   }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
@@ -185,17 +190,49 @@ class SpecialEnv : public EnvWrapper {
     sleep_time_counter_.IncrementBy(micros);
   }
 
+  struct DelayedJob {
+    SpecialEnv* env;
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void RunDelayedJob(void* arg) {
+    DelayedJob* job = reinterpret_cast<DelayedJob*>(arg);
+    while (job->env->delay_compactions_.Acquire_Load() != NULL) {
+      DelayMilliseconds(10);
+    }
+    (*job->function)(job->arg);
+    delete job;
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg, Priority pri) {
+    if (pri == LOW) {
+      DelayedJob* job = new DelayedJob;
+      job->env = this;
+      job->function = function;
+      job->arg = arg;
+      target()->Schedule(&RunDelayedJob, job, pri);
+    } else {
+      target()->Schedule(function, arg, pri);
+    }
+  }
+
 };
 
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  const FilterPolicy* cache_local_filter_policy_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
     kDefault,
     kFilter,
     kUncompressed,
+    kPipelinedWrite,
+    kCachedIndexAndFilter,
+    kPartitionedIndexAndFilter,
+    kWholeTableFilter,
     kEnd
   };
   int option_config_;
@@ -210,6 +247,7 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    cache_local_filter_policy_ = NewCacheLocalBloomFilterPolicy(10);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -221,6 +259,7 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete cache_local_filter_policy_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -245,6 +284,23 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kCachedIndexAndFilter:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        break;
+      case kPartitionedIndexAndFilter:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 128;
+        break;
+      case kWholeTableFilter:
+        options.filter_policy = cache_local_filter_policy_;
+        options.whole_table_filter = true;
+        options.cache_index_and_filter_blocks = true;
+        break;
       default:
         break;
     }
@@ -471,6 +527,20 @@ class DBTest {
     return result;
   }
 
+  int CountTableFiles() {
+    std::vector<std::string> filenames;
+    env_->GetChildren(dbname_, &filenames);
+    uint64_t number;
+    FileType type;
+    int result = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+        result++;
+      }
+    }
+    return result;
+  }
+
   bool DeleteAnSSTFile() {
     std::vector<std::string> filenames;
     ASSERT_OK(env_->GetChildren(dbname_, &filenames));
@@ -533,6 +603,73 @@ TEST(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultipleImmutableMemTables) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_write_buffer_number = 4;
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "v1"));
+  env_->delay_sstable_sync_.Release_Store(env_);   // Block sync calls
+  ASSERT_OK(Put("k1", std::string(100000, 'x')));  // Fill memtable
+  ASSERT_OK(Put("k2", std::string(100000, 'y')));  // Queue it
+  ASSERT_OK(Put("k3", std::string(100000, 'z')));  // Queue another
+  ASSERT_OK(Put("k4", "v4"));                      // Queue another
+
+  // The writes did not wait for the blocked flush, and reads see the
+  // contents of every queued memtable
+  std::string num;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+  ASSERT_EQ("3", num);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(std::string(100000, 'y'), Get("k2"));
+  ASSERT_EQ("v4", Get("k4"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::string keys;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    keys += iter->key().ToString() + " ";
+  }
+  delete iter;
+  ASSERT_EQ("foo k1 k2 k3 k4 ", keys);
+  env_->delay_sstable_sync_.Release_Store(NULL);   // Release sync calls
+
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+  ASSERT_EQ("0", num);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v4", Get("k4"));
+
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(std::string(100000, 'z'), Get("k3"));
+  ASSERT_EQ("v4", Get("k4"));
+}
+
+TEST(DBTest, MergeWriteBuffers) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_write_buffer_number = 4;
+  options.merge_write_buffers = true;
+  Reopen(&options);
+
+  env_->delay_sstable_sync_.Release_Store(env_);   // Block sync calls
+  ASSERT_OK(Put("k1", std::string(100000, 'x')));
+  ASSERT_OK(Put("k2", std::string(100000, 'y')));
+  ASSERT_OK(Put("k3", std::string(100000, 'z')));
+  ASSERT_OK(Put("k4", "v4"));
+  env_->delay_sstable_sync_.Release_Store(NULL);   // Release sync calls
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // The memtables queued behind the blocked flush share a table, where
+  // there would be one table for each of the four memtables
+  ASSERT_LE(TotalTableFiles(), 3);
+  ASSERT_EQ(std::string(100000, 'x'), Get("k1"));
+  ASSERT_EQ(std::string(100000, 'z'), Get("k3"));
+  ASSERT_EQ("v4", Get("k4"));
+}
+
 TEST(DBTest, GetFromVersions) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -559,6 +696,44 @@ TEST(DBTest, GetSnapshot) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("d", "vd"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Delete("d"));
+    const Snapshot* s1 = db_->GetSnapshot();
+    ASSERT_OK(Put("a", "va2"));
+
+    // Unsorted, with a missing, a deleted and a repeated key
+    const int n = 6;
+    Slice keys[n] = { "c", "x", "a", "d", "b", "a" };
+    std::string values[n];
+    Status statuses[n];
+    db_->MultiGet(ReadOptions(), n, keys, values, statuses);
+    ASSERT_OK(statuses[0]);
+    ASSERT_EQ("vc", values[0]);
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_OK(statuses[2]);
+    ASSERT_EQ("va2", values[2]);
+    ASSERT_TRUE(statuses[3].IsNotFound());
+    ASSERT_OK(statuses[4]);
+    ASSERT_EQ("vb", values[4]);
+    ASSERT_OK(statuses[5]);
+    ASSERT_EQ("va2", values[5]);
+
+    ReadOptions options;
+    options.snapshot = s1;
+    db_->MultiGet(options, n, keys, values, statuses);
+    ASSERT_EQ("va", values[2]);
+    ASSERT_EQ("va", values[5]);
+    ASSERT_TRUE(statuses[3].IsNotFound());
+    db_->ReleaseSnapshot(s1);
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, GetLevel0Ordering) {
   do {
     // Check that we process level-0 files in correct order.  The code
@@ -969,6 +1144,244 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+
+  // Write three overlapping 8MB files (800 values, each 10K), deleting
+  // some keys in the last one and holding a snapshot of the first, so the
+  // split compaction has both entries to drop and entries to keep.
+  std::vector<std::string> values(800), old_values(800);
+  const Snapshot* snapshot = NULL;
+  for (int pass = 0; pass < 3; pass++) {
+    for (int i = 0; i < 800; i++) {
+      if (pass == 2 && i % 7 == 0) {
+        ASSERT_OK(Delete(Key(i)));
+        values[i] = "NOT_FOUND";
+      } else {
+        values[i] = RandomString(&rnd, 10000);
+        ASSERT_OK(Put(Key(i), values[i]));
+      }
+    }
+    if (pass == 0) {
+      old_values = values;
+      snapshot = db_->GetSnapshot();
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  dbfull()->CompactRange(NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  for (int i = 0; i < 800; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+    ASSERT_EQ(Get(Key(i), snapshot), old_values[i]);
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(count, 800 - 115);
+  db_->ReleaseSnapshot(snapshot);
+}
+
+namespace {
+// Runs every background job on a thread of its own, as an Env with a
+// thread pool would, and keeps track of how many ran at the same time.
+class ConcurrentJobsEnv : public EnvWrapper {
+ public:
+  explicit ConcurrentJobsEnv(Env* base)
+      : EnvWrapper(base), running_(0), max_running_(0) {
+  }
+  ~ConcurrentJobsEnv() {
+    while (Running() > 0) {
+      DelayMilliseconds(10);
+    }
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    Schedule(function, arg, LOW);
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg, Priority pri) {
+    Job* job = new Job;
+    job->env = this;
+    job->function = function;
+    job->arg = arg;
+    MutexLock l(&mu_);
+    running_++;
+    max_running_ = std::max(max_running_, running_);
+    StartThread(&ConcurrentJobsEnv::Run, job);
+  }
+
+  int Running() {
+    MutexLock l(&mu_);
+    return running_;
+  }
+
+  int MaxRunning() {
+    MutexLock l(&mu_);
+    return max_running_;
+  }
+
+ private:
+  struct Job {
+    ConcurrentJobsEnv* env;
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void Run(void* arg) {
+    Job* job = reinterpret_cast<Job*>(arg);
+    (*job->function)(job->arg);
+    MutexLock l(&job->env->mu_);
+    job->env->running_--;
+    delete job;
+  }
+
+  port::Mutex mu_;
+  int running_;
+  int max_running_;
+};
+}  // namespace
+
+TEST(DBTest, ConcurrentCompactions) {
+  ConcurrentJobsEnv env(env_);
+  Options options = CurrentOptions();
+  options.env = &env;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Overwrite 40000 keys at random until well past the size of level-1,
+  // so that flushes and compactions of several levels overlap.
+  Random rnd(301);
+  std::vector<std::string> values(40000);
+  for (int i = 0; i < 80000; i++) {
+    const int k = rnd.Uniform(40000);
+    values[k] = RandomString(&rnd, 500);
+    ASSERT_OK(Put(Key(k), values[k]));
+  }
+  dbfull()->CompactRange(NULL, NULL);
+  ASSERT_GT(env.MaxRunning(), 1);
+
+  Reopen(&options);
+  for (int k = 0; k < 40000; k++) {
+    ASSERT_EQ(Get(Key(k)), values[k].empty() ? "NOT_FOUND" : values[k]);
+  }
+  Close();
+}
+
+namespace {
+// Runs the LOW jobs one after another on a single thread, as a LOW pool
+// of one thread would, and records the longest queue of waiting jobs.
+class OneLowThreadEnv : public EnvWrapper {
+ public:
+  explicit OneLowThreadEnv(Env* base)
+      : EnvWrapper(base), cv_(&mu_), started_(false), exiting_(false),
+        exited_(false), max_queued_(0) {
+  }
+  ~OneLowThreadEnv() {
+    MutexLock l(&mu_);
+    exiting_ = true;
+    cv_.SignalAll();
+    while (started_ && !exited_) {
+      cv_.Wait();
+    }
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    Schedule(function, arg, LOW);
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg, Priority pri) {
+    if (pri != LOW) {
+      target()->Schedule(function, arg, pri);
+      return;
+    }
+    MutexLock l(&mu_);
+    if (!started_) {
+      started_ = true;
+      StartThread(&OneLowThreadEnv::Run, this);
+    }
+    jobs_.push_back(Job(function, arg));
+    max_queued_ = std::max(max_queued_, static_cast<int>(jobs_.size()));
+    cv_.SignalAll();
+  }
+
+  int MaxQueued() {
+    MutexLock l(&mu_);
+    return max_queued_;
+  }
+
+ private:
+  typedef std::pair<void (*)(void*), void*> Job;
+
+  static void Run(void* arg) {
+    reinterpret_cast<OneLowThreadEnv*>(arg)->RunJobs();
+  }
+
+  void RunJobs() {
+    MutexLock l(&mu_);
+    while (!jobs_.empty() || !exiting_) {
+      if (jobs_.empty()) {
+        cv_.Wait();
+        continue;
+      }
+      Job job = jobs_.front();
+      jobs_.pop_front();
+      mu_.Unlock();
+      (*job.first)(job.second);
+      mu_.Lock();
+    }
+    exited_ = true;
+    cv_.SignalAll();
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<Job> jobs_;
+  bool started_;
+  bool exiting_;
+  bool exited_;
+  int max_queued_;
+};
+}  // namespace
+
+TEST(DBTest, SubcompactionsOnOneThread) {
+  // The subcompactions are queued behind the compaction that waits for
+  // them, so it must merge their ranges itself
+  OneLowThreadEnv env(env_);
+  Options options = CurrentOptions();
+  options.env = &env;
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values(800);
+  for (int pass = 0; pass < 3; pass++) {
+    for (int i = 0; i < 800; i++) {
+      values[i] = RandomString(&rnd, 10000);
+      ASSERT_OK(Put(Key(i), values[i]));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  dbfull()->CompactRange(NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GT(env.MaxQueued(), 1);
+  for (int i = 0; i < 800; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  Close();
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -976,8 +1389,9 @@ TEST(DBTest, RepeatedWritesToSameKey) {
   Reopen(&options);
 
   // We must have at most one file per level except for level-0,
-  // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  // which may have up to level0_stop_writes_trigger files.
+  const int kMaxFiles =
+      config::kNumLevels + options.level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1632,6 +2046,49 @@ TEST(DBTest, MissingSSTFile) {
       << s.ToString();
 }
 
+TEST(DBTest, WriteStall) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.level0_slowdown_writes_trigger = 4;
+  options.level0_stop_writes_trigger = 100;
+  options.delayed_write_rate = 1 << 20;
+  Reopen(&options);
+
+  // Pile up level-0 files while compactions are held back
+  env_->delay_compactions_.Release_Store(env_);
+  for (int i = 0; i < 10 && NumTableFilesAtLevel(0) < 4; i++) {
+    MakeTables(1, "a", "z");
+  }
+  ASSERT_EQ(4, NumTableFilesAtLevel(0));
+  std::string rate;
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &rate));
+  ASSERT_EQ("1048576", rate);
+
+  // Writes are paced, not stopped
+  const int sleeps = env_->sleep_counter_.Read();
+  for (int i = 0; i < 20; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'x')));
+  }
+  ASSERT_GT(env_->sleep_counter_.Read(), sleeps);
+  std::string micros;
+  ASSERT_TRUE(db_->GetProperty("leveldb.stall-micros", &micros));
+  ASSERT_GT(atoi(micros.c_str()), 100000);
+
+  // The pace drops while level-0 grows
+  MakeTables(1, "a", "z");
+  ASSERT_EQ(5, NumTableFilesAtLevel(0));
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &rate));
+  ASSERT_EQ("838860", rate);
+
+  // And writes go through unpaced once compactions catch up
+  env_->delay_compactions_.Release_Store(NULL);
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &rate));
+  ASSERT_EQ("0", rate);
+  ASSERT_EQ(std::string(10000, 'x'), Get(Key(19)));
+}
+
 TEST(DBTest, FilesDeletedAfterCompaction) {
   ASSERT_OK(Put("foo", "v2"));
   Compact("a", "z");
@@ -1690,6 +2147,267 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST(DBTest, WholeTableFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewCacheLocalBloomFilterPolicy(10);
+  options.whole_table_filter = true;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_sstable_sync_.Release_Store(env_);
+
+  // Lookup present keys.  Should rarely read from small sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2*N/100);
+
+  // Lookup missing keys.  Should rarely read from either sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3*N/100);
+
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+static std::string PrefixKey(int tenant, int entity, int ts) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "t%03d/e%03d/%06d", tenant, entity, ts);
+  return std::string(buf);
+}
+
+// Returns the entries with the prefix of target that a prefix seek
+// iterator finds
+static std::string PrefixScan(DB* db, const std::string& target) {
+  const size_t prefix_len = target.rfind('/') + 1;
+  ReadOptions options;
+  options.prefix_seek = true;
+  Iterator* iter = db->NewIterator(options);
+  std::string result;
+  for (iter->Seek(target);
+       iter->Valid() && iter->key().starts_with(Slice(target.data(),
+                                                      prefix_len));
+       iter->Next()) {
+    result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+  }
+  delete iter;
+  return result;
+}
+
+TEST(DBTest, PrefixSeek) {
+  const SliceTransform* prefix_extractor = NewDelimitedPrefixTransform('/', 2);
+  const FilterPolicy* filter_policy = NewBloomFilterPolicy(10);
+  do {
+    Options options = CurrentOptions();
+    if (options.filter_policy == NULL) {
+      options.filter_policy = filter_policy;
+    }
+    options.prefix_extractor = prefix_extractor;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // Every other entity of every tenant, spread over two levels and the
+    // memtable
+    for (int t = 0; t < 4; t++) {
+      for (int e = 0; e < 40; e += 2) {
+        for (int ts = 0; ts < 5; ts++) {
+          ASSERT_OK(Put(PrefixKey(t, e, ts), "v1"));
+        }
+      }
+    }
+    Compact("a", "z");
+    for (int t = 0; t < 4; t++) {
+      ASSERT_OK(Put(PrefixKey(t, 10, 2), "v2"));
+      ASSERT_OK(Delete(PrefixKey(t, 10, 3)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put(PrefixKey(1, 20, 7), "v3"));
+
+    for (int t = 0; t < 4; t++) {
+      ASSERT_EQ(PrefixKey(t, 10, 0) + "=v1 " + PrefixKey(t, 10, 1) + "=v1 " +
+                PrefixKey(t, 10, 2) + "=v2 " + PrefixKey(t, 10, 4) + "=v1 ",
+                PrefixScan(db_, PrefixKey(t, 10, 0)));
+      ASSERT_EQ(PrefixKey(t, 4, 3) + "=v1 " + PrefixKey(t, 4, 4) + "=v1 ",
+                PrefixScan(db_, PrefixKey(t, 4, 3)));
+      for (int e = 1; e < 40; e += 2) {
+        ASSERT_EQ("", PrefixScan(db_, PrefixKey(t, e, 0)));
+      }
+    }
+    ASSERT_EQ(PrefixKey(1, 20, 4) + "=v1 " + PrefixKey(1, 20, 7) + "=v3 ",
+              PrefixScan(db_, PrefixKey(1, 20, 4)));
+  } while (ChangeOptions());
+  delete prefix_extractor;
+  delete filter_policy;
+}
+
+TEST(DBTest, PrefixSeekSkipsTables) {
+  const SliceTransform* prefix_extractor = NewDelimitedPrefixTransform('/', 2);
+  for (int whole_table = 0; whole_table < 2; whole_table++) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.prefix_extractor = prefix_extractor;
+    options.whole_table_filter = (whole_table != 0);
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // Populate multiple layers
+    for (int t = 0; t < 10; t++) {
+      for (int e = 0; e < 100; e += 2) {
+        for (int ts = 0; ts < 10; ts++) {
+          ASSERT_OK(Put(PrefixKey(t, e, ts), "v"));
+        }
+      }
+    }
+    Compact("a", "z");
+    for (int t = 0; t < 10; t++) {
+      for (int e = 0; e < 100; e += 10) {
+        ASSERT_OK(Put(PrefixKey(t, e, 0), "v"));
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+
+    // Prevent auto compactions triggered by seeks
+    env_->delay_sstable_sync_.Release_Store(env_);
+
+    // Scans of missing prefixes should rarely read a data block
+    const int N = 500;
+    env_->random_read_counter_.Reset();
+    for (int t = 0; t < 10; t++) {
+      for (int e = 1; e < 100; e += 2) {
+        ASSERT_EQ("", PrefixScan(db_, PrefixKey(t, e, 0)));
+      }
+    }
+    int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "%d missing prefixes => %d reads\n", N, reads);
+    ASSERT_LE(reads, 3*N/100);
+
+    // Scans of present prefixes read one or two blocks per table
+    env_->random_read_counter_.Reset();
+    for (int t = 0; t < 10; t++) {
+      for (int e = 0; e < 100; e += 2) {
+        ASSERT_EQ(10 * (PrefixKey(t, e, 0).size() + 3),
+                  PrefixScan(db_, PrefixKey(t, e, 0)).size());
+      }
+    }
+    reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "%d present prefixes => %d reads\n", N, reads);
+    ASSERT_GE(reads, N);
+
+    env_->delay_sstable_sync_.Release_Store(NULL);
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+  delete prefix_extractor;
+}
+
+TEST(DBTest, PartitionedFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 256;
+  // Room for the index and filter partitions, but not for the data
+  options.block_cache = NewLRUCache(64 << 10, 0, 0.5);
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_sstable_sync_.Release_Store(env_);
+
+  // The first pass loads the index and filter partitions into the cache
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  // Lookup missing keys.  Should rarely read from the sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3*N/100);
+
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, CacheIndexAndFilterBlocks) {
+  uint64_t readers_mem[2];
+  uint64_t cache_usage[2];
+  const FilterPolicy* filter_policy = NewBloomFilterPolicy(10);
+  for (int cached = 0; cached < 2; cached++) {
+    Options options = CurrentOptions();
+    options.filter_policy = filter_policy;
+    options.block_cache = NewLRUCache(1 << 20, 4, 0.5);
+    options.cache_index_and_filter_blocks = (cached != 0);
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_OK(Put(Key(i), std::string(100, 'v')));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_EQ(std::string(100, 'v'), Get(Key(i)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+
+    std::string value;
+    Slice in;
+    ASSERT_TRUE(db_->GetProperty("leveldb.table-readers-mem", &value));
+    in = value;
+    ASSERT_TRUE(ConsumeDecimalNumber(&in, &readers_mem[cached]));
+    ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-usage", &value));
+    in = value;
+    ASSERT_TRUE(ConsumeDecimalNumber(&in, &cache_usage[cached]));
+    ASSERT_EQ(cache_usage[cached], options.block_cache->TotalCharge());
+    Close();
+    delete options.block_cache;
+  }
+  delete filter_policy;
+
+  // The index and filter blocks moved from the tables to the cache
+  ASSERT_GT(readers_mem[0], readers_mem[1] + 1000);
+  ASSERT_GT(cache_usage[1], cache_usage[0] + 1000);
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -1788,6 +2506,144 @@ TEST(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+namespace {
+// Writers of a group insert their batches into the memtable in parallel
+struct CWState {
+  static const int kThreads = 8;
+  static const int kBatches = 500;
+
+  DB* db;
+  port::Mutex mu;
+  int next_id;
+  int done;
+};
+
+static void CWThreadBody(void* arg) {
+  CWState* state = reinterpret_cast<CWState*>(arg);
+  int id;
+  {
+    MutexLock l(&state->mu);
+    id = state->next_id++;
+  }
+  for (int i = 0; i < CWState::kBatches; i++) {
+    // Two keys per batch so that a batch takes two sequence numbers
+    char key[30];
+    WriteBatch batch;
+    snprintf(key, sizeof(key), "a%02d.%06d", id, i);
+    batch.Put(key, key + 1);
+    snprintf(key, sizeof(key), "b%02d.%06d", id, i);
+    batch.Put(key, key + 1);
+    // Sync writes leave the other threads time to queue up into groups
+    WriteOptions write_options;
+    write_options.sync = true;
+    ASSERT_OK(state->db->Write(write_options, &batch));
+  }
+  MutexLock l(&state->mu);
+  state->done++;
+}
+}  // namespace
+
+TEST(DBTest, ConcurrentMemtableWrites) {
+  do {
+    Options options = CurrentOptions();
+    options.allow_concurrent_memtable_write = true;
+    options.write_buffer_size = 100000;  // Small write buffer
+    Reopen(&options);
+
+    CWState state;
+    state.db = db_;
+    state.next_id = 0;
+    state.done = 0;
+    for (int i = 0; i < CWState::kThreads; i++) {
+      env_->StartThread(CWThreadBody, &state);
+    }
+    while (true) {
+      state.mu.Lock();
+      const int done = state.done;
+      state.mu.Unlock();
+      if (done == CWState::kThreads) {
+        break;
+      }
+      DelayMilliseconds(10);
+    }
+
+    // Every write took the sequence numbers of its own keys
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_EQ(2 * CWState::kThreads * CWState::kBatches,
+              reinterpret_cast<const SnapshotImpl*>(snapshot)->number_);
+    db_->ReleaseSnapshot(snapshot);
+
+    for (int id = 0; id < CWState::kThreads; id++) {
+      for (int i = 0; i < CWState::kBatches; i++) {
+        char key[30];
+        snprintf(key, sizeof(key), "a%02d.%06d", id, i);
+        ASSERT_EQ(key + 1, Get(key));
+        snprintf(key, sizeof(key), "b%02d.%06d", id, i);
+        ASSERT_EQ(key + 1, Get(key));
+      }
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    delete iter;
+    ASSERT_EQ(2 * CWState::kThreads * CWState::kBatches, count);
+  } while (ChangeOptions());
+}
+
+namespace {
+// Reads once, which leaves a SuperVersion in the thread's cache, and
+// then idles until it is stopped
+struct IdleReaderState {
+  DB* db;
+  port::AtomicPointer read;
+  port::AtomicPointer stop;
+  port::AtomicPointer done;
+};
+
+static void IdleReaderBody(void* arg) {
+  IdleReaderState* state = reinterpret_cast<IdleReaderState*>(arg);
+  std::string value;
+  ASSERT_OK(state->db->Get(ReadOptions(), "foo", &value));
+  ASSERT_EQ("v1", value);
+  state->read.Release_Store(state);
+  while (state->stop.Acquire_Load() == NULL) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  state->done.Release_Store(state);
+}
+}  // namespace
+
+TEST(DBTest, IdleReaderDoesNotPinFiles) {
+  ASSERT_OK(Put("foo", "v1"));
+  dbfull()->TEST_CompactMemTable();
+
+  IdleReaderState state;
+  state.db = db_;
+  state.read.Release_Store(NULL);
+  state.stop.Release_Store(NULL);
+  state.done.Release_Store(NULL);
+  env_->StartThread(IdleReaderBody, &state);
+  while (state.read.Acquire_Load() == NULL) {
+    DelayMilliseconds(1);
+  }
+
+  // Replace the table the reader saw.  The SuperVersion it cached must
+  // not keep the replaced table on disk.
+  ASSERT_OK(Put("foo", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  Compact("a", "z");
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ(1, CountTableFiles());
+  ASSERT_EQ("v2", Get("foo"));
+
+  state.stop.Release_Store(&state);
+  while (state.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(1);
+  }
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -5,7 +5,9 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Writes require external synchronization, most likely a mutex.  The
+// exception is InsertConcurrently(), which may run in several threads at
+// once as long as no Insert() runs at the same time.
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -49,6 +51,12 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but may be called from several threads at once.  The
+  // nodes are linked with compare-and-swap and allocated with
+  // Arena::AllocateAlignedConcurrently().
+  // REQUIRES: no concurrent call to Insert().
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -100,8 +108,8 @@ class SkipList {
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
   port::AtomicPointer max_height_;   // Height of the entire list
 
   inline int GetMaxHeight() const {
@@ -112,8 +120,13 @@ class SkipList {
   // Read/written only by Insert().
   Random rnd_;
 
+  // Number of heights drawn by InsertConcurrently()
+  port::AtomicPointer concurrent_draws_;
+
   Node* NewNode(const Key& key, int height);
+  Node* NewNodeConcurrently(const Key& key, int height);
   int RandomHeight();
+  int RandomHeightConcurrently();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -171,6 +184,13 @@ struct SkipList<Key,Comparator>::Node {
     next_[n].NoBarrier_Store(x);
   }
 
+  // Link "x" at level n iff the next node is still "expected".  Has the
+  // barrier of SetNext().
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].CompareAndSwap(expected, x);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   port::AtomicPointer next_[1];
@@ -184,6 +204,14 @@ SkipList<Key,Comparator>::NewNode(const Key& key, int height) {
   return new (mem) Node(key);
 }
 
+template<typename Key, class Comparator>
+typename SkipList<Key,Comparator>::Node*
+SkipList<Key,Comparator>::NewNodeConcurrently(const Key& key, int height) {
+  char* mem = arena_->AllocateAlignedConcurrently(
+      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+  return new (mem) Node(key);
+}
+
 template<typename Key, class Comparator>
 inline SkipList<Key,Comparator>::Iterator::Iterator(const SkipList* list) {
   list_ = list;
@@ -249,6 +277,31 @@ int SkipList<Key,Comparator>::RandomHeight() {
   return height;
 }
 
+template<typename Key, class Comparator>
+int SkipList<Key,Comparator>::RandomHeightConcurrently() {
+  // rnd_ cannot be shared between threads.  Instead every call takes the
+  // next value of a counter and scrambles it (the finalizer of
+  // MurmurHash3), using two bits per level for the 1 in 4 branching of
+  // RandomHeight().
+  void* draw;
+  do {
+    draw = concurrent_draws_.NoBarrier_Load();
+  } while (!concurrent_draws_.CompareAndSwap(
+      draw, reinterpret_cast<char*>(draw) + 1));
+  uint32_t bits = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(draw));
+  bits ^= bits >> 16;
+  bits *= 0x85ebca6b;
+  bits ^= bits >> 13;
+  bits *= 0xc2b2ae35;
+  bits ^= bits >> 16;
+  int height = 1;
+  while (height < kMaxHeight && (bits & 3) == 0) {
+    height++;
+    bits >>= 2;
+  }
+  return height;
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   // NULL n is considered infinite
@@ -324,7 +377,8 @@ SkipList<Key,Comparator>::SkipList(Comparator cmp, Arena* arena)
       arena_(arena),
       head_(NewNode(0 /* any key will do */, kMaxHeight)),
       max_height_(reinterpret_cast<void*>(1)),
-      rnd_(0xdeadbeef) {
+      rnd_(0xdeadbeef),
+      concurrent_draws_(NULL) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, NULL);
   }
@@ -366,6 +420,48 @@ void SkipList<Key,Comparator>::Insert(const Key& key) {
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::InsertConcurrently(const Key& key) {
+  int height = RandomHeightConcurrently();
+
+  // Raise max_height_ first, so that the search below fills prev[] for
+  // every level of the new node.  Readers see the new levels of head_ as
+  // NULL until a node is linked there, as in Insert().
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    if (max_height_.CompareAndSwap(reinterpret_cast<void*>(max_height),
+                                   reinterpret_cast<void*>(height))) {
+      break;
+    }
+    max_height = GetMaxHeight();
+  }
+
+  Node* prev[kMaxHeight];
+  FindGreaterOrEqual(key, prev);
+
+  // Link from the bottom up, so that a reader that finds the node at some
+  // level also finds it at the levels below.  When another thread linked
+  // a node after prev[i] meanwhile, the CAS fails and we move prev[i]
+  // forward past the nodes now before key.  Nodes are never removed, so
+  // prev[i] stays before key.
+  Node* x = NewNodeConcurrently(key, height);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      Node* next = prev[i]->Next(i);
+      if (KeyIsAfterNode(key, next)) {
+        prev[i] = next;
+        continue;
+      }
+      // Our data structure does not allow duplicate insertion
+      assert(next == NULL || !Equal(key, next->key));
+      x->NoBarrier_SetNext(i, next);
+      if (prev[i]->CASNext(i, next, x)) {
+        break;
+      }
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, NULL);
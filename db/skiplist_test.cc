@@ -3,10 +3,13 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/skiplist.h"
+#include <algorithm>
 #include <set>
+#include <vector>
 #include "leveldb/env.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -371,6 +374,121 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads insert disjoint sets of keys with InsertConcurrently()
+// while a reader checks that the list stays sorted.
+class ConcurrentInsertState {
+ public:
+  static const int kThreads = 4;
+  static const int kKeysPerThread = 5000;
+
+  Arena arena_;
+  SkipList<Key, Comparator> list_;
+  port::AtomicPointer quit_flag_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  int running_;
+  int next_thread_;
+  int64_t bad_reads_;
+
+  ConcurrentInsertState()
+      : list_(Comparator(), &arena_),
+        quit_flag_(NULL),
+        cv_(&mu_),
+        running_(0),
+        next_thread_(0),
+        bad_reads_(0) { }
+
+  void Done() {
+    MutexLock l(&mu_);
+    running_--;
+    cv_.SignalAll();
+  }
+};
+
+static void ConcurrentInserter(void* arg) {
+  ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+  int id;
+  {
+    MutexLock l(&state->mu_);
+    id = state->next_thread_++;
+  }
+  // Insert the keys of this thread in a random order
+  std::vector<Key> keys;
+  for (int i = 0; i < ConcurrentInsertState::kKeysPerThread; i++) {
+    keys.push_back(static_cast<Key>(i) * ConcurrentInsertState::kThreads + id);
+  }
+  Random rnd(1000 + id);
+  for (size_t i = keys.size() - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    state->list_.InsertConcurrently(keys[i]);
+  }
+  state->Done();
+}
+
+static void SortedReader(void* arg) {
+  ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+  int64_t bad_reads = 0;
+  while (!state->quit_flag_.Acquire_Load()) {
+    SkipList<Key, Comparator>::Iterator iter(&state->list_);
+    iter.SeekToFirst();
+    Key last = 0;
+    bool first = true;
+    for (; iter.Valid(); iter.Next()) {
+      if (!first && iter.key() <= last) {
+        bad_reads++;
+      }
+      last = iter.key();
+      first = false;
+    }
+  }
+  MutexLock l(&state->mu_);
+  state->bad_reads_ = bad_reads;
+  state->running_--;
+  state->cv_.SignalAll();
+}
+
+TEST(SkipTest, ConcurrentInsert) {
+  ConcurrentInsertState state;
+  state.running_ = ConcurrentInsertState::kThreads + 1;
+  Env::Default()->StartThread(SortedReader, &state);
+  for (int i = 0; i < ConcurrentInsertState::kThreads; i++) {
+    Env::Default()->StartThread(ConcurrentInserter, &state);
+  }
+  {
+    MutexLock l(&state.mu_);
+    while (state.running_ > 1) {
+      state.cv_.Wait();
+    }
+  }
+  state.quit_flag_.Release_Store(&state);  // Any non-NULL arg will do
+  {
+    MutexLock l(&state.mu_);
+    while (state.running_ > 0) {
+      state.cv_.Wait();
+    }
+  }
+  ASSERT_EQ(0, state.bad_reads_);
+
+  const int kTotal =
+      ConcurrentInsertState::kThreads * ConcurrentInsertState::kKeysPerThread;
+  SkipList<Key, Comparator>::Iterator iter(&state.list_);
+  iter.SeekToFirst();
+  for (int i = 0; i < kTotal; i++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(static_cast<Key>(i), iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (int i = kTotal - 1; i >= 0; i -= 97) {
+    ASSERT_TRUE(state.list_.Contains(i));
+    iter.Seek(i);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(static_cast<Key>(i), iter.key());
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -8,16 +8,23 @@
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  TableCache* owner;
+  size_t memory_usage;
 };
 
-static void DeleteEntry(const Slice& key, void* value) {
+void TableCache::DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  {
+    MutexLock l(&tf->owner->mu_);
+    tf->owner->memory_usage_ -= tf->memory_usage;
+  }
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -35,7 +42,8 @@ TableCache::TableCache(const std::string& dbname,
     : env_(options->env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      memory_usage_(0) {
 }
 
 TableCache::~TableCache() {
@@ -67,6 +75,12 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->owner = this;
+      tf->memory_usage = table->ApproximateMemoryUsage();
+      {
+        MutexLock l(&mu_);
+        memory_usage_ += tf->memory_usage;
+      }
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -118,4 +132,9 @@ void TableCache::Evict(uint64_t file_number) {
   cache_->Erase(Slice(buf, sizeof(buf)));
 }
 
+size_t TableCache::ApproximateMemoryUsage() {
+  MutexLock l(&mu_);
+  return memory_usage_;
+}
+
 }  // namespace leveldb
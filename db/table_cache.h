@@ -47,13 +47,21 @@ class TableCache {
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Return the number of bytes held in memory by the open tables,
+  // outside of the block cache.
+  size_t ApproximateMemoryUsage();
+
  private:
   Env* const env_;
   const std::string dbname_;
   const Options* options_;
   Cache* cache_;
 
+  port::Mutex mu_;
+  size_t memory_usage_;  // Guarded by mu_
+
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  static void DeleteEntry(const Slice& key, void* value);
 };
 
 }  // namespace leveldb
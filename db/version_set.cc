@@ -974,6 +974,7 @@ void VersionSet::Finalize(Version* v) {
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
       score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
     }
+    v->level_score_[level] = score;
 
     if (score > best_score) {
       best_level = level;
@@ -983,6 +984,30 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate the compaction debt.  Level-0 is merged into level-1 as a
+  // whole.  A level over its limit moves its excess into the next level,
+  // rewriting the overlapping bytes there, and the excess counts towards
+  // the size of the next level.
+  uint64_t pending = 0;
+  uint64_t carried = 0;
+  if (v->files_[0].size() >= config::kL0_CompactionTrigger) {
+    carried = TotalFileSize(v->files_[0]);
+    pending += carried + TotalFileSize(v->files_[1]);
+  }
+  for (int level = 1; level < config::kNumLevels-1; level++) {
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]) + carried;
+    carried = 0;
+    if (level_bytes > MaxBytesForLevel(level)) {
+      const uint64_t excess =
+          level_bytes - static_cast<uint64_t>(MaxBytesForLevel(level));
+      const double fanout = static_cast<double>(
+          TotalFileSize(v->files_[level + 1])) / level_bytes;
+      pending += static_cast<uint64_t>(excess * (fanout + 1));
+      carried = excess;
+    }
+  }
+  v->pending_compaction_bytes_ = pending;
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1199,43 +1224,76 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+namespace {
+bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  Compaction* c = NULL;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != NULL);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+  // the compactions triggered by seeks.  Levels are tried from the
+  // highest score down, so a level whose files are all busy does not
+  // hold up the others.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  for (int i = 0; i < config::kNumLevels - 1 && c == NULL; i++) {
+    for (int j = i + 1; j < config::kNumLevels - 1; j++) {
+      if (current_->level_score_[levels[j]] >
+          current_->level_score_[levels[i]]) {
+        std::swap(levels[i], levels[j]);
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    const int level = levels[i];
+    if (current_->level_score_[level] < 1) {
+      break;
+    }
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    if (level == 0 && AnyBeingCompacted(files)) {
+      // Level-0 files may overlap each other and must reach level-1 in
+      // order, so only one compaction takes level-0 files at a time
+      continue;
+    }
+
+    // Pick the first file that comes after compact_pointer_[level],
+    // wrapping around to the beginning of the key space, whose
+    // compaction does not need any busy files.
+    size_t start = 0;
+    while (start < files.size() &&
+           !compact_pointer_[level].empty() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    for (size_t k = 0; k < files.size() && c == NULL; k++) {
+      c = SetupCompaction(level, files[(start + k) % files.size()]);
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return NULL;
   }
 
-  c->input_version_ = current_;
-  c->input_version_->Ref();
+  if (c == NULL && current_->file_to_compact_ != NULL) {
+    const int level = current_->file_to_compact_level_;
+    if (level > 0 || !AnyBeingCompacted(current_->files_[0])) {
+      c = SetupCompaction(level, current_->file_to_compact_);
+    }
+  }
+  return c;
+}
+
+Compaction* VersionSet::SetupCompaction(int level, FileMetaData* f) {
+  if (f->being_compacted) {
+    return NULL;
+  }
+  Compaction* c = new Compaction(level);
+  c->inputs_[0].push_back(f);
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
   if (level == 0) {
@@ -1248,17 +1306,26 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
-  SetupOtherInputs(c);
+  if (AnyBeingCompacted(c->inputs_[0]) || !SetupOtherInputs(c)) {
+    delete c;
+    return NULL;
+  }
 
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->MarkInputs(true);
   return c;
 }
 
-void VersionSet::SetupOtherInputs(Compaction* c) {
+bool VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
   GetRange(c->inputs_[0], &smallest, &largest);
 
   current_->GetOverlappingInputs(level+1, &smallest, &largest, &c->inputs_[1]);
+  if (AnyBeingCompacted(c->inputs_[1])) {
+    return false;
+  }
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
@@ -1273,7 +1340,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
-        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit) {
+        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1318,6 +1386,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // key range next time.
   compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+  return true;
 }
 
 Compaction* VersionSet::CompactRange(
@@ -1348,31 +1417,39 @@ Compaction* VersionSet::CompactRange(
   }
 
   Compaction* c = new Compaction(level);
+  c->inputs_[0] = inputs;
+  if (!SetupOtherInputs(c)) {
+    assert(false);  // Manual compactions do not run along with others
+    delete c;
+    return NULL;
+  }
   c->input_version_ = current_;
   c->input_version_->Ref();
-  c->inputs_[0] = inputs;
-  SetupOtherInputs(c);
+  c->MarkInputs(true);
   return c;
 }
 
 Compaction::Compaction(int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(level)),
-      input_version_(NULL),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
-  }
+      input_version_(NULL) {
 }
 
 Compaction::~Compaction() {
   if (input_version_ != NULL) {
+    MarkInputs(false);
     input_version_->Unref();
   }
 }
 
+void Compaction::MarkInputs(bool being_compacted) {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      inputs_[which][i]->being_compacted = being_compacted;
+    }
+  }
+}
+
 bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
@@ -1390,13 +1467,23 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+Compaction::Position::Position()
+    : grandparent_index(0),
+      seen_key(false),
+      overlapped_bytes(0) {
+  for (int i = 0; i < config::kNumLevels; i++) {
+    level_ptrs[i] = 0;
+  }
+}
+
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Position* pos) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; pos->level_ptrs[lvl] < files.size(); ) {
+      FileMetaData* f = files[pos->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1405,36 +1492,84 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      pos->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Position* pos) const {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (pos->grandparent_index < grandparents_.size() &&
       icmp->Compare(internal_key,
-                    grandparents_[grandparent_index_]->largest.Encode()) > 0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                    grandparents_[pos->grandparent_index]->largest.Encode())
+      > 0) {
+    if (pos->seen_key) {
+      pos->overlapped_bytes +=
+          grandparents_[pos->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    pos->grandparent_index++;
   }
-  seen_key_ = true;
+  pos->seen_key = true;
 
-  if (overlapped_bytes_ > kMaxGrandParentOverlapBytes) {
+  if (pos->overlapped_bytes > kMaxGrandParentOverlapBytes) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    pos->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+namespace {
+struct SmallestKeyFirst {
+  const InternalKeyComparator* icmp;
+
+  explicit SmallestKeyFirst(const InternalKeyComparator* c) : icmp(c) { }
+
+  bool operator()(FileMetaData* f1, FileMetaData* f2) const {
+    return icmp->Compare(f1->smallest, f2->smallest) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetSplitPoints(int max_ranges,
+                                std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (max_ranges <= 1) {
+    return;
+  }
+  const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
+  const Comparator* user_cmp = icmp->user_comparator();
+  std::vector<FileMetaData*> files(inputs_[0]);
+  files.insert(files.end(), inputs_[1].begin(), inputs_[1].end());
+  std::sort(files.begin(), files.end(), SmallestKeyFirst(icmp));
+
+  // Start a new range at the first file that begins past the next
+  // multiple of total/max_ranges bytes.
+  const int64_t total = TotalFileSize(files);
+  int64_t before = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    const int ranges = static_cast<int>(boundaries->size()) + 1;
+    if (ranges >= max_ranges) {
+      break;
+    }
+    const Slice key = files[i]->smallest.user_key();
+    if (before * max_ranges >= total * ranges &&
+        user_cmp->Compare(key, files[0]->smallest.user_key()) > 0 &&
+        (boundaries->empty() ||
+         user_cmp->Compare(key, Slice(boundaries->back())) > 0)) {
+      boundaries->push_back(key.ToString());
+    }
+    before += files[i]->file_size;
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
+    MarkInputs(false);
     input_version_->Unref();
     input_version_ = NULL;
   }
@@ -126,18 +126,27 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
-  // Level that should be compacted next and its compaction score.
-  // Score < 1 means compaction is not strictly needed.  These fields
-  // are initialized by Finalize().
+  // Level that should be compacted next and its compaction score, and
+  // the score of every level.  Score < 1 means compaction is not strictly
+  // needed.  These fields are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+  double level_score_[config::kNumLevels];
+
+  // Estimated bytes compactions must rewrite to bring every level within
+  // its limit.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
 
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_score_[level] = -1;
+    }
   }
 
   ~Version();
@@ -190,13 +199,22 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return an estimate of the bytes compactions must rewrite before
+  // every level of the current version is within its limit.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
+  // Return the last sequence number.  Unlike the rest of the VersionSet,
+  // may be called without holding the DB mutex.
+  uint64_t LastSequence() const {
+    return port::Acquire_Load64(&last_sequence_);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
     assert(s >= last_sequence_);
-    last_sequence_ = s;
+    port::Release_Store64(&last_sequence_, s);
   }
 
   // Mark the specified file number as used.
@@ -209,16 +227,20 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
+  // Pick level and inputs for a new compaction.  Files that are inputs
+  // of compactions still running are left alone, so several compactions
+  // may run at once.
   // Returns NULL if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  // REQUIRES: mu is held, and no edit is being applied by LogAndApply()
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns NULL if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no other compaction is running
   Compaction* CompactRange(
       int level,
       const InternalKey* begin,
@@ -270,7 +292,13 @@ class VersionSet {
                  InternalKey* smallest,
                  InternalKey* largest);
 
-  void SetupOtherInputs(Compaction* c);
+  // Build a compaction of "level" that starts from file "f".  Returns
+  // NULL if any of the files it needs is being compacted.
+  Compaction* SetupCompaction(int level, FileMetaData* f);
+
+  // Add the "level+1" inputs and the grandparents of *c.  Returns false,
+  // leaving the compaction pointer alone, if any input is being compacted.
+  bool SetupOtherInputs(Compaction* c);
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
@@ -334,17 +362,42 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // State of one pass over the compaction's keys in increasing order,
+  // advanced by IsBaseLevelForKey() and ShouldStopBefore().  Each
+  // subcompaction walks its key range with a Position of its own.
+  struct Position {
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // level_ptrs[] holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+
+    Position();
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Position* pos) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Position* pos) const;
+
+  // Store in *boundaries up to "max_ranges - 1" user keys that split the
+  // compaction's inputs into key ranges of roughly equal size, in
+  // increasing order.  Each boundary is the smallest key of an input file.
+  void GetSplitPoints(int max_ranges, std::vector<std::string>* boundaries)
+      const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  The inputs are no longer marked as being compacted.
+  // REQUIRES: mu is held
   void ReleaseInputs();
 
  private:
@@ -353,6 +406,9 @@ class Compaction {
 
   explicit Compaction(int level);
 
+  // Set FileMetaData::being_compacted on all inputs.
+  void MarkInputs(bool being_compacted);
+
   int level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
@@ -361,21 +417,9 @@ class Compaction {
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
 
-  // State used to check for number of of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Grandparent files, used to check for the number of overlapping
+  // grandparent files (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
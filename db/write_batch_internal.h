@@ -40,6 +40,11 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Same as InsertInto(), but other batches may be inserted into memtable
+  // by other threads at the same time, see MemTable::AddConcurrently().
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       MemTable* memtable);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -0,0 +1,45 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <assert.h>
+
+namespace leveldb {
+
+// Bytes a writer may write at once, in micros of the rate
+static const uint64_t kMaxBurstMicros = 1000;
+
+WriteController::WriteController(uint64_t rate)
+    : delayed_(false),
+      rate_(rate),
+      next_write_micros_(0) {
+  assert(rate > 0);
+}
+
+void WriteController::set_delayed_write_rate(uint64_t rate) {
+  assert(rate > 0);
+  rate_ = rate;
+}
+
+void WriteController::Charge(uint64_t now_micros, uint64_t num_bytes) {
+  if (!delayed_) {
+    return;
+  }
+  const uint64_t earliest =
+      (now_micros > kMaxBurstMicros ? now_micros - kMaxBurstMicros : 0);
+  if (next_write_micros_ < earliest) {
+    next_write_micros_ = earliest;
+  }
+  next_write_micros_ += num_bytes * 1000000 / rate_;
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros) const {
+  if (!delayed_ || next_write_micros_ <= now_micros) {
+    return 0;
+  }
+  return next_write_micros_ - now_micros;
+}
+
+}  // namespace leveldb
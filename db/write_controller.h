@@ -0,0 +1,54 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+// WriteController paces writes while compactions fall behind.  It is a
+// token bucket: the bytes written are charged against a rate, and a
+// writer that gets ahead of the rate is told how long to wait, so writes
+// are spread evenly instead of stalling in bursts.  The rate is kept
+// while writes are not paced, so the next slowdown starts from it.
+//
+// Not thread safe; DBImpl calls it with its mutex held.
+class WriteController {
+ public:
+  explicit WriteController(uint64_t rate);
+
+  // Start or stop pacing writes.
+  void set_delayed(bool delayed) { delayed_ = delayed; }
+  bool IsDelayed() const { return delayed_; }
+
+  // The rate in bytes per second writes are, or next will be, paced to.
+  void set_delayed_write_rate(uint64_t rate);
+  uint64_t delayed_write_rate() const { return rate_; }
+
+  // Charge num_bytes written at now_micros against the rate.
+  void Charge(uint64_t now_micros, uint64_t num_bytes);
+
+  // Return how many micros a writer must wait at now_micros before the
+  // bytes charged so far are within the rate, 0 if it need not wait.
+  uint64_t GetDelay(uint64_t now_micros) const;
+
+ private:
+  bool delayed_;
+  uint64_t rate_;
+
+  // Time at which the bytes charged so far are within the rate.  Never
+  // left more than kMaxBurstMicros behind the present, so that a writer
+  // that was idle cannot save up for a long burst.
+  uint64_t next_write_micros_;
+
+  // No copying allowed
+  WriteController(const WriteController&);
+  void operator=(const WriteController&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
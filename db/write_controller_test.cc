@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteControllerTest { };
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController c(1000);
+  ASSERT_TRUE(!c.IsDelayed());
+  c.Charge(1000000, 1 << 30);
+  ASSERT_EQ(0, c.GetDelay(1000000));
+}
+
+TEST(WriteControllerTest, PacesToRate) {
+  WriteController c(1000000);  // One byte per micro
+  c.set_delayed(true);
+  ASSERT_TRUE(c.IsDelayed());
+
+  // A short burst passes, then writers wait for the rate
+  uint64_t now = 10000000;
+  c.Charge(now, 800);
+  ASSERT_EQ(0, c.GetDelay(now));
+  c.Charge(now, 800);
+  ASSERT_EQ(600, c.GetDelay(now));
+  now += 600;
+  ASSERT_EQ(0, c.GetDelay(now));
+
+  // Writing steadily at the rate never waits
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(0, c.GetDelay(now));
+    c.Charge(now, 100);
+    now += 100;
+  }
+
+  // Idle time does not save up for more than a short burst
+  now += 10000000;
+  c.Charge(now, 5000);
+  ASSERT_EQ(4000, c.GetDelay(now));
+
+  // A lower rate spaces writes further apart
+  now += 4000;
+  c.set_delayed_write_rate(500000);
+  c.Charge(now, 1500);
+  ASSERT_EQ(3000, c.GetDelay(now));
+
+  c.set_delayed(false);
+  ASSERT_EQ(0, c.GetDelay(now));
+  ASSERT_EQ(500000, c.delayed_write_rate());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
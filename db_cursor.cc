@@ -0,0 +1,174 @@
+#include "db_cursor.h"
+
+inline void append_int(std::string* buffer, int val){
+  char buf[4];
+  buf[0] = (char)(val & 255);
+  buf[1] = (char)((val >> 8) & 255);
+  buf[2] = (char)((val >> 16) & 255);
+  buf[3] = (char)((val >> 24) & 255);
+  buffer->append(buf, 4);
+}
+
+db_snapshot::db_snapshot(const boost::shared_ptr<leveldb::DB>& db)
+  : _db(db), _snapshot(db->GetSnapshot()){
+}
+
+db_snapshot::~db_snapshot(){
+  _db->ReleaseSnapshot(_snapshot);
+}
+
+db_cursor::db_cursor(const boost::shared_ptr<leveldb::DB>& db, const boost::shared_ptr<db_snapshot>& snapshot,
+  const leveldb::Slice& start, const leveldb::Slice& end, bool reverse, bool prefix, int limit)
+  : _db(db), _snapshot(snapshot), _iter(NULL), _start(start.data(), start.size()), _end(end.data(), end.size()),
+  _reverse(reverse), _remaining(limit > 0 ? limit : -1), _positioned(false), _mutex(){
+  leveldb::ReadOptions options;
+  if(snapshot){
+    options.snapshot = snapshot->snapshot();
+  }
+  // a scan would push the hot blocks out of the cache
+  options.fill_cache = false;
+  // a reverse scan seeks to end, which need not share the prefix of start
+  options.prefix_seek = prefix && !reverse;
+  _iter = _db->NewIterator(options);
+}
+
+db_cursor::~db_cursor(){
+  // the iterator has to go before the database and the snapshot
+  delete _iter;
+}
+
+bool db_cursor::in_range() const{
+  if(!_iter->Valid()){
+    return false;
+  }
+  leveldb::Slice key(_iter->key());
+  if(key.compare(leveldb::Slice(_start)) < 0){
+    return false;
+  }
+  return _end.empty() || key.compare(leveldb::Slice(_end)) < 0;
+}
+
+bool db_cursor::next_chunk(std::string* chunk, size_t max_bytes, int* count){
+  *count = 0;
+  if(!_positioned){
+    _positioned = true;
+    if(!_reverse){
+      _iter->Seek(_start);
+    }else if(_end.empty()){
+      _iter->SeekToLast();
+    }else{
+      // the last key before end
+      _iter->Seek(_end);
+      if(_iter->Valid()){
+        _iter->Prev();
+      }else{
+        _iter->SeekToLast();
+      }
+    }
+  }
+
+  while(_remaining != 0 && in_range()){
+    leveldb::Slice key(_iter->key());
+    leveldb::Slice value(_iter->value());
+    append_int(chunk, (int)key.size());
+    chunk->append(key.data(), key.size());
+    append_int(chunk, (int)value.size());
+    chunk->append(value.data(), value.size());
+    ++*count;
+    if(_remaining > 0){
+      --_remaining;
+    }
+
+    if(_reverse){
+      _iter->Prev();
+    }else{
+      _iter->Next();
+    }
+
+    if(chunk->size() >= max_bytes){
+      break;
+    }
+  }
+  return _remaining != 0 && in_range();
+}
+
+db_cursor_table::db_cursor_table(size_t max_items)
+  : _max_items(max_items), _last_id(0), _cursors(), _snapshots(), _mutex(){
+}
+
+db_cursor_table::~db_cursor_table(){
+  // cursors may read from the snapshots
+  _cursors.clear();
+  _snapshots.clear();
+}
+
+int db_cursor_table::add_cursor(const boost::shared_ptr<db_cursor>& cursor){
+  boost::mutex::scoped_lock lock(_mutex);
+  if(_cursors.size() + _snapshots.size() >= _max_items){
+    return 0;
+  }
+  if(++_last_id <= 0){
+    _last_id = 1;
+  }
+  _cursors[_last_id] = cursor;
+  return _last_id;
+}
+
+boost::shared_ptr<db_cursor> db_cursor_table::cursor(int id) const{
+  boost::mutex::scoped_lock lock(_mutex);
+  std::map<int, boost::shared_ptr<db_cursor>>::const_iterator item = _cursors.find(id);
+  if(item != _cursors.end()){
+    return item->second;
+  }
+  return boost::shared_ptr<db_cursor>();
+}
+
+bool db_cursor_table::remove_cursor(int id){
+  boost::shared_ptr<db_cursor> cursor;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    std::map<int, boost::shared_ptr<db_cursor>>::iterator item = _cursors.find(id);
+    if(item == _cursors.end()){
+      return false;
+    }
+    // released outside of the lock, deleting the iterator may take a while
+    cursor.swap(item->second);
+    _cursors.erase(item);
+  }
+  return true;
+}
+
+int db_cursor_table::add_snapshot(const boost::shared_ptr<db_snapshot>& snapshot){
+  boost::mutex::scoped_lock lock(_mutex);
+  if(_cursors.size() + _snapshots.size() >= _max_items){
+    return 0;
+  }
+  if(++_last_id <= 0){
+    _last_id = 1;
+  }
+  _snapshots[_last_id] = snapshot;
+  return _last_id;
+}
+
+boost::shared_ptr<db_snapshot> db_cursor_table::snapshot(int id) const{
+  boost::mutex::scoped_lock lock(_mutex);
+  std::map<int, boost::shared_ptr<db_snapshot>>::const_iterator item = _snapshots.find(id);
+  if(item != _snapshots.end()){
+    return item->second;
+  }
+  return boost::shared_ptr<db_snapshot>();
+}
+
+bool db_cursor_table::remove_snapshot(int id){
+  boost::shared_ptr<db_snapshot> snapshot;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    std::map<int, boost::shared_ptr<db_snapshot>>::iterator item = _snapshots.find(id);
+    if(item == _snapshots.end()){
+      return false;
+    }
+    snapshot.swap(item->second);
+    _snapshots.erase(item);
+  }
+  return true;
+}
\ No newline at end of file
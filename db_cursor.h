@@ -0,0 +1,106 @@
+#pragma once
+#include <map>
+#include <string>
+#include <leveldb/db.h>
+#include <leveldb/iterator.h>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
+
+// A snapshot a session keeps open across requests.
+class db_snapshot {
+public:
+  explicit db_snapshot(const boost::shared_ptr<leveldb::DB>& db);
+  ~db_snapshot() throw();
+
+public:
+  const boost::shared_ptr<leveldb::DB>& db() const{
+    return _db;
+  }
+
+  const leveldb::Snapshot* snapshot() const{
+    return _snapshot;
+  }
+
+private:
+  db_snapshot(const db_snapshot&);
+  db_snapshot& operator = (const db_snapshot&);
+
+private:
+  boost::shared_ptr<leveldb::DB> _db;
+  const leveldb::Snapshot* _snapshot;
+};
+
+// An iterator over the keys in [start, end) a session keeps open so a scan
+// can be resumed chunk by chunk. An empty end means no upper bound. The
+// cursor reads from the given snapshot, or from the implicit snapshot the
+// iterator takes when the cursor is opened. A forward prefix scan, whose
+// range lies within the prefix of start, skips the tables whose filters
+// rule that prefix out.
+class db_cursor {
+public:
+  db_cursor(const boost::shared_ptr<leveldb::DB>& db, const boost::shared_ptr<db_snapshot>& snapshot,
+    const leveldb::Slice& start, const leveldb::Slice& end, bool reverse, bool prefix, int limit);
+  ~db_cursor() throw();
+
+public:
+  // appends entries as key_size(4) key value_size(4) value to chunk until it
+  // holds max_bytes or the scan is done, returns false once it is done
+  bool next_chunk(std::string* chunk, size_t max_bytes, int* count);
+
+  leveldb::Status status() const{
+    return _iter->status();
+  }
+
+  // held while a request reads from the cursor
+  boost::mutex& mutex(){
+    return _mutex;
+  }
+
+private:
+  bool in_range() const;
+
+private:
+  db_cursor(const db_cursor&);
+  db_cursor& operator = (const db_cursor&);
+
+private:
+  boost::shared_ptr<leveldb::DB> _db;
+  boost::shared_ptr<db_snapshot> _snapshot;
+  leveldb::Iterator* _iter;
+  std::string _start;
+  std::string _end;
+  bool _reverse;
+  // entries left to return, negative for no limit
+  int _remaining;
+  bool _positioned;
+  boost::mutex _mutex;
+};
+
+// The cursors and snapshots of a session, shared by its concurrently
+// running requests.
+class db_cursor_table {
+public:
+  db_cursor_table(size_t max_items);
+  ~db_cursor_table() throw();
+
+public:
+  // returns the id of the new entry, or 0 if the table is full
+  int add_cursor(const boost::shared_ptr<db_cursor>& cursor);
+  boost::shared_ptr<db_cursor> cursor(int id) const;
+  bool remove_cursor(int id);
+
+  int add_snapshot(const boost::shared_ptr<db_snapshot>& snapshot);
+  boost::shared_ptr<db_snapshot> snapshot(int id) const;
+  bool remove_snapshot(int id);
+
+private:
+  db_cursor_table(const db_cursor_table&);
+  db_cursor_table& operator = (const db_cursor_table&);
+
+private:
+  size_t _max_items;
+  int _last_id;
+  std::map<int, boost::shared_ptr<db_cursor>> _cursors;
+  std::map<int, boost::shared_ptr<db_snapshot>> _snapshots;
+  mutable boost::mutex _mutex;
+};
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "db_executor.h"
+#include <leveldb/env.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+db_executor::db_executor(size_t threads, size_t max_queue_length, size_t per_db_limit)
+  : _thread_count(threads > 0 ? threads : 1), _max_queue_length(max_queue_length),
+  _per_db_limit(per_db_limit > 0 ? per_db_limit : std::max<size_t>(_thread_count / 2, 1)), _stopped(true), _queues(), _ready(), _threads(),
+  _mutex(), _task_ready(), _active(0), _queue_depth(0), _max_queue_depth(0), _completed(0), _rejected(0), _total_wait_micros(0), _max_wait_micros(0){
+}
+
+db_executor::~db_executor(){
+  stop();
+}
+
+void db_executor::start(){
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if(!_stopped){
+      return;
+    }
+    _stopped = false;
+  }
+  for(size_t counter = 0; counter < _thread_count; ++ counter){
+    _threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&db_executor::worker, this))));
+  }
+}
+
+void db_executor::stop(){
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _stopped = true;
+    // the sessions waiting for these are being torn down with the io service
+    _queues.clear();
+    _ready.clear();
+    _queue_depth = 0;
+  }
+  _task_ready.notify_all();
+  std::for_each(_threads.begin(), _threads.end(), [](boost::shared_ptr<boost::thread>& thread){
+    thread->join();
+  });
+  _threads.clear();
+}
+
+bool db_executor::submit(leveldb::DB* db, const task& t){
+  boost::mutex::scoped_lock lock(_mutex);
+  if(_stopped){
+    return false;
+  }
+  db_queue& queue = _queues[db];
+  if(queue.tasks.size() >= _max_queue_length){
+    ++_rejected;
+    return false;
+  }
+  queue.tasks.push_back(pending_task());
+  pending_task& item = queue.tasks.back();
+  item.func = t;
+  item.queued_micros = leveldb::Env::Default()->NowMicros();
+  bool ready = make_ready(db, queue);
+  ++_queue_depth;
+  _max_queue_depth = std::max(_max_queue_depth, _queue_depth);
+  lock.unlock();
+  if(ready){
+    _task_ready.notify_one();
+  }
+  return true;
+}
+
+bool db_executor::make_ready(leveldb::DB* db, db_queue& queue){
+  if(queue.ready || queue.tasks.empty() || queue.active >= _per_db_limit){
+    return false;
+  }
+  queue.ready = true;
+  _ready.push_back(db);
+  return true;
+}
+
+void db_executor::worker(){
+  boost::mutex::scoped_lock lock(_mutex);
+  while(true){
+    while(!_stopped && _ready.empty()){
+      _task_ready.wait(lock);
+    }
+    if(_stopped){
+      return;
+    }
+
+    leveldb::DB* db = _ready.front();
+    _ready.pop_front();
+    db_queue& queue = _queues[db];
+    queue.ready = false;
+    // swap the task out, copying a boost::function copies its target
+    pending_task item;
+    item.func.swap(queue.tasks.front().func);
+    item.queued_micros = queue.tasks.front().queued_micros;
+    queue.tasks.pop_front();
+    ++queue.active;
+    // let the other databases go first before this one gets another worker
+    make_ready(db, queue);
+    --_queue_depth;
+    ++_active;
+    uint64_t wait_micros = leveldb::Env::Default()->NowMicros() - item.queued_micros;
+    _total_wait_micros += wait_micros;
+    _max_wait_micros = std::max(_max_wait_micros, wait_micros);
+    lock.unlock();
+
+    item.func();
+
+    lock.lock();
+    --_active;
+    ++_completed;
+    // stop() drops the queues while the tasks run
+    queue_map::iterator done = _queues.find(db);
+    if(done != _queues.end()){
+      --done->second.active;
+      if(done->second.tasks.empty() && done->second.active == 0){
+        _queues.erase(done);
+      }else if(make_ready(db, done->second)){
+        _task_ready.notify_one();
+      }
+    }
+  }
+}
+
+db_executor_stats db_executor::stats() const{
+  boost::mutex::scoped_lock lock(_mutex);
+  db_executor_stats result;
+  result.threads = _thread_count;
+  result.active_threads = _active;
+  result.queue_depth = _queue_depth;
+  result.max_queue_depth = _max_queue_depth;
+  result.databases = _queues.size();
+  result.completed = _completed;
+  result.rejected = _rejected;
+  result.total_wait_micros = _total_wait_micros;
+  result.max_wait_micros = _max_wait_micros;
+  return result;
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+#include <map>
+#include <deque>
+#include <vector>
+#include <boost/smart_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+namespace leveldb{
+  class DB;
+}
+
+struct db_executor_stats{
+  size_t threads;
+  size_t active_threads;
+  size_t queue_depth;
+  size_t max_queue_depth;
+  size_t databases;
+  uint64_t completed;
+  uint64_t rejected;
+  uint64_t total_wait_micros;
+  uint64_t max_wait_micros;
+};
+
+// Runs the blocking database calls of the service off the io threads.
+// Every database has its own bounded queue; the workers take one task at a
+// time from the databases in round robin order, and at most per_db_limit
+// workers run the tasks of one database at once, so a stalled database
+// cannot take all the workers away from the others.
+class db_executor {
+public:
+  typedef boost::function<void()> task;
+
+public:
+  // per_db_limit 0 means half of the threads
+  db_executor(size_t threads, size_t max_queue_length, size_t per_db_limit);
+  ~db_executor() throw();
+
+public:
+  void start();
+  void stop();
+
+  // queues the task on db's queue, returns false if that queue is full
+  bool submit(leveldb::DB* db, const task& t);
+
+  db_executor_stats stats() const;
+
+private:
+  struct pending_task{
+    task func;
+    uint64_t queued_micros;
+  };
+
+  struct db_queue{
+    db_queue() : tasks(), ready(false), active(0){
+    }
+
+    std::deque<pending_task> tasks;
+    // in _ready
+    bool ready;
+    // workers running tasks of this database
+    size_t active;
+  };
+
+  typedef std::map<leveldb::DB*, db_queue> queue_map;
+
+private:
+  void worker();
+  // puts the database in _ready if it has tasks a worker may take
+  bool make_ready(leveldb::DB* db, db_queue& queue);
+
+private:
+  db_executor(const db_executor&);
+  db_executor& operator = (const db_executor&);
+
+private:
+  size_t _thread_count;
+  size_t _max_queue_length;
+  size_t _per_db_limit;
+  bool _stopped;
+  queue_map _queues;
+  // databases with queued tasks, in the order the workers serve them
+  std::deque<leveldb::DB*> _ready;
+  std::vector<boost::shared_ptr<boost::thread>> _threads;
+  mutable boost::mutex _mutex;
+  boost::condition_variable _task_ready;
+  size_t _active;
+  size_t _queue_depth;
+  size_t _max_queue_depth;
+  uint64_t _completed;
+  uint64_t _rejected;
+  uint64_t _total_wait_micros;
+  uint64_t _max_wait_micros;
+};
\ No newline at end of file
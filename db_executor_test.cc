@@ -0,0 +1,107 @@
+#include "db_executor.h"
+#include <boost/bind.hpp>
+#include "util/testharness.h"
+
+namespace {
+
+// tasks that block until released
+struct gate{
+  gate() : open(false), waiting(0){
+  }
+
+  void pass(){
+    boost::mutex::scoped_lock lock(mutex);
+    ++waiting;
+    changed.notify_all();
+    while(!open){
+      changed.wait(lock);
+    }
+    --waiting;
+  }
+
+  void release(){
+    boost::mutex::scoped_lock lock(mutex);
+    open = true;
+    changed.notify_all();
+  }
+
+  // waits until count tasks are blocked, false after timeout_ms
+  bool wait_blocked(int count, int timeout_ms){
+    boost::mutex::scoped_lock lock(mutex);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+    while(waiting < count){
+      if(!changed.timed_wait(lock, deadline)){
+        return waiting >= count;
+      }
+    }
+    return true;
+  }
+
+  boost::mutex mutex;
+  boost::condition_variable changed;
+  bool open;
+  int waiting;
+};
+
+leveldb::DB* fake_db(int* id){
+  return reinterpret_cast<leveldb::DB*>(id);
+}
+
+}  // namespace
+
+namespace leveldb {
+
+class DBExecutorTest { };
+
+TEST(DBExecutorTest, StalledDatabaseKeepsItsShare) {
+  int slow_id = 0, fast_id = 0;
+  db_executor executor(4, 100, 2);
+  executor.start();
+
+  // the tasks of the slow database block; only two workers take them
+  gate slow;
+  for(int i = 0; i < 10; ++i){
+    ASSERT_TRUE(executor.submit(fake_db(&slow_id), boost::bind(&gate::pass, &slow)));
+  }
+  ASSERT_TRUE(slow.wait_blocked(2, 5000));
+  ASSERT_TRUE(!slow.wait_blocked(3, 200));
+
+  // the other database still gets the remaining workers
+  gate fast;
+  for(int i = 0; i < 2; ++i){
+    ASSERT_TRUE(executor.submit(fake_db(&fast_id), boost::bind(&gate::pass, &fast)));
+  }
+  ASSERT_TRUE(fast.wait_blocked(2, 5000));
+  ASSERT_EQ(4u, executor.stats().active_threads);
+  fast.release();
+
+  slow.release();
+  for(int i = 0; i < 500 && executor.stats().completed < 12; ++i){
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  }
+  db_executor_stats stats = executor.stats();
+  ASSERT_EQ(12u, stats.completed);
+  ASSERT_EQ(0u, stats.queue_depth);
+  ASSERT_EQ(0u, stats.databases);
+  executor.stop();
+}
+
+TEST(DBExecutorTest, DefaultLimitIsHalfTheThreads) {
+  int id = 0;
+  db_executor executor(4, 100, 0);
+  executor.start();
+  gate blocked;
+  for(int i = 0; i < 4; ++i){
+    ASSERT_TRUE(executor.submit(fake_db(&id), boost::bind(&gate::pass, &blocked)));
+  }
+  ASSERT_TRUE(blocked.wait_blocked(2, 5000));
+  ASSERT_TRUE(!blocked.wait_blocked(3, 200));
+  blocked.release();
+  executor.stop();
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,93 @@
+#include "db_group_commit.h"
+#include "db/dbformat.h"
+#include "db/write_batch_internal.h"
+#include <algorithm>
+
+db_group_commit::db_group_commit(uint64_t window_micros, size_t max_group_bytes, bool sync_writes)
+  : _window_micros(window_micros), _max_group_bytes(max_group_bytes), _write_options(), _writers(), _idle(), _mutex(){
+  _write_options.sync = sync_writes;
+}
+
+db_group_commit::~db_group_commit(){
+}
+
+db_group_commit::write_group* db_group_commit::pending_group(leveldb::DB* db, boost::shared_ptr<db_writer>& writer){
+  boost::shared_ptr<db_writer>& item = _writers[db];
+  if(!item){
+    if(_idle){
+      item.swap(_idle);
+    }else{
+      item.reset(new db_writer);
+    }
+  }
+  if(!item->pending){
+    if(item->spare){
+      item->pending.swap(item->spare);
+    }else{
+      item->pending.reset(new write_group);
+    }
+  }
+  writer = item;
+  return item->pending.get();
+}
+
+void db_group_commit::put(const boost::shared_ptr<leveldb::DB>& db, const leveldb::Slice& key, const leveldb::Slice& value, const callback& done){
+  boost::mutex::scoped_lock lock(_mutex);
+  boost::shared_ptr<db_writer> writer;
+  write_group* group = pending_group(db.get(), writer);
+  group->batch.Put(key, value);
+  group->callbacks.push_back(done);
+  commit(db, writer, lock);
+}
+
+void db_group_commit::remove(const boost::shared_ptr<leveldb::DB>& db, const leveldb::Slice& key, const callback& done){
+  boost::mutex::scoped_lock lock(_mutex);
+  boost::shared_ptr<db_writer> writer;
+  write_group* group = pending_group(db.get(), writer);
+  group->batch.Delete(key);
+  group->callbacks.push_back(done);
+  commit(db, writer, lock);
+}
+
+void db_group_commit::write(const boost::shared_ptr<leveldb::DB>& db, const leveldb::WriteBatch* updates, const callback& done){
+  boost::mutex::scoped_lock lock(_mutex);
+  boost::shared_ptr<db_writer> writer;
+  write_group* group = pending_group(db.get(), writer);
+  leveldb::WriteBatchInternal::Append(&group->batch, updates);
+  group->callbacks.push_back(done);
+  commit(db, writer, lock);
+}
+
+void db_group_commit::commit(boost::shared_ptr<leveldb::DB> db, const boost::shared_ptr<db_writer>& writer, boost::mutex::scoped_lock& lock){
+  if(writer->committing){
+    // the leader picks this group up once its current write is done
+    if(leveldb::WriteBatchInternal::ByteSize(&writer->pending->batch) >= _max_group_bytes){
+      writer->group_full.notify_one();
+    }
+    return;
+  }
+
+  writer->committing = true;
+  while(writer->pending){
+    if(_window_micros > 0 && leveldb::WriteBatchInternal::ByteSize(&writer->pending->batch) < _max_group_bytes){
+      // give the other sessions a chance to join this group
+      writer->group_full.timed_wait(lock, boost::posix_time::microseconds(_window_micros));
+    }
+    boost::shared_ptr<write_group> group(writer->pending);
+    writer->pending.reset();
+    lock.unlock();
+
+    leveldb::Status status = db->Write(_write_options, &group->batch);
+    std::for_each(group->callbacks.begin(), group->callbacks.end(), [&status](const callback& done){
+      done(status);
+    });
+    group->batch.Clear();
+    group->callbacks.clear();
+
+    lock.lock();
+    writer->spare = group;
+  }
+  writer->committing = false;
+  _writers.erase(db.get());
+  _idle = writer;
+}
\ No newline at end of file
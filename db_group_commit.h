@@ -0,0 +1,74 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+#include <boost/smart_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+// Gathers the writes of all sessions on a database into one WriteBatch.
+// The first writer to find no commit running on its database becomes the
+// leader: it waits up to window_micros (or until max_group_bytes are
+// queued) for more writes, issues a single DB::Write for the group and
+// completes every writer of it, then goes on with the group that queued
+// up meanwhile. The other writers return at once and are completed by the
+// leader, so with sync_writes one fsync covers the whole group.
+class db_group_commit {
+public:
+  typedef boost::function<void(const leveldb::Status&)> callback;
+
+public:
+  db_group_commit(uint64_t window_micros, size_t max_group_bytes, bool sync_writes);
+  ~db_group_commit() throw();
+
+public:
+  void put(const boost::shared_ptr<leveldb::DB>& db, const leveldb::Slice& key, const leveldb::Slice& value, const callback& done);
+  void remove(const boost::shared_ptr<leveldb::DB>& db, const leveldb::Slice& key, const callback& done);
+  void write(const boost::shared_ptr<leveldb::DB>& db, const leveldb::WriteBatch* updates, const callback& done);
+
+private:
+  struct write_group{
+    write_group() : batch(), callbacks(){
+    }
+
+    leveldb::WriteBatch batch;
+    std::vector<callback> callbacks;
+  };
+
+  struct db_writer{
+    db_writer() : pending(), spare(), committing(false), group_full(){
+    }
+
+    boost::shared_ptr<write_group> pending;
+    // the last group written, reused so its buffers are kept
+    boost::shared_ptr<write_group> spare;
+    bool committing;
+    boost::condition_variable group_full;
+  };
+
+  // a writer is removed once it goes idle, so a closed database leaves no
+  // entry behind and a new database at the same address starts afresh; the
+  // last writer removed is kept in _idle and handed to the next database
+  // that writes, with its spare group
+  typedef std::map<leveldb::DB*, boost::shared_ptr<db_writer>> writer_map;
+
+private:
+  write_group* pending_group(leveldb::DB* db, boost::shared_ptr<db_writer>& writer);
+  // db is taken by value, completing a writer may release the reference
+  // the caller passed in
+  void commit(boost::shared_ptr<leveldb::DB> db, const boost::shared_ptr<db_writer>& writer, boost::mutex::scoped_lock& lock);
+
+private:
+  db_group_commit(const db_group_commit&);
+  db_group_commit& operator = (const db_group_commit&);
+
+private:
+  uint64_t _window_micros;
+  size_t _max_group_bytes;
+  leveldb::WriteOptions _write_options;
+  writer_map _writers;
+  boost::shared_ptr<db_writer> _idle;
+  boost::mutex _mutex;
+};
\ No newline at end of file
@@ -1,141 +1,220 @@
-#include "dbmgr.h"
-#include "win32_helper.h"
-#include <leveldb/cache.h>
-#include <leveldb/filter_policy.h>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
-
-db_manager::db_manager() : _databases(), _options(NULL), _cache(NULL), _filter_policy(NULL), _lock() {
-  this->load_options();
-  this->load_databases();
-}
-
-db_manager::~db_manager(){
-  if(_options != NULL){
-    delete _options;
-  }
-
-  if(_cache != NULL){
-    delete _cache;
-  }
-
-  if(_filter_policy != NULL){
-    delete _filter_policy;
-  }
-}
-
-void db_manager::load_options() {
-  using boost::property_tree::ptree;
-  ptree settings_tree;
-  _options = new leveldb::Options;
-  _options->create_if_missing = true;
-  try{
-    std::string config_file(std::move(get_executable_dir() + "leveldb.xml"));
-    boost::property_tree::read_xml(config_file, settings_tree);
-    int cache_size = settings_tree.get<int>("leveldb.cache_size", -1);
-    int write_buffer_size = settings_tree.get<int>("leveldb.write_buffer_size", 0);
-    int max_open_files = settings_tree.get<int>("leveldb.max_open_files", 0);
-    int bloom_bits = settings_tree.get<int>("leveldb.bloom_bits", -1);
-    if( cache_size >= 0){
-      _cache = leveldb::NewLRUCache((size_t)cache_size);
-      _options->block_cache = _cache;
-    }
-
-    if(bloom_bits >= 0){
-      _filter_policy = leveldb::NewBloomFilterPolicy(bloom_bits);
-      _options->filter_policy = _filter_policy;
-    }
-
-    if(write_buffer_size > 0){
-      _options->write_buffer_size = write_buffer_size;
-    }
-
-    if(max_open_files > 0){
-      _options->max_open_files = max_open_files;
-    }
-  }catch(...){
-  }
-}
-
-void db_manager::load_databases() {
-  std::string exe_folder(std::move(get_executable_dir()));
-  WIN32_FIND_DATAA find_data = {0};
-  std::string filter(std::move(exe_folder + "*"));
-  HANDLE find_handle = FindFirstFileA(filter.c_str(), &find_data);
-  if(find_handle != INVALID_HANDLE_VALUE){
-    srw_lock_guard lock_guard(_lock, srw_lock_guard::lock_type::write);
-    do{
-      if((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 && 
-        (strcmp(find_data.cFileName, ".") != 0 && strcmp(find_data.cFileName, "..") != 0)){
-          leveldb::DB* db(NULL);
-          std::string db_folder(std::move(exe_folder + find_data.cFileName));
-          leveldb::Status status = leveldb::DB::Open(*_options, db_folder.c_str(), &db);
-          if(status.ok()){
-            _databases.insert(db_item(std::move(std::string(find_data.cFileName)), boost::shared_ptr<leveldb::DB>(db)));
-          }
-      }
-    }while(FindNextFileA(find_handle, &find_data) != FALSE);
-  }
-}
-
-boost::shared_ptr<leveldb::DB> db_manager::open_db(const std::string& dbname) {
-  srw_lock_guard lock_guard(_lock, srw_lock_guard::lock_type::read);
-  db_map::iterator result = _databases.find(dbname);
-  if(result != _databases.end()){
-    return result->second;
-  }
-  return boost::shared_ptr<leveldb::DB>();
-}
-
-bool db_manager::delete_db(const std::string& dbname){
-  {
-    srw_lock_guard lock_guard(_lock, srw_lock_guard::lock_type::write);
-    db_map::iterator result = _databases.find(dbname);
-    if(result != _databases.end()){
-      _databases.erase(result);
-    }
-  }
-  // delete the folder by rmdir /s /q
-  std::string db_folder(std::move(get_executable_dir() + dbname));
-  std::string cmd(std::move("cmd /c \"rmdir /s /q \"\"" + db_folder +  "\"\"\""));
-  char* cmd_line = new char[cmd.length() + 20];
-  strcpy_s(cmd_line, cmd.length() + 20, cmd.c_str());
-  STARTUPINFOA si = {0};
-  si.cb = sizeof(si);
-  PROCESS_INFORMATION pi = {0};
-  if(CreateProcessA(NULL, cmd_line, NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi) == TRUE){
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-  }
-  delete[] cmd_line;
-  return false;
-}
-
-bool db_manager::create_db(const std::string& dbname) {
-  {
-    srw_lock_guard lock_guard(_lock, srw_lock_guard::lock_type::read);
-    db_map::iterator result = _databases.find(dbname);
-    if(result != _databases.end()){
-      return false;
-    }
-  }
-  std::string db_folder(std::move(get_executable_dir() + dbname));
-  leveldb::DB* db = NULL;
-  leveldb::Status status = leveldb::DB::Open(*_options, db_folder.c_str(), &db);
-  if(status.ok())
-  {
-    srw_lock_guard lock_guard(_lock, srw_lock_guard::lock_type::write);
-    _databases.insert(db_item(dbname, boost::shared_ptr<leveldb::DB>(db)));
-    return true;
-  }
-  return false;
-}
-
-std::vector<std::string> db_manager::list_db() const {
-  srw_lock_guard lock_guard(_lock, srw_lock_guard::lock_type::read);
-  std::vector<std::string> db_list;
-  std::for_each(_databases.begin(), _databases.end(), [&db_list](const db_item& item) -> void {
-    db_list.push_back(item.first);
-  });
-  return std::move(db_list);
-}
\ No newline at end of file
+#include "dbmgr.h"
+#include "win32_helper.h"
+#include <leveldb/cache.h>
+#include <leveldb/env.h>
+#include <leveldb/filter_policy.h>
+#include <leveldb/slice_transform.h>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <algorithm>
+
+namespace {
+// Deletes a database once the last reference to it is gone, then removes
+// its files if it was deleted from the registry meanwhile.
+class db_closer {
+public:
+  db_closer(const std::string& db_folder, const leveldb::Options& options)
+    : _db_folder(db_folder), _options(options), _destroy(false){
+  }
+
+  void operator()(leveldb::DB* db) const{
+    delete db;
+    if(_destroy){
+      leveldb::DestroyDB(_db_folder, _options);
+    }
+  }
+
+  // only called by the registry while it still holds a reference, so the
+  // release of that reference publishes the flag to the deleting thread
+  void destroy_on_close(){
+    _destroy = true;
+  }
+
+private:
+  std::string _db_folder;
+  leveldb::Options _options;
+  bool _destroy;
+};
+}
+
+db_manager::db_manager() : _databases(new db_map), _options(NULL), _cache(NULL), _filter_policy(NULL), _prefix_extractor(NULL), _write_mutex() {
+  this->load_options();
+  this->load_databases();
+}
+
+db_manager::~db_manager(){
+  // the databases use the cache, the filter policy and the prefix extractor
+  _databases.reset();
+
+  if(_options != NULL){
+    delete _options;
+  }
+
+  if(_cache != NULL){
+    delete _cache;
+  }
+
+  if(_filter_policy != NULL){
+    delete _filter_policy;
+  }
+
+  if(_prefix_extractor != NULL){
+    delete _prefix_extractor;
+  }
+}
+
+void db_manager::load_options() {
+  using boost::property_tree::ptree;
+  ptree settings_tree;
+  _options = new leveldb::Options;
+  _options->create_if_missing = true;
+  try{
+    std::string config_file(std::move(get_executable_dir() + "leveldb.xml"));
+    boost::property_tree::read_xml(config_file, settings_tree);
+    int cache_size = settings_tree.get<int>("leveldb.cache_size", -1);
+    int write_buffer_size = settings_tree.get<int>("leveldb.write_buffer_size", 0);
+    int max_open_files = settings_tree.get<int>("leveldb.max_open_files", 0);
+    int bloom_bits = settings_tree.get<int>("leveldb.bloom_bits", -1);
+    std::string prefix_delimiter = settings_tree.get<std::string>("leveldb.prefix_delimiter", "");
+    int prefix_delimiter_count = settings_tree.get<int>("leveldb.prefix_delimiter_count", 1);
+    _options->max_subcompactions = settings_tree.get<int>("leveldb.max_subcompactions", _options->max_subcompactions);
+    _options->max_background_compactions = settings_tree.get<int>("leveldb.max_background_compactions", _options->max_background_compactions);
+    _options->max_background_flushes = settings_tree.get<int>("leveldb.max_background_flushes", _options->max_background_flushes);
+    _options->max_write_buffer_number = settings_tree.get<int>("leveldb.max_write_buffer_number", _options->max_write_buffer_number);
+    _options->merge_write_buffers = settings_tree.get<int>("leveldb.merge_write_buffers", _options->merge_write_buffers ? 1 : 0) != 0;
+    _options->level0_slowdown_writes_trigger = settings_tree.get<int>("leveldb.level0_slowdown_writes_trigger", _options->level0_slowdown_writes_trigger);
+    _options->level0_stop_writes_trigger = settings_tree.get<int>("leveldb.level0_stop_writes_trigger", _options->level0_stop_writes_trigger);
+    _options->soft_pending_compaction_bytes_limit = settings_tree.get<uint64_t>("leveldb.soft_pending_compaction_bytes_limit", _options->soft_pending_compaction_bytes_limit);
+    _options->hard_pending_compaction_bytes_limit = settings_tree.get<uint64_t>("leveldb.hard_pending_compaction_bytes_limit", _options->hard_pending_compaction_bytes_limit);
+    _options->delayed_write_rate = settings_tree.get<uint64_t>("leveldb.delayed_write_rate", _options->delayed_write_rate);
+    int compaction_threads = settings_tree.get<int>("leveldb.compaction_threads", 0);
+    int flush_threads = settings_tree.get<int>("leveldb.flush_threads", 0);
+    _options->cache_index_and_filter_blocks = settings_tree.get<int>("leveldb.cache_index_and_filter_blocks", 0) != 0;
+    _options->partition_index_and_filters = settings_tree.get<int>("leveldb.partition_index_and_filters", 0) != 0;
+    _options->whole_table_filter = settings_tree.get<int>("leveldb.whole_table_filter", 0) != 0;
+    double high_pri_pool_ratio = settings_tree.get<double>("leveldb.cache_high_pri_pool_ratio", 0.0);
+    if( cache_size >= 0){
+      _cache = leveldb::NewLRUCache((size_t)cache_size, 4, high_pri_pool_ratio);
+      _options->block_cache = _cache;
+    }
+
+    if(bloom_bits >= 0){
+      _filter_policy = _options->whole_table_filter ? leveldb::NewCacheLocalBloomFilterPolicy(bloom_bits) : leveldb::NewBloomFilterPolicy(bloom_bits);
+      _options->filter_policy = _filter_policy;
+    }
+
+    if(prefix_delimiter.size() == 1 && prefix_delimiter_count > 0){
+      _prefix_extractor = leveldb::NewDelimitedPrefixTransform(prefix_delimiter[0], prefix_delimiter_count);
+      _options->prefix_extractor = _prefix_extractor;
+    }
+
+    if(write_buffer_size > 0){
+      _options->write_buffer_size = write_buffer_size;
+    }
+
+    if(max_open_files > 0){
+      _options->max_open_files = max_open_files;
+    }
+
+    // the thread pools of the environment are shared by all the databases
+    if(compaction_threads > 0){
+      leveldb::Env::Default()->SetBackgroundThreads(compaction_threads, leveldb::Env::LOW);
+    }
+
+    if(flush_threads > 0){
+      leveldb::Env::Default()->SetBackgroundThreads(flush_threads, leveldb::Env::HIGH);
+    }
+  }catch(...){
+  }
+}
+
+void db_manager::load_databases() {
+  std::string exe_folder(std::move(get_executable_dir()));
+  std::vector<std::string> children;
+  leveldb::Env* env = leveldb::Env::Default();
+  if(!env->GetChildren(exe_folder, &children).ok()){
+    return;
+  }
+  boost::shared_ptr<db_map> databases(new db_map);
+  std::for_each(children.begin(), children.end(), [&](const std::string& child) -> void {
+    // every folder holding a database has a CURRENT file
+    std::string db_folder(std::move(exe_folder + child));
+    if(child == "." || child == ".." || !env->FileExists(db_folder + "/CURRENT")){
+      return;
+    }
+    boost::shared_ptr<leveldb::DB> db(open_folder(db_folder));
+    if(db){
+      databases->insert(db_item(child, db));
+    }
+  });
+  boost::mutex::scoped_lock lock(_write_mutex);
+  boost::atomic_store(&_databases, db_map_ptr(databases));
+}
+
+boost::shared_ptr<leveldb::DB> db_manager::open_folder(const std::string& db_folder) const {
+  leveldb::DB* db = NULL;
+  leveldb::Status status = leveldb::DB::Open(*_options, db_folder.c_str(), &db);
+  if(!status.ok()){
+    return boost::shared_ptr<leveldb::DB>();
+  }
+  return boost::shared_ptr<leveldb::DB>(db, db_closer(db_folder, *_options));
+}
+
+db_manager::db_map_ptr db_manager::snapshot() const {
+  return boost::atomic_load(&_databases);
+}
+
+boost::shared_ptr<leveldb::DB> db_manager::open_db(const std::string& dbname) {
+  db_map_ptr databases(snapshot());
+  db_map::const_iterator result = databases->find(dbname);
+  if(result != databases->end()){
+    return result->second;
+  }
+  return boost::shared_ptr<leveldb::DB>();
+}
+
+bool db_manager::delete_db(const std::string& dbname){
+  boost::shared_ptr<leveldb::DB> db;
+  {
+    boost::mutex::scoped_lock lock(_write_mutex);
+    db_map_ptr databases(snapshot());
+    db_map::const_iterator result = databases->find(dbname);
+    if(result == databases->end()){
+      return false;
+    }
+    db = result->second;
+    boost::shared_ptr<db_map> updated(new db_map(*databases));
+    updated->erase(dbname);
+    boost::atomic_store(&_databases, db_map_ptr(updated));
+  }
+  // sessions that opened the database keep using it, the files go with the
+  // last of them
+  boost::get_deleter<db_closer>(db)->destroy_on_close();
+  return true;
+}
+
+bool db_manager::create_db(const std::string& dbname) {
+  if(snapshot()->count(dbname) > 0){
+    return false;
+  }
+  // opened without holding a lock, a racing create of the same name fails
+  // on the LOCK file of the database
+  boost::shared_ptr<leveldb::DB> db(open_folder(get_executable_dir() + dbname));
+  if(!db){
+    return false;
+  }
+  boost::mutex::scoped_lock lock(_write_mutex);
+  boost::shared_ptr<db_map> updated(new db_map(*snapshot()));
+  updated->insert(db_item(dbname, db));
+  boost::atomic_store(&_databases, db_map_ptr(updated));
+  return true;
+}
+
+std::vector<std::string> db_manager::list_db() const {
+  db_map_ptr databases(snapshot());
+  std::vector<std::string> db_list;
+  std::for_each(databases->begin(), databases->end(), [&db_list](const db_item& item) -> void {
+    db_list.push_back(item.first);
+  });
+  return std::move(db_list);
+}
@@ -1,35 +1,49 @@
-#pragma
-#include <hash_map>
-#include <leveldb/db.h>
-#include <boost/smart_ptr.hpp>
-#include "slim_read_write_lock.h"
-
-class db_manager {
-public:
-    db_manager();
-    ~db_manager() throw();
-
-public:
-    boost::shared_ptr<leveldb::DB> open_db(const std::string& name);
-    bool delete_db(const std::string& name);
-    bool create_db(const std::string& name);
-    std::vector<std::string> list_db() const;
-    
-public:
-    typedef std::hash_map<std::string, boost::shared_ptr<leveldb::DB>> db_map;
-    typedef std::pair<std::string, boost::shared_ptr<leveldb::DB>> db_item;
-
-private:
-    void load_options();
-    void load_databases();
-private:
-    db_manager(const db_manager&);
-    db_manager& operator = (const db_manager&);
-
-private:
-    db_map _databases;
-    leveldb::Options* _options;
-    leveldb::Cache* _cache;
-    const leveldb::FilterPolicy* _filter_policy;
-    mutable slim_read_write_lock _lock;
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <leveldb/db.h>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
+
+// The registry of the databases. Lookups read an immutable snapshot of the
+// map through boost::atomic_load, which holds one of boost's pooled
+// spinlocks just long enough to copy the shared_ptr, so they never wait on
+// a database being opened or closed. create_db and delete_db publish a
+// modified copy. A deleted database is closed, and its files removed, once
+// the last session holding it lets go.
+class db_manager {
+public:
+    db_manager();
+    ~db_manager() throw();
+
+public:
+    boost::shared_ptr<leveldb::DB> open_db(const std::string& name);
+    bool delete_db(const std::string& name);
+    bool create_db(const std::string& name);
+    std::vector<std::string> list_db() const;
+    
+public:
+    typedef std::unordered_map<std::string, boost::shared_ptr<leveldb::DB>> db_map;
+    typedef std::pair<std::string, boost::shared_ptr<leveldb::DB>> db_item;
+    typedef boost::shared_ptr<const db_map> db_map_ptr;
+
+private:
+    void load_options();
+    void load_databases();
+    boost::shared_ptr<leveldb::DB> open_folder(const std::string& db_folder) const;
+    db_map_ptr snapshot() const;
+
+private:
+    db_manager(const db_manager&);
+    db_manager& operator = (const db_manager&);
+
+private:
+    // read with boost::atomic_load (a short pooled spinlock), replaced under _write_mutex
+    db_map_ptr _databases;
+    leveldb::Options* _options;
+    leveldb::Cache* _cache;
+    const leveldb::FilterPolicy* _filter_policy;
+    const leveldb::SliceTransform* _prefix_extractor;
+    boost::mutex _write_mutex;
 };
\ No newline at end of file
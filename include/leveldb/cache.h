@@ -29,6 +29,38 @@ class Cache;
 // of Cache uses a least-recently-used eviction policy.
 extern Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but splits the cache into
+// 2^num_shard_bits shards, each with a mutex of its own.  More shards
+// mean less lock contention among threads that share the cache, at the
+// cost of a coarser approximation of a global LRU order.
+extern Cache* NewLRUCache(size_t capacity, int num_shard_bits);
+
+// Like NewLRUCache(capacity, num_shard_bits), but reserves the fraction
+// high_pri_pool_ratio of the capacity for entries inserted with
+// Cache::HIGH priority.  Those entries are only evicted after every
+// low priority entry, for as long as they fit into the reserved pool;
+// beyond that they age like any other entry.
+extern Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                          double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity that uses the CLOCK
+// eviction policy.  Lookup() and Release() take no lock: a hit only
+// bumps atomic reference and usage counters on the entry, so readers of
+// hot blocks do not serialize on a shard mutex.  Insert() and Erase()
+// still lock their shard.  Each shard keeps a fixed number of entries
+// sized for capacity / estimated_entry_charge; when those run out, the
+// least recently used entries are evicted early, and an entry that
+// cannot be placed at all is handed back uncached (it is freed when its
+// handle is released).
+extern Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                            int num_shard_bits);
+
+// Like NewClockCache(capacity, estimated_entry_charge, num_shard_bits),
+// but the clock skips Cache::HIGH priority entries for as long as they
+// fit into the fraction high_pri_pool_ratio of the capacity.
+extern Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                            int num_shard_bits, double high_pri_pool_ratio);
+
 class Cache {
  public:
   Cache() { }
@@ -40,6 +72,13 @@ class Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle { };
 
+  // Caches created with a high priority pool evict HIGH priority
+  // entries last.
+  enum Priority {
+    HIGH,
+    LOW
+  };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -52,6 +91,12 @@ class Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Same as above, but with the specified priority.  The default
+  // implementation ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority);
+
   // If the cache has no mapping for "key", returns NULL.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -81,6 +126,11 @@ class Cache {
   // its cache keys.
   virtual uint64_t NewId() = 0;
 
+  // Return the combined charge of all entries that are in the cache,
+  // including the ones that were erased or evicted but are still
+  // referenced by a handle.
+  virtual size_t TotalCharge() const = 0;
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
@@ -83,6 +83,16 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Look up each of keys[0,n-1] as Get() would, storing the value of
+  // keys[i] in values[i] and the status of the lookup in statuses[i].
+  // All keys are read from the same state of the database:
+  // options.snapshot if it is set, or else an implicit snapshot taken
+  // when the call starts.
+  //
+  // The default implementation calls Get() for each key.
+  virtual void MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                        std::string* values, Status* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -115,6 +125,20 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.block-cache-usage" - returns the combined charge of the
+  //     entries in the block cache (which may be shared with other DBs).
+  //  "leveldb.table-readers-mem" - returns the number of bytes the open
+  //     tables hold in memory outside of the block cache, mostly index
+  //     and filter blocks (see Options::cache_index_and_filter_blocks).
+  //  "leveldb.num-immutable-mem-table" - returns the number of immutable
+  //     memtables waiting to be flushed.
+  //  "leveldb.stall-micros" - returns the number of micros writers were
+  //     paced, stopped or waiting for a memtable flush.
+  //  "leveldb.actual-delayed-write-rate" - returns the bytes per second
+  //     writes are paced to, or 0 if they are not paced.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns an estimate of
+  //     the bytes compactions must rewrite to bring every level within its
+  //     size limit.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
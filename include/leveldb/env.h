@@ -115,7 +115,13 @@ class Env {
   // REQUIRES: lock has not already been unlocked.
   virtual Status UnlockFile(FileLock* lock) = 0;
 
+  // Background work runs in one of two pools of threads.  HIGH is meant
+  // for short jobs that others wait on, such as memtable flushes, and LOW
+  // for the others, such as compactions.
+  enum Priority { LOW, HIGH };
+
   // Arrange to run "(*function)(arg)" once in a background thread.
+  // Same as Schedule(function, arg, LOW).
   //
   // "function" may run in an unspecified thread.  Multiple functions
   // added to the same Env may run concurrently in different threads.
@@ -125,6 +131,25 @@ class Env {
       void (*function)(void* arg),
       void* arg) = 0;
 
+  // Arrange to run "(*function)(arg)" once in a background thread of the
+  // pool "pri".  The default implementation ignores the priority.
+  virtual void Schedule(
+      void (*function)(void* arg),
+      void* arg,
+      Priority pri);
+
+  // Set the number of threads of the pool "pri".  Threads above the new
+  // number exit once they finish their current job.  The default
+  // implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
+  // Return the number of threads of the pool "pri", the number of its
+  // jobs waiting for a thread and the number of its threads running a
+  // job.  The default implementations return 0.
+  virtual int GetBackgroundThreads(Priority pri);
+  virtual int GetThreadPoolQueueLen(Priority pri);
+  virtual int GetThreadPoolActiveThreads(Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -309,6 +334,21 @@ class EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) {
+    return target_->Schedule(f, a, pri);
+  }
+  void SetBackgroundThreads(int n, Priority pri) {
+    target_->SetBackgroundThreads(n, pri);
+  }
+  int GetBackgroundThreads(Priority pri) {
+    return target_->GetBackgroundThreads(pri);
+  }
+  int GetThreadPoolQueueLen(Priority pri) {
+    return target_->GetThreadPoolQueueLen(pri);
+  }
+  int GetThreadPoolActiveThreads(Priority pri) {
+    return target_->GetThreadPoolActiveThreads(pri);
+  }
   void StartThread(void (*f)(void*), void* a) {
     return target_->StartThread(f, a);
   }
@@ -65,6 +65,15 @@ class FilterPolicy {
 // trailing spaces in keys.
 extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a bloom filter made of 64-byte
+// blocks: all the bits probed for a key lie in one block, so a lookup
+// costs at most one cache miss however large the filter is.  The false
+// positive rate for a given bits_per_key is close to, but a little
+// higher than, that of NewBloomFilterPolicy().  Meant for large
+// filters, such as those built with Options::whole_table_filter.  The
+// note above on custom comparators applies here too.
+extern const FilterPolicy* NewCacheLocalBloomFilterPolicy(int bits_per_key);
+
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 namespace leveldb {
 
@@ -14,6 +15,7 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -74,14 +76,47 @@ struct Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.
   // Also, a larger write buffer will result in a longer recovery time
   // the next time the database is opened.
   //
   // Default: 4MB
   size_t write_buffer_size;
 
+  // Largest number of write buffers held in memory, counting the one
+  // being written.  A full write buffer joins a queue of immutable ones
+  // to be flushed to level-0, and writes only wait when the queue holds
+  // max_write_buffer_number - 1 of them, so bursts of writes do not stall
+  // while earlier buffers are flushed.  Reads search all of them.
+  //
+  // Default: 2
+  int max_write_buffer_number;
+
+  // If true, a flush writes all the immutable write buffers that are
+  // queued when it starts into a single level-0 file, instead of one
+  // file per buffer.
+  //
+  // Default: false
+  bool merge_write_buffers;
+
+  // Writes are paced once level-0 holds this many files, or once the
+  // compactions owe soft_pending_compaction_bytes_limit bytes, so that
+  // compactions can catch up.  The pace starts at delayed_write_rate
+  // bytes per second, drops while the backlog grows and recovers while
+  // it shrinks.  Writes stop altogether at level0_stop_writes_trigger
+  // files or hard_pending_compaction_bytes_limit bytes.  The bytes owed
+  // are an estimate of what compactions must rewrite to bring every
+  // level within its size; a limit of 0 means no limit.
+  //
+  // Default: 8, 12, 64GB, 256GB and 16MB
+  int level0_slowdown_writes_trigger;
+  int level0_stop_writes_trigger;
+  uint64_t soft_pending_compaction_bytes_limit;
+  uint64_t hard_pending_compaction_bytes_limit;
+  uint64_t delayed_write_rate;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -89,6 +124,48 @@ struct Options {
   // Default: 1000
   int max_open_files;
 
+  // Largest number of key-range subcompactions a compaction is split
+  // into.  The subcompactions merge their ranges on the free threads of
+  // the LOW background pool and their outputs are installed together, so
+  // with Env::SetBackgroundThreads(n, Env::LOW) a large compaction can use
+  // up to this many cores instead of one.  Compactions too small to give
+  // each subcompaction a few output files are not split.
+  //
+  // Default: 1
+  int max_subcompactions;
+
+  // Largest number of compactions run at the same time.  Compactions
+  // that run together never share input files, and only one of them at a
+  // time takes files from level-0.
+  //
+  // Default: 1
+  int max_background_compactions;
+
+  // Largest number of background jobs that flush memtables to level-0
+  // at the same time.  The jobs do not wait for the running compactions.
+  // If 0, the compaction jobs flush the memtables before picking a
+  // compaction.  Memtables may be flushed in parallel (see
+  // max_write_buffer_number), but their files are added oldest first.
+  //
+  // Default: 1
+  int max_background_flushes;
+
+  // If true, when the writes of several threads are grouped into one log
+  // record, each thread inserts its own batch into the memtable at the
+  // same time as the others, instead of the thread that wrote the log
+  // inserting the whole group.
+  //
+  // Default: true
+  bool allow_concurrent_memtable_write;
+
+  // If true, writes go through two stages, each led by a writer of its
+  // own: a group of writes is appended to the log while the group before
+  // it is inserted into the memtable.  Writes become visible in the order
+  // they were logged.
+  //
+  // Default: false
+  bool enable_pipelined_write;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -97,6 +174,17 @@ struct Options {
   // Default: NULL
   Cache* block_cache;
 
+  // If true, the index and filter blocks of open tables are loaded
+  // through block_cache with Cache::HIGH priority instead of being held
+  // by each table for as long as it is open, so that their memory counts
+  // against (and is capped by) the capacity of the cache.  Use a cache
+  // with a high priority pool, e.g. NewLRUCache(capacity, 4, 0.5), to
+  // keep them from being evicted by data blocks.  The internal cache
+  // created when block_cache is NULL has such a pool.
+  //
+  // Default: false
+  bool cache_index_and_filter_blocks;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -135,6 +223,45 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If true, new tables get a single filter over all their keys instead
+  // of one filter per 2KB of data blocks, so a lookup checks the filter
+  // before it reads the index block.  Best combined with
+  // NewCacheLocalBloomFilterPolicy(), whose probes stay within one cache
+  // line however large the filter grows.  Ignored with
+  // partition_index_and_filters, whose filter partitions already work
+  // this way.  Tables written with this option cannot be filtered by
+  // versions of leveldb that predate it (they are still readable).
+  //
+  // Default: false
+  bool whole_table_filter;
+
+  // If non-NULL, and filter_policy is set too, the filters of new
+  // tables also hold the prefixes of their keys, as computed by this
+  // transform.  Iterators that read with ReadOptions::prefix_seek then
+  // skip the tables whose filters rule out the prefix of their seek
+  // target.  Tables remember the name of the transform; those written
+  // without it, or with another one, are never skipped.
+  //
+  // Default: NULL
+  const SliceTransform* prefix_extractor;
+
+  // If true, new tables get a two-level index: a small top-level index
+  // over index partitions of about metadata_block_size bytes each, which
+  // are read on demand through block_cache like data blocks instead of
+  // all at once when the table is opened.  With a filter_policy, the
+  // filter is partitioned the same way, one filter per index partition.
+  // Tables written with this option cannot be read by versions of
+  // leveldb that predate it; tables written without it are unchanged.
+  //
+  // Default: false
+  bool partition_index_and_filters;
+
+  // Approximate size of an index partition (see
+  // partition_index_and_filters).
+  //
+  // Default: 4K
+  size_t metadata_block_size;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -158,10 +285,21 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // If true, an iterator is only used for a scan over the keys with the
+  // prefix of its Seek() target (see Options::prefix_extractor), which
+  // lets it skip the tables whose filters rule out that prefix.  After
+  // a Seek(), the keys with the prefix of the target come out as usual;
+  // once the prefix changes, the iterator may skip keys or turn
+  // invalid, so callers should stop there.  SeekToFirst() and
+  // SeekToLast() are not affected.
+  // Default: false
+  bool prefix_seek;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        prefix_seek(false) {
   }
 };
 
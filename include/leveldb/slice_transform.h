@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to its prefix.  A database configured with
+// one (see Options::prefix_extractor) adds the prefixes of the keys to
+// its filters, so that an iterator reading with ReadOptions::prefix_seek
+// can skip the tables that hold no key with the prefix of its target.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Slice;
+
+class SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  Tables remember the name of the
+  // transform whose prefixes they hold, so if the transform changes in
+  // an incompatible way, the name returned by this method must be
+  // changed.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must be a prefix of "key"
+  // (it may refer to the same bytes), and the comparator must order all
+  // keys that share a prefix next to each other, as bytewise ordering
+  // does.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if "key" has a prefix.  Keys without one are only
+  // filtered as whole keys.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first prefix_len bytes of
+// a key.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+// Return a new transform whose prefix runs up to and including the n-th
+// occurrence of "delimiter" in a key; e.g., for keys shaped like
+// "tenant/entity/timestamp", NewDelimitedPrefixTransform('/', 2) maps
+// each key to its "tenant/entity/" prefix.  Keys with fewer than n
+// delimiters have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const SliceTransform* NewDelimitedPrefixTransform(char delimiter,
+                                                         int n);
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -55,12 +55,27 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns the number of bytes this table keeps in memory for as long
+  // as it is open.  Index and filter blocks that are loaded through the
+  // block cache (see Options::cache_index_and_filter_blocks) are charged
+  // to the cache instead and are not included.
+  size_t ApproximateMemoryUsage() const;
+
  private:
   struct Rep;
   Rep* rep_;
 
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+  static Iterator* ReadBlockIterator(Table*, const ReadOptions&,
+                                     const Slice&, bool index_partition);
+  Iterator* NewIndexBlockIterator(const ReadOptions&) const;
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+  bool PartitionMayMatch(const ReadOptions&, const Slice& top_level_value,
+                         const Slice& key) const;
+  static bool PrefixMayMatch(void*, const ReadOptions&, const Slice& target);
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
@@ -73,7 +88,7 @@ class Table {
 
 
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilter(const Slice& filter_handle_value, bool whole_table);
 
   // No copying allowed
   Table(const Table&);
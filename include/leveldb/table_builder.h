@@ -78,6 +78,7 @@ class TableBuilder {
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void FlushIndexPartition();
 
   struct Rep;
   Rep* rep_;
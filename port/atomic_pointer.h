@@ -123,6 +123,17 @@ class AtomicPointer {
     MemoryBarrier();
     rep_ = v;
   }
+  // Stores "v" iff the pointer is "expected" and returns whether it did.
+  // Orders memory like both Acquire_Load() and Release_Store().
+  inline bool CompareAndSwap(void* expected, void* v) {
+#if defined(OS_WIN) && defined(COMPILER_MSVC)
+    return InterlockedCompareExchangePointer(&rep_, v, expected) == expected;
+#elif defined(OS_MACOSX)
+    return OSAtomicCompareAndSwapPtrBarrier(expected, v, &rep_);
+#else
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+#endif
+  }
 };
 
 // AtomicPointer based on <cstdatomic>
@@ -145,6 +156,9 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     rep_.store(v, std::memory_order_relaxed);
   }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return rep_.compare_exchange_strong(expected, v);
+  }
 };
 
 // Atomic pointer based on sparc memory barriers
@@ -175,6 +189,9 @@ class AtomicPointer {
   }
   inline void* NoBarrier_Load() const { return rep_; }
   inline void NoBarrier_Store(void* v) { rep_ = v; }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+  }
 };
 
 // Atomic pointer based on ia64 acq/rel
@@ -205,6 +222,9 @@ class AtomicPointer {
   }
   inline void* NoBarrier_Load() const { return rep_; }
   inline void NoBarrier_Store(void* v) { rep_ = v; }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+  }
 };
 
 // We have neither MemoryBarrier(), nor <cstdatomic>
@@ -213,6 +233,35 @@ class AtomicPointer {
 
 #endif
 
+// Loads and stores of a 64-bit integer that are atomic also on 32-bit
+// targets, ordered like AtomicPointer::Acquire_Load()/Release_Store().
+// For counters that some readers load without holding a lock.
+#if defined(OS_WIN) && defined(COMPILER_MSVC)
+inline uint64_t Acquire_Load64(const volatile uint64_t* p) {
+#if defined(_M_X64)
+  return *p;  // MSVC orders volatile accesses as acquire/release
+#else
+  return InterlockedCompareExchange64(
+      const_cast<volatile LONGLONG*>(
+          reinterpret_cast<const volatile LONGLONG*>(p)), 0, 0);
+#endif
+}
+inline void Release_Store64(volatile uint64_t* p, uint64_t v) {
+#if defined(_M_X64)
+  *p = v;
+#else
+  InterlockedExchange64(reinterpret_cast<volatile LONGLONG*>(p), v);
+#endif
+}
+#else
+inline uint64_t Acquire_Load64(const volatile uint64_t* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+inline void Release_Store64(volatile uint64_t* p, uint64_t v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#endif
+
 #undef LEVELDB_HAVE_MEMORY_BARRIER
 #undef ARCH_CPU_X86_FAMILY
 #undef ARCH_CPU_ARM_FAMILY
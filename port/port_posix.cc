@@ -50,5 +50,9 @@ void InitOnce(OnceType* once, void (*initializer)()) {
   PthreadCall("once", pthread_once(once, initializer));
 }
 
+void NewThreadKey(ThreadKey* key, void (*destructor)(void*)) {
+  PthreadCall("create key", pthread_key_create(key, destructor));
+}
+
 }  // namespace port
 }  // namespace leveldb
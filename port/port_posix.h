@@ -46,6 +46,8 @@
 #include <snappy.h>
 #endif
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <string>
 #include "port/atomic_pointer.h"
 
@@ -74,6 +76,11 @@
 #define fdatasync fsync
 #endif
 
+// The sources use the names the Microsoft C runtime gives these functions
+#define _snprintf_s snprintf
+#define _strdup strdup
+#define sscanf_s sscanf
+
 namespace leveldb {
 namespace port {
 
@@ -116,6 +123,18 @@ typedef pthread_once_t OnceType;
 #define LEVELDB_ONCE_INIT PTHREAD_ONCE_INIT
 extern void InitOnce(OnceType* once, void (*initializer)());
 
+// A key to a slot that holds one value per thread, NULL until the
+// thread sets it.  When a thread exits, "destructor" is called with the
+// thread's value if it is not NULL.  Keys are never deleted.
+typedef pthread_key_t ThreadKey;
+extern void NewThreadKey(ThreadKey* key, void (*destructor)(void*));
+inline void* GetThreadValue(ThreadKey key) {
+  return pthread_getspecific(key);
+}
+inline void SetThreadValue(ThreadKey key, void* value) {
+  pthread_setspecific(key, value);
+}
+
 inline bool Snappy_Compress(const char* input, size_t length,
                             ::std::string* output) {
 #ifdef SNAPPY
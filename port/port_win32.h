@@ -83,6 +83,17 @@ namespace leveldb {
 #define LEVELDB_ONCE_INIT 0
 		extern void InitOnce(port::OnceType*, void (*initializer)());
 
+		// A key to a slot that holds one value per thread, NULL until the
+		// thread sets it.  When a thread exits, "destructor" is called with
+		// the thread's value if it is not NULL.  Keys are never deleted.
+		struct ThreadKey {
+			DWORD index;  // Fiber local storage, which runs a callback on exit
+			void (*destructor)(void*);
+		};
+		extern void NewThreadKey(ThreadKey* key, void (*destructor)(void*));
+		extern void* GetThreadValue(ThreadKey key);
+		extern void SetThreadValue(ThreadKey key, void* value);
+
 		// ------------------ Compression -------------------
 
 		// Store the snappy compression of "input[0,input_length-1]" in *output.
@@ -0,0 +1,237 @@
+// Counts the heap allocations made per request by the network service.
+// The service is started in process, the "alloc_bench" database is created
+// and then driven over loopback by one blocking client, first one request
+// at a time (protocol v1) and then pipelined (protocol v2). The client
+// reuses its buffers, so the counts are the allocations of the service and
+// of the database calls it makes.
+//
+// Built by the Makefile along with the service, run it from a scratch
+// directory next to leveldb.xml.
+//
+//   --num=N           requests per run (default 100000)
+//   --value_size=N    size of the values written (default 100)
+//   --depth=N         requests in flight for the v2 runs (default 32)
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "db_service.h"
+
+#define COMMAND_LOGIN 1
+#define COMMAND_OPEN 2
+#define COMMAND_PUT 4
+#define COMMAND_GET 6
+#define COMMAND_CREATE 9
+#define COMMAND_PROTOCOL 10
+
+#define PROTOCOL_V2 2
+
+static std::atomic<long> g_allocations(0);
+
+void* operator new(size_t size){
+  ++g_allocations;
+  void* p = malloc(size > 0 ? size : 1);
+  if(p == NULL){
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size){
+  ++g_allocations;
+  void* p = malloc(size > 0 ? size : 1);
+  if(p == NULL){
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) throw(){
+  free(p);
+}
+
+void operator delete[](void* p) throw(){
+  free(p);
+}
+
+using boost::asio::ip::tcp;
+
+static int FLAGS_num = 100000;
+static int FLAGS_value_size = 100;
+static int FLAGS_depth = 32;
+
+inline void encode_int(char* buffer, int val){
+  buffer[0] = (char)(val & 255);
+  buffer[1] = (char)((val >> 8) & 255);
+  buffer[2] = (char)((val >> 16) & 255);
+  buffer[3] = (char)((val >> 24) & 255);
+}
+
+inline int read_int(const char* buffer){
+  int val = 0;
+  val |= (int)(unsigned char)buffer[0];
+  val |= ((int)(unsigned char)buffer[1]) << 8;
+  val |= ((int)(unsigned char)buffer[2]) << 16;
+  val |= ((int)(unsigned char)buffer[3]) << 24;
+  return val;
+}
+
+class bench_client{
+public:
+  bench_client(boost::asio::io_service& io) : _socket(io), _protocol(1), _request(), _response(){
+  }
+
+public:
+  void connect(){
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), 4406);
+    for(int retry = 0; ; ++retry){
+      boost::system::error_code error;
+      _socket.connect(endpoint, error);
+      if(!error){
+        return;
+      }
+      if(retry == 50){
+        throw boost::system::system_error(error);
+      }
+      _socket.close();
+      boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    }
+  }
+
+  void send(int command, int request_id, const std::string& key, const std::string& value){
+    size_t header_size = _protocol == PROTOCOL_V2 ? 12 : 8;
+    size_t data_size = command == COMMAND_PUT ? 8 + key.size() + value.size() : key.size();
+    if(_request.size() < header_size + data_size){
+      _request.resize(header_size + data_size);
+    }
+    char* buf = &_request[0];
+    encode_int(buf, command);
+    buf += 4;
+    if(_protocol == PROTOCOL_V2){
+      encode_int(buf, request_id);
+      buf += 4;
+    }
+    encode_int(buf, (int)data_size);
+    buf += 4;
+    if(command == COMMAND_PUT){
+      encode_int(buf, (int)key.size());
+      encode_int(buf + 4, (int)value.size());
+      buf += 8;
+    }
+    memcpy(buf, key.data(), key.size());
+    if(command == COMMAND_PUT){
+      memcpy(buf + key.size(), value.data(), value.size());
+    }
+    boost::asio::write(_socket, boost::asio::buffer(&_request[0], header_size + data_size));
+  }
+
+  int receive(){
+    size_t header_size = _protocol == PROTOCOL_V2 ? 12 : 8;
+    char header[12];
+    boost::asio::read(_socket, boost::asio::buffer(header, header_size));
+    const char* buf = _protocol == PROTOCOL_V2 ? header + 4 : header;
+    int data_size = read_int(buf + 4);
+    if(data_size > 0){
+      if(_response.size() < (size_t)data_size){
+        _response.resize(data_size);
+      }
+      boost::asio::read(_socket, boost::asio::buffer(&_response[0], data_size));
+    }
+    return read_int(buf);
+  }
+
+  int call(int command, const std::string& key, const std::string& value){
+    send(command, 0, key, value);
+    return receive();
+  }
+
+  void set_protocol(int protocol){
+    std::string data(4, '\0');
+    encode_int(&data[0], protocol);
+    call(COMMAND_PROTOCOL, data, std::string());
+    _protocol = protocol;
+  }
+
+private:
+  tcp::socket _socket;
+  int _protocol;
+  std::vector<char> _request;
+  std::vector<char> _response;
+};
+
+static void make_key(int k, std::string* key){
+  char buf[32];
+  int size = sprintf(buf, "%016d", k);
+  key->assign(buf, size);
+}
+
+static void run(bench_client& client, const char* name, int command, int depth){
+  std::string key;
+  std::string value(FLAGS_value_size, 'x');
+  key.reserve(32);
+  // let the pools and the memtable warm up first
+  for(int i = 0; i < 1000; ++i){
+    make_key(i, &key);
+    client.call(command, key, value);
+  }
+
+  long before = g_allocations;
+  int errors = 0;
+  int sent = 0, received = 0;
+  while(received < FLAGS_num){
+    while(sent < FLAGS_num && sent - received < depth){
+      make_key(sent, &key);
+      client.send(command, sent, key, value);
+      ++sent;
+    }
+    if(client.receive() != 0){
+      ++errors;
+    }
+    ++received;
+  }
+  long allocations = g_allocations - before;
+  fprintf(stdout, "%-12s : %8.2f allocations/request (%d errors)\n", name, (double)allocations / FLAGS_num, errors);
+}
+
+int main(int argc, char** argv){
+  for(int i = 1; i < argc; i++){
+    if(strncmp(argv[i], "--num=", 6) == 0){
+      FLAGS_num = atoi(argv[i] + 6);
+    }else if(strncmp(argv[i], "--value_size=", 13) == 0){
+      FLAGS_value_size = atoi(argv[i] + 13);
+    }else if(strncmp(argv[i], "--depth=", 8) == 0){
+      FLAGS_depth = atoi(argv[i] + 8);
+    }else{
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  db_service service;
+  service.start();
+  {
+    boost::asio::io_service io;
+    bench_client client(io);
+    client.connect();
+    client.call(COMMAND_LOGIN, std::string(), std::string());
+    client.call(COMMAND_CREATE, std::string("alloc_bench"), std::string());
+    if(client.call(COMMAND_OPEN, std::string("alloc_bench"), std::string()) != 0){
+      fprintf(stderr, "cannot open the alloc_bench database\n");
+      service.stop();
+      return 1;
+    }
+    run(client, "put", COMMAND_PUT, 1);
+    run(client, "get", COMMAND_GET, 1);
+    client.set_protocol(PROTOCOL_V2);
+    run(client, "put (v2)", COMMAND_PUT, FLAGS_depth);
+    run(client, "get (v2)", COMMAND_GET, FLAGS_depth);
+  }
+  service.stop();
+  return 0;
+}
\ No newline at end of file
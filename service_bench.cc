@@ -0,0 +1,353 @@
+// Load generator for the network service. It drives a running server over
+// the wire protocol with a number of connections, each on its own thread,
+// keeping up to --depth requests in flight per connection (protocol v2 when
+// the depth is above 1), and reports the throughput and the p50/p99/p999
+// request latency.
+//
+//   --host=ADDR         server address (default 127.0.0.1)
+//   --port=N            server port (default 4406)
+//   --db=NAME           database to create and use (default bench)
+//   --connections=N     concurrent connections (default 4)
+//   --depth=N           requests in flight per connection (default 1)
+//   --num=N             requests per connection (default 100000)
+//   --reads=N           percentage of GETs, the rest are PUTs (default 50)
+//   --keys=N            size of the key space (default 100000)
+//   --value_size=N      size of the values written (default 100)
+//   --fill=0|1          write the key space once before the run (default 1)
+//   --histogram=0|1     print the latency histogram (default 0)
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "leveldb/env.h"
+#include "util/histogram.h"
+#include "util/random.h"
+
+#define COMMAND_LOGIN 1
+#define COMMAND_OPEN 2
+#define COMMAND_PUT 4
+#define COMMAND_GET 6
+#define COMMAND_CREATE 9
+#define COMMAND_PROTOCOL 10
+
+#define RESULT_OK 0
+#define RESULT_NOT_FOUND 405
+
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+
+using boost::asio::ip::tcp;
+
+static const char* FLAGS_host = "127.0.0.1";
+static int FLAGS_port = 4406;
+static const char* FLAGS_db = "bench";
+static int FLAGS_connections = 4;
+static int FLAGS_depth = 1;
+static int FLAGS_num = 100000;
+static int FLAGS_reads = 50;
+static int FLAGS_keys = 100000;
+static int FLAGS_value_size = 100;
+static bool FLAGS_fill = true;
+static bool FLAGS_histogram = false;
+
+inline void encode_int(char* buffer, int val){
+  buffer[0] = (char)(val & 255);
+  buffer[1] = (char)((val >> 8) & 255);
+  buffer[2] = (char)((val >> 16) & 255);
+  buffer[3] = (char)((val >> 24) & 255);
+}
+
+inline int read_int(const char* buffer){
+  int val = 0;
+  val |= (int)(unsigned char)buffer[0];
+  val |= ((int)(unsigned char)buffer[1]) << 8;
+  val |= ((int)(unsigned char)buffer[2]) << 16;
+  val |= ((int)(unsigned char)buffer[3]) << 24;
+  return val;
+}
+
+class bench_client{
+public:
+  bench_client(boost::asio::io_service& io) : _socket(io), _protocol(PROTOCOL_V1), _request(), _response(){
+  }
+
+public:
+  void connect(){
+    tcp::endpoint endpoint(boost::asio::ip::address::from_string(FLAGS_host), (unsigned short)FLAGS_port);
+    _socket.connect(endpoint);
+    _socket.set_option(tcp::no_delay(true));
+  }
+
+  // queues the request, it is sent by the next flush
+  void send(int command, int request_id, const std::string& key, const std::string& value){
+    size_t header_size = _protocol == PROTOCOL_V2 ? 12 : 8;
+    size_t data_size = command == COMMAND_PUT ? 8 + key.size() + value.size() : key.size();
+    size_t offset = _request.size();
+    _request.resize(offset + header_size + data_size);
+    char* buf = &_request[offset];
+    encode_int(buf, command);
+    buf += 4;
+    if(_protocol == PROTOCOL_V2){
+      encode_int(buf, request_id);
+      buf += 4;
+    }
+    encode_int(buf, (int)data_size);
+    buf += 4;
+    if(command == COMMAND_PUT){
+      encode_int(buf, (int)key.size());
+      encode_int(buf + 4, (int)value.size());
+      buf += 8;
+    }
+    memcpy(buf, key.data(), key.size());
+    if(command == COMMAND_PUT){
+      memcpy(buf + key.size(), value.data(), value.size());
+    }
+  }
+
+  void flush(){
+    if(!_request.empty()){
+      boost::asio::write(_socket, boost::asio::buffer(&_request[0], _request.size()));
+      _request.clear();
+    }
+  }
+
+  // returns the status of the next response and its request id (0 for v1)
+  int receive(int* request_id){
+    size_t header_size = _protocol == PROTOCOL_V2 ? 12 : 8;
+    char header[12];
+    boost::asio::read(_socket, boost::asio::buffer(header, header_size));
+    const char* buf = header;
+    *request_id = 0;
+    if(_protocol == PROTOCOL_V2){
+      *request_id = read_int(buf);
+      buf += 4;
+    }
+    int data_size = read_int(buf + 4);
+    if(data_size > 0){
+      if(_response.size() < (size_t)data_size){
+        _response.resize(data_size);
+      }
+      boost::asio::read(_socket, boost::asio::buffer(&_response[0], data_size));
+    }
+    return read_int(buf);
+  }
+
+  int call(int command, const std::string& key, const std::string& value){
+    int request_id = 0;
+    send(command, 0, key, value);
+    flush();
+    return receive(&request_id);
+  }
+
+  void set_protocol(int protocol){
+    std::string data(4, '\0');
+    encode_int(&data[0], protocol);
+    call(COMMAND_PROTOCOL, data, std::string());
+    _protocol = protocol;
+  }
+
+private:
+  tcp::socket _socket;
+  int _protocol;
+  std::vector<char> _request;
+  std::vector<char> _response;
+};
+
+static void make_key(int k, std::string* key){
+  char buf[32];
+  int size = snprintf(buf, sizeof(buf), "%016d", k);
+  key->assign(buf, size);
+}
+
+static bool open_db(bench_client& client){
+  client.call(COMMAND_LOGIN, std::string(), std::string());
+  int status = client.call(COMMAND_OPEN, std::string(FLAGS_db), std::string());
+  if(status != RESULT_OK){
+    client.call(COMMAND_CREATE, std::string(FLAGS_db), std::string());
+    status = client.call(COMMAND_OPEN, std::string(FLAGS_db), std::string());
+  }
+  if(status != RESULT_OK){
+    fprintf(stderr, "cannot open the %s database (status %d)\n", FLAGS_db, status);
+    return false;
+  }
+  return true;
+}
+
+struct bench_result{
+  bench_result() : hist(), done(0), errors(0), not_found(0), failed(false){
+    hist.Clear();
+  }
+
+  leveldb::Histogram hist;
+  int done;
+  int errors;
+  int not_found;
+  bool failed;
+};
+
+static void run_connection(int id, bench_result* result){
+  try{
+    boost::asio::io_service io;
+    bench_client client(io);
+    client.connect();
+    if(!open_db(client)){
+      result->failed = true;
+      return;
+    }
+    if(FLAGS_depth > 1){
+      client.set_protocol(PROTOCOL_V2);
+    }
+
+    leveldb::Env* env = leveldb::Env::Default();
+    leveldb::Random rnd(301 + id);
+    std::string key;
+    std::string value(FLAGS_value_size, 'x');
+    std::vector<int> commands(FLAGS_num);
+    std::vector<uint64_t> start(FLAGS_num);
+    int sent = 0;
+    while(result->done < FLAGS_num){
+      while(sent < FLAGS_num && sent - result->done < FLAGS_depth){
+        int command = (int)rnd.Uniform(100) < FLAGS_reads ? COMMAND_GET : COMMAND_PUT;
+        make_key((int)rnd.Uniform(FLAGS_keys), &key);
+        commands[sent] = command;
+        start[sent] = env->NowMicros();
+        client.send(command, sent, key, value);
+        ++sent;
+      }
+      client.flush();
+
+      int request_id = 0;
+      int status = client.receive(&request_id);
+      if(FLAGS_depth == 1){
+        // v1 responses carry no id, they come back in order
+        request_id = result->done;
+      }
+      if(request_id < 0 || request_id >= sent){
+        fprintf(stderr, "connection %d: unexpected request id %d\n", id, request_id);
+        result->failed = true;
+        return;
+      }
+      result->hist.Add((double)(env->NowMicros() - start[request_id]));
+      if(status == RESULT_NOT_FOUND && commands[request_id] == COMMAND_GET){
+        ++result->not_found;
+      }else if(status != RESULT_OK){
+        ++result->errors;
+      }
+      ++result->done;
+    }
+  }catch(const std::exception& e){
+    fprintf(stderr, "connection %d: %s\n", id, e.what());
+    result->failed = true;
+  }
+}
+
+static bool fill(){
+  boost::asio::io_service io;
+  bench_client client(io);
+  client.connect();
+  if(!open_db(client)){
+    return false;
+  }
+  client.set_protocol(PROTOCOL_V2);
+  std::string key;
+  std::string value(FLAGS_value_size, 'x');
+  int sent = 0, received = 0, errors = 0;
+  while(received < FLAGS_keys){
+    while(sent < FLAGS_keys && sent - received < 64){
+      make_key(sent, &key);
+      client.send(COMMAND_PUT, sent, key, value);
+      ++sent;
+    }
+    client.flush();
+    int request_id = 0;
+    if(client.receive(&request_id) != RESULT_OK){
+      ++errors;
+    }
+    ++received;
+  }
+  if(errors > 0){
+    fprintf(stderr, "fill: %d of %d writes failed\n", errors, FLAGS_keys);
+  }
+  return errors == 0;
+}
+
+int main(int argc, char** argv){
+  for(int i = 1; i < argc; i++){
+    int n;
+    char junk;
+    if(strncmp(argv[i], "--host=", 7) == 0){
+      FLAGS_host = argv[i] + 7;
+    }else if(strncmp(argv[i], "--db=", 5) == 0){
+      FLAGS_db = argv[i] + 5;
+    }else if(sscanf(argv[i], "--port=%d%c", &n, &junk) == 1){
+      FLAGS_port = n;
+    }else if(sscanf(argv[i], "--connections=%d%c", &n, &junk) == 1 && n > 0){
+      FLAGS_connections = n;
+    }else if(sscanf(argv[i], "--depth=%d%c", &n, &junk) == 1 && n > 0){
+      FLAGS_depth = n;
+    }else if(sscanf(argv[i], "--num=%d%c", &n, &junk) == 1 && n > 0){
+      FLAGS_num = n;
+    }else if(sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1 && n >= 0 && n <= 100){
+      FLAGS_reads = n;
+    }else if(sscanf(argv[i], "--keys=%d%c", &n, &junk) == 1 && n > 0){
+      FLAGS_keys = n;
+    }else if(sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1 && n > 0){
+      FLAGS_value_size = n;
+    }else if(sscanf(argv[i], "--fill=%d%c", &n, &junk) == 1 && (n == 0 || n == 1)){
+      FLAGS_fill = n != 0;
+    }else if(sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 && (n == 0 || n == 1)){
+      FLAGS_histogram = n != 0;
+    }else{
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  try{
+    if(FLAGS_fill && FLAGS_reads > 0 && !fill()){
+      return 1;
+    }
+  }catch(const std::exception& e){
+    fprintf(stderr, "fill: %s\n", e.what());
+    return 1;
+  }
+
+  std::vector<bench_result> results(FLAGS_connections);
+  std::vector<boost::shared_ptr<boost::thread>> threads;
+  uint64_t start = leveldb::Env::Default()->NowMicros();
+  for(int i = 0; i < FLAGS_connections; ++i){
+    threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(run_connection, i, &results[i])));
+  }
+  for(size_t i = 0; i < threads.size(); ++i){
+    threads[i]->join();
+  }
+  double seconds = (leveldb::Env::Default()->NowMicros() - start) * 1e-6;
+
+  leveldb::Histogram hist;
+  hist.Clear();
+  int done = 0, errors = 0, not_found = 0;
+  bool failed = false;
+  for(size_t i = 0; i < results.size(); ++i){
+    hist.Merge(results[i].hist);
+    done += results[i].done;
+    errors += results[i].errors;
+    not_found += results[i].not_found;
+    failed = failed || results[i].failed;
+  }
+
+  fprintf(stdout, "connections : %d, depth %d, %d%% reads, %d-byte values, %d keys\n",
+    FLAGS_connections, FLAGS_depth, FLAGS_reads, FLAGS_value_size, FLAGS_keys);
+  fprintf(stdout, "requests    : %d in %.3f s, %.1f ops/sec (%d errors, %d not found)\n",
+    done, seconds, seconds > 0 ? done / seconds : 0.0, errors, not_found);
+  fprintf(stdout, "latency     : p50 %.1f  p99 %.1f  p999 %.1f  avg %.1f micros/op\n",
+    hist.Median(), hist.Percentile(99), hist.Percentile(99.9), hist.Average());
+  if(FLAGS_histogram){
+    fprintf(stdout, "Microseconds per op:\n%s\n", hist.ToString().c_str());
+  }
+  return failed ? 1 : 0;
+}
@@ -1,687 +1,1457 @@
-
-#include <boost/asio.hpp>
-#include <boost/thread.hpp>
-#include <leveldb/db.h>
-#include <leveldb/write_batch.h>
-#include "db_service.h"
-#include "dbmgr.h"
-
-#include <boost/smart_ptr.hpp>
-#include <boost/bind.hpp>
-#include <iostream>
-#include <vector>
-
-#define HEADER_SIZE 8
-
-#define COMMAND_LOGIN 1
-#define COMMAND_OPEN 2
-#define COMMAND_CLOSE 3
-#define COMMAND_PUT 4
-#define COMMAND_BATCH 5
-#define COMMAND_GET 6
-#define COMMAND_DELETE 7
-#define COMMAND_LIST 8
-#define COMMAND_CREATE 9
-
-#define RESULT_OK 0
-#define RESULT_IO_ERROR 501
-#define RESULT_UN_AUTH 401
-#define RESULT_DATA_ERROR 400
-#define RESULT_NO_DB 402
-#define RESULT_CREAT_FAILED 502
-#define RESULT_NO_DB_SELECTED 403
-#define RESULT_DB_ERROR 503
-#define RESULT_BAD_COMMAND 404
-#define RESULT_NOT_FOUND 405
-
-using boost::asio::ip::tcp;
-
-db_manager dbmgr;
-
-inline int read_int(const char* buffer){
-  int val = 0;
-  val |= (int)(unsigned char)buffer[0];
-  val |= ((int)(unsigned char)buffer[1]) << 8;
-  val |= ((int)(unsigned char)buffer[2]) << 16;
-  val |= ((int)(unsigned char)buffer[3]) << 24;
-  return val;
-}
-
-inline boost::shared_array<char> write_int(int val){
-  char* buffer = new char[4];
-  buffer[0] = (char)(val & 255);
-  buffer[1] = (char)((val >> 8) & 255);
-  buffer[2] = (char)((val >> 16) & 255);
-  buffer[3] = (char)((val >> 24) & 255);
-  return boost::shared_array<char>(buffer);
-}
-
-class db_session;
-
-class db_command : public boost::enable_shared_from_this<db_command> {
-public:
-  typedef boost::shared_ptr<db_command> pointer;
-
-public:
-  db_command(const boost::shared_ptr<db_session>& session)
-    : _session(session), _buffer(new char[4]), _buf_size(4){
-  }
-
-public:
-  virtual void execute(const boost::shared_array<char>& data, int data_size);
-
-protected:
-
-  const char* data() const{
-    return _buffer.get();
-  }
-
-  virtual void complete();
-
-  tcp::socket& socket();
-
-  size_t buffer_size() const{
-    return _buf_size;
-  }
-
-  boost::shared_ptr<db_session>& session(){
-    return _session;
-  }
-
-  virtual void process_data() = 0;
-
-private:
-  db_command(const db_command&);
-  db_command& operator = (const db_command&);
-
-private:
-  boost::shared_ptr<db_session> _session;
-  boost::shared_array<char> _buffer;
-  size_t _buf_size;
-};
-
-class db_session : public boost::enable_shared_from_this<db_session>{
-public:
-  typedef boost::shared_ptr<db_session> pointer;
-
-private:
-  db_session(boost::asio::io_service& io) : _socket(io), _current_db(), _command_data(), _bytes_read(0), _data_size(0){
-  }
-
-private:
-  void data_read(const boost::system::error_code& error, size_t bytes_transferred);
-  void read_complete();
-
-private:
-  static boost::shared_ptr<db_command> create_command(int command, const db_session::pointer& session);
-
-public:
-  static pointer create(boost::asio::io_service& io){
-    return pointer(new db_session(io));
-  }
-
-public:
-  boost::shared_ptr<leveldb::DB> current_db(){
-    return _current_db;
-  }
-
-  tcp::socket& socket(){
-    return _socket;
-  }
-
-  void set_db(const boost::shared_ptr<leveldb::DB>& db){
-    _current_db = db;
-  }
-
-  void start();
-
-private:
-  tcp::socket _socket;
-  boost::shared_ptr<leveldb::DB> _current_db;
-  boost::shared_array<char> _command_data;
-  int _bytes_read;
-  int _data_size;
-  char _header[HEADER_SIZE];
-};
-
-void db_command::execute(const boost::shared_array<char>& data, int data_size){
-  _buf_size = data_size;
-  _buffer = data;
-  this->process_data();
-}
-
-void db_command::complete(){
-  _session->start();
-}
-
-tcp::socket& db_command::socket(){
-  return _session->socket();
-}
-
-void db_session::start() {
-  pointer self = shared_from_this();
-  boost::asio::async_read(_socket, boost::asio::buffer(_header, HEADER_SIZE), [this,self](const boost::system::error_code& error, size_t /*bytes_transffered*/){
-    if(!error){
-      _data_size = read_int(_header + 4);
-      _bytes_read = 0;
-      if(_data_size <= 0){
-        this->read_complete();
-        return;
-      }
-      this->_command_data.reset(new char[_data_size]);
-      boost::asio::async_read(_socket, boost::asio::buffer(_command_data.get(), _data_size), boost::bind(&db_session::data_read, self,
-        boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
-    }
-    // else, read header error, drop the connection
-  });
-}
-
-void db_session::data_read(const boost::system::error_code& error, size_t bytes_transferred){
-  pointer self = shared_from_this();
-  if(!error){
-    this->read_complete();
-  }
-}
-
-void db_session::read_complete(){
-  int command = read_int(_header);
-  pointer self = shared_from_this();
-  db_command::pointer db_cmd = db_session::create_command(command, self);
-  if(db_cmd){
-    db_cmd->execute(_command_data, _data_size);
-  }else{
-    boost::shared_array<char> buffer(new char[8]);
-    char len_buf[] = {0, 0, 0, 0};
-    boost::shared_array<char> result(write_int(RESULT_BAD_COMMAND));
-    memcpy(buffer.get(), result.get(), 4);
-    memcpy(buffer.get() + 4, len_buf, 4);
-    boost::asio::async_write(_socket, boost::asio::buffer(buffer.get(), 8), [this, self](const boost::system::error_code& error, size_t /*bytes_transferred*/){
-      if(!error){
-        this->start();
-      }else{ // io error drop the socket
-        this->_socket.close();
-      }
-    });
-  }
-}
-
-class login_command : public db_command{
-public:
-  login_command(const boost::shared_ptr<db_session>& session) :
-    db_command(session){
-  }
-
-protected:
-  virtual void process_data();
-};
-
-
-void login_command::process_data(){
-  // for now, we don't have user database, just return OK to client
-  pointer self = shared_from_this();
-  boost::shared_array<char> buffer(new char[8]);
-  boost::shared_array<char> result (write_int(RESULT_OK));
-  char len[] = {0, 0, 0, 0};
-  memcpy(buffer.get(), result.get(), 4);
-  memcpy(buffer.get() + 4, len, 4);
-  boost::asio::async_write(socket(), boost::asio::buffer(buffer.get(), 8), [this, self, buffer](const boost::system::error_code& error, size_t /*bytes_transferred*/){
-    if(!error){
-      this->complete();
-    }else{
-      // io error, close out and stop here
-      socket().close();
-    }
-  });
-}
-
-class open_command : public db_command{
-public:
-  open_command(const boost::shared_ptr<db_session>& session)
-    :db_command(session){
-  }
-
-protected:
-  virtual void process_data();
-
-private:
-  virtual int do_open(const std::string& db_name);
-};
-
-void open_command::process_data(){
-  boost::shared_array<char> buffer(new char[8]);
-  char len_buf[] = {0, 0, 0, 0};
-  if(buffer_size() < 4){
-    // error, invalid command data
-    boost::shared_array<char> result(write_int(RESULT_DATA_ERROR));
-    memcpy(buffer.get(), result.get(), 4);
-    memcpy(buffer.get() + 4, len_buf, 4);
-    pointer self = shared_from_this();
-    boost::asio::async_write(socket(), boost::asio::buffer(buffer.get(), 8), [self, this, buffer](const boost::system::error_code& error, size_t){
-      if(!error){
-        this->complete();
-      }else{
-        socket().close();
-      }
-    });
-    return;
-  }
-  const char* buf = data();
-  std::string db_name(buf, buf + buffer_size());
-  int status = do_open(db_name);
-  boost::shared_array<char> result(write_int(status));
-  memcpy(buffer.get(), result.get(), 4);
-  memcpy(buffer.get() + 4, len_buf, 4);
-  pointer self = shared_from_this();
-  boost::asio::async_write(socket(), boost::asio::buffer(buffer.get(), 8), [this, self, buffer](const boost::system::error_code& error, size_t){
-    if(!error){
-      this->complete();
-    }else{
-      //we done, we could not recover from the error
-      socket().close();
-    }
-  });
-}
-
-int open_command::do_open(const std::string& db_name){
-  boost::shared_ptr<leveldb::DB> db = dbmgr.open_db(db_name);
-  if(db){
-    session()->set_db(db);
-    return RESULT_OK;
-  }
-  return RESULT_NO_DB;
-}
-
-class create_command : public open_command{
-public:
-  explicit create_command(const boost::shared_ptr<db_session>& session) : 
-  open_command(session){
-  }
-
-private:
-  virtual int do_open(const std::string& db_name);
-};
-
-int create_command::do_open(const std::string& db_name){
-  if(dbmgr.create_db(db_name)){
-    return RESULT_OK;
-  }
-  return RESULT_CREAT_FAILED;
-}
-
-class tx_command : public db_command{
-public:
-  tx_command(const boost::shared_ptr<db_session>& session)
-    : db_command(session){
-  }
-
-protected:
-  virtual void process_data() = 0;
-
-  void response(int status);
-};
-
-void tx_command::response(int status){
-  boost::shared_array<char> buffer(new char[8]);
-  char buf_len[] = {0, 0, 0, 0};
-  boost::shared_array<char> result(write_int(status));
-  memcpy(buffer.get(), result.get(), 4);
-  memcpy(buffer.get() + 4, buf_len, 4);
-  pointer self = shared_from_this();
-  boost::asio::async_write(socket(), boost::asio::buffer(buffer.get(), 8), [this, self, buffer](const boost::system::error_code& error, size_t){
-    if(!error){
-      this->complete();
-    }else{
-      socket().close();
-    }
-  });
-}
-
-class put_command : public tx_command{
-public:
-  put_command(const boost::shared_ptr<db_session>& session) 
-    : tx_command(session){
-  }
-
-protected:
-  virtual void process_data();
-};
-
-void put_command::process_data(){
-  if(!session()->current_db()){
-    response(RESULT_NO_DB_SELECTED);
-    return;
-  }
-  int buf_size = buffer_size();
-  const char* buf = data();
-  if(buf_size < 8){
-    response(RESULT_DATA_ERROR);
-    return;
-  }
-  int key_size = read_int(buf);
-  int value_size = read_int(buf + 4);
-  buf_size -= 8;
-  if(buf_size < key_size + value_size || key_size < 0 || value_size < 0){
-    response(RESULT_DATA_ERROR);
-    return;
-  }
-  leveldb::Slice key(buf + 8, key_size);
-  leveldb::Slice value(buf + 8 + key_size, value_size);
-  boost::shared_ptr<leveldb::DB> db = session()->current_db();
-  leveldb::Status status = db->Put(leveldb::WriteOptions(), key, value);
-  if(!status.ok()){
-    response(RESULT_DB_ERROR);
-    return;
-  }
-  response(RESULT_OK);
-  return;
-}
-
-class delete_command : public tx_command{
-public:
-  delete_command(const boost::shared_ptr<db_session>& session) 
-    : tx_command(session)
-  {
-  }
-
-protected:
-  virtual void process_data();
-};
-
-void delete_command::process_data(){
-  if(!session()->current_db()){
-    response(RESULT_NO_DB_SELECTED);
-    return;
-  }
-
-  int buf_size = buffer_size();
-  const char* buf = data();
-  if(buf_size <= 0){
-    response(RESULT_DATA_ERROR);
-    return;
-  }
-
-  leveldb::Slice key(buf, buf_size);
-  boost::shared_ptr<leveldb::DB> db = session()->current_db();
-  leveldb::Status status = db->Delete(leveldb::WriteOptions(), key);
-  if(status.ok()){
-    response(RESULT_OK);
-    return;
-  }
-
-  if(status.IsNotFound()){
-    response(RESULT_NOT_FOUND);
-    return;
-  }
-
-  response(RESULT_DB_ERROR);
-}
-
-class read_command : public tx_command{
-public:
-  read_command(const boost::shared_ptr<db_session>& session)
-    : tx_command(session){
-  }
-
-protected:
-  virtual void process_data();
-};
-
-void read_command::process_data(){
-  if(!session()->current_db()){
-    response(RESULT_NO_DB_SELECTED);
-    return;
-  }
-  int buf_size = buffer_size();
-  const char* buf = data();
-  if(buf_size <= 0){
-    response(RESULT_DATA_ERROR);
-    return;
-  }
-  leveldb::Slice key(buf, buf_size);
-  boost::shared_ptr<leveldb::DB> db = session()->current_db();
-  std::string value;
-  leveldb::Status status = db->Get(leveldb::ReadOptions(), key, &value);
-
-  if(!status.ok()){
-    if(status.IsNotFound()){
-      response(RESULT_NOT_FOUND);
-    }else{
-      response(RESULT_DB_ERROR);
-    }
-    return;
-  }
-  boost::shared_array<char> buffer(new char[8 + value.size()]);
-  boost::shared_array<char> result(write_int(RESULT_OK));
-  boost::shared_array<char> buf_len(write_int((int)value.size()));
-  memcpy(buffer.get(), result.get(), 4);
-  memcpy(buffer.get() + 4, buf_len.get(), 4);
-  memcpy(buffer.get() + 8, value.data(), value.size());
-  pointer self = shared_from_this();
-  boost::asio::async_write(socket(), boost::asio::buffer(buffer.get(), 8 + value.size()), [self, this, buffer](const boost::system::error_code& error, size_t){
-    if(!error){
-      this->complete();
-    }else{
-      socket().close();
-    }
-  });
-
-}
-
-class batch_command : public tx_command{
-public:
-  batch_command(const boost::shared_ptr<db_session>& session)
-    : tx_command(session){
-  }
-
-protected:
-  virtual void process_data();
-};
-
-void batch_command::process_data(){
-  if(!session()->current_db()){
-    response(RESULT_NO_DB_SELECTED);
-    return;
-  }
-  int buf_size = buffer_size();
-  const char* buf = data();
-  if(buf_size <= 0){
-    response(RESULT_DATA_ERROR);
-    return;
-  }
-  int items_count = read_int(buf);
-  buf += 4;
-  buf_size -= 4;
-  if(items_count <= 0){
-    response(RESULT_DATA_ERROR);
-    return;
-  }
-  leveldb::WriteBatch batch;
-  leveldb::Slice key;
-  leveldb::Slice value;
-  int key_size(0), value_size(0);
-  while(items_count > 0){
-    int command = read_int(buf);
-    buf += 4;
-    buf_size -= 4;
-    switch(command){
-    case COMMAND_PUT:
-      key_size = read_int(buf);
-      buf += 4;
-      buf_size -= 4;
-      value_size = read_int(buf);
-      buf += 4;
-      buf_size -= 4;
-      if(key_size + value_size > buf_size || key_size <= 0 || value_size <= 0){
-        response(RESULT_DATA_ERROR);
-        return;
-      }
-      key = leveldb::Slice(buf, key_size);
-      buf += key_size;
-      buf_size -= key_size;
-      value = leveldb::Slice(buf, value_size);
-      buf += value_size;
-      buf_size -= value_size;
-      batch.Put(key, value);
-      break;
-    case COMMAND_DELETE:
-      key_size = read_int(buf);
-      buf += 4;
-      buf_size -= 4;
-      if(key_size <= 0 || buf_size < key_size){
-        response(RESULT_DATA_ERROR);
-        return;
-      }
-      key = leveldb::Slice(buf, key_size);
-      batch.Delete(key);
-      break;
-    default:
-      response(RESULT_BAD_COMMAND);
-      return;
-    }
-    --items_count;
-  }//end while
-  boost::shared_ptr<leveldb::DB> db = session()->current_db();
-  leveldb::Status s = db->Write(leveldb::WriteOptions(), &batch);
-  if(s.ok()){
-    response(RESULT_OK);
-    return;
-  }
-  response(RESULT_DB_ERROR);
-  return;
-}
-
-class close_command : public tx_command{
-public:
-  close_command(const boost::shared_ptr<db_session>& session)
-    : tx_command(session){
-  }
-
-protected:
-  virtual void process_data();
-};
-
-void close_command::process_data(){
-  session()->set_db(boost::shared_ptr<leveldb::DB>(NULL));
-  response(RESULT_OK);
-  return;
-}
-
-class list_command : public tx_command{
-public:
-  list_command(const boost::shared_ptr<db_session>& session)
-    : tx_command(session){
-  }
-
-protected:
-  virtual void process_data();
-};
-
-void list_command::process_data(){
-  response(RESULT_OK);
-}
-
-boost::shared_ptr<db_command> db_session::create_command(int command, const db_session::pointer& session) {
-  switch (command)
-  {
-  case COMMAND_BATCH:
-    return boost::shared_ptr<db_command>(new batch_command(session));
-  case COMMAND_CLOSE:
-    return boost::shared_ptr<db_command>(new close_command(session));
-  case COMMAND_CREATE:
-    return boost::shared_ptr<db_command>(new ::create_command(session));
-  case COMMAND_GET:
-    return boost::shared_ptr<db_command>(new read_command(session));
-  case COMMAND_LIST:
-    return boost::shared_ptr<db_command>(new list_command(session));
-  case COMMAND_LOGIN:
-    return boost::shared_ptr<db_command>(new login_command(session));
-  case COMMAND_OPEN:
-    return boost::shared_ptr<db_command>(new open_command(session));
-  case COMMAND_PUT:
-    return boost::shared_ptr<db_command>(new put_command(session));
-  case COMMAND_DELETE:
-    return boost::shared_ptr<db_command>(new delete_command(session));
-  default:
-    return boost::shared_ptr<db_command>();
-    break;
-  }
-}
-
-class db_tcp_server {
-public:
-  db_tcp_server(boost::asio::io_service& io) : _acceptor(io, tcp::endpoint(tcp::v4(), 4406)){
-  }
-
-public:
-
-  void stop(){
-    boost::system::error_code error;
-    _acceptor.close(error);
-  }
-
-  void start(){
-    db_session::pointer session = db_session::create(_acceptor.get_io_service());
-    _acceptor.async_accept(session->socket(), [this, session](const boost::system::error_code& error){
-      if(!error){
-        session->start();
-      }
-      start();
-    });
-  }
-private:
-  tcp::acceptor _acceptor;
-};
-
-class db_service_impl{
-public:
-  db_service_impl() : _io_service(), _tcp_server(), _worker_threads(){
-  }
-
-public:
-  void start(){
-    SYSTEM_INFO sys_info = {0};
-    GetSystemInfo(&sys_info);
-    if(_tcp_server){
-      _tcp_server->stop();
-    }
-    _tcp_server.reset(new db_tcp_server(_io_service));
-    _tcp_server->start();
-    //start io threads
-    for(DWORD counter = 0; counter < sys_info.dwNumberOfProcessors; ++ counter){
-      _worker_threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&boost::asio::io_service::run, &_io_service))));
-    }
-  }
-
-  void stop(){
-    if(_tcp_server){
-      _tcp_server->stop();
-    }
-    _io_service.stop();
-    std::for_each(_worker_threads.begin(), _worker_threads.end(), [](boost::shared_ptr<boost::thread>& thread){
-      thread->join();
-    });
-  }
-private:
-  boost::asio::io_service _io_service;
-  boost::shared_ptr<db_tcp_server> _tcp_server;
-  std::vector<boost::shared_ptr<boost::thread>> _worker_threads;
-};
-
-db_service::db_service() : _impl(new db_service_impl)
-{
-}
-
-db_service::~db_service()
-{
-}
-
-bool db_service::start()
-{
-  _impl->start();
-  return true;
-}
-
-void db_service::stop()
-{
-  _impl->stop();
-}
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+#include "db_service.h"
+#include "dbmgr.h"
+#include "db_executor.h"
+#include "db_group_commit.h"
+#include "db_cursor.h"
+#include "win32_helper.h"
+
+#include <boost/smart_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define HEADER_SIZE 8
+#define HEADER_SIZE_V2 12
+
+#define COMMAND_LOGIN 1
+#define COMMAND_OPEN 2
+#define COMMAND_CLOSE 3
+#define COMMAND_PUT 4
+#define COMMAND_BATCH 5
+#define COMMAND_GET 6
+#define COMMAND_DELETE 7
+#define COMMAND_LIST 8
+#define COMMAND_CREATE 9
+#define COMMAND_PROTOCOL 10
+#define COMMAND_STATS 11
+#define COMMAND_SCAN 12
+#define COMMAND_SCAN_NEXT 13
+#define COMMAND_SCAN_CLOSE 14
+#define COMMAND_SNAPSHOT 15
+#define COMMAND_RELEASE_SNAPSHOT 16
+#define COMMAND_MGET 17
+
+#define RESULT_OK 0
+#define RESULT_IO_ERROR 501
+#define RESULT_UN_AUTH 401
+#define RESULT_DATA_ERROR 400
+#define RESULT_NO_DB 402
+#define RESULT_CREAT_FAILED 502
+#define RESULT_NO_DB_SELECTED 403
+#define RESULT_DB_ERROR 503
+#define RESULT_BAD_COMMAND 404
+#define RESULT_NOT_FOUND 405
+#define RESULT_BUSY 504
+
+// Protocol v1 frames are
+//   request:  command(4) data_size(4) data
+//   response: status(4) data_size(4) data
+// and a session handles exactly one request at a time.
+// A COMMAND_PROTOCOL request carrying PROTOCOL_V2 switches the session to
+// v2 frames, which are tagged with a client chosen request id
+//   request:  command(4) request_id(4) data_size(4) data
+//   response: request_id(4) status(4) data_size(4) data
+// so the client may keep up to MAX_PIPELINED_REQUESTS requests in flight.
+// Data commands (GET/MGET/PUT/DELETE/BATCH/...) run on the db executor, for
+// a v2 session concurrently and possibly completing out of order, session
+// commands (OPEN/CLOSE/...) are still applied in the order they are received.
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define MAX_PIPELINED_REQUESTS 256
+
+// number of queued responses gathered into a single socket write
+#define MAX_GATHERED_RESPONSES 64
+
+// commands and their buffers are recycled per session, up to this many
+// commands of each kind and buffers of up to this size
+#define MAX_POOLED_COMMANDS 64
+#define MAX_POOLED_BUFFER_SIZE (64 * 1024)
+
+// A SCAN opens a cursor over [start, end) and returns the first chunk of
+// entries, SCAN_NEXT returns the following ones, so the client pulls the
+// range at its own pace. A cursor stays open on the session until the range
+// is done or it is closed with SCAN_CLOSE.
+//   SCAN:      flags(4) limit(4) snapshot_id(4) start_size(4) start end_size(4) end
+//   SCAN_NEXT: cursor_id(4)
+//   response:  cursor_id(4) count(4) (key_size(4) key value_size(4) value)*
+// where cursor_id is 0 once the range is done. snapshot_id is 0 or the id
+// of a snapshot returned by SNAPSHOT, which stays open until released.
+// SCAN_PREFIX promises that all of [start, end) shares the prefix of start
+// (see prefix_delimiter in the ReadMe), which lets a forward scan skip the
+// tables whose filters rule the prefix out.
+#define SCAN_REVERSE 1
+#define SCAN_PREFIX 2
+#define SCAN_CHUNK_BYTES (64 * 1024)
+#define MAX_SESSION_CURSORS 64
+
+// An MGET reads up to MAX_MGET_KEYS keys from one snapshot, the one given
+// by snapshot_id or else an implicit one, and answers with an entry per key
+// in the order of the request
+//   MGET:     snapshot_id(4) count(4) (key_size(4) key)*
+//   response: count(4) (status(4) value_size(4) value)*
+// where status is RESULT_OK, RESULT_NOT_FOUND or RESULT_DB_ERROR.
+#define MAX_MGET_KEYS 1024
+
+#define DEFAULT_PORT 4406
+#define DEFAULT_DB_QUEUE_SIZE 1024
+#define DEFAULT_COMMIT_MAX_BYTES (1024 * 1024)
+
+using boost::asio::ip::tcp;
+
+db_manager dbmgr;
+
+inline int read_int(const char* buffer){
+  int val = 0;
+  val |= (int)(unsigned char)buffer[0];
+  val |= ((int)(unsigned char)buffer[1]) << 8;
+  val |= ((int)(unsigned char)buffer[2]) << 16;
+  val |= ((int)(unsigned char)buffer[3]) << 24;
+  return val;
+}
+
+inline void encode_int(char* buffer, int val){
+  buffer[0] = (char)(val & 255);
+  buffer[1] = (char)((val >> 8) & 255);
+  buffer[2] = (char)((val >> 16) & 255);
+  buffer[3] = (char)((val >> 24) & 255);
+}
+
+// writes a response header for the given protocol, returns its size
+inline size_t encode_response_header(char* buffer, int protocol, int request_id, int status, int data_size){
+  size_t header_size = HEADER_SIZE;
+  if(protocol == PROTOCOL_V2){
+    encode_int(buffer, request_id);
+    buffer += 4;
+    header_size = HEADER_SIZE_V2;
+  }
+  encode_int(buffer, status);
+  encode_int(buffer + 4, data_size);
+  return header_size;
+}
+
+// A response is written as its header followed by the payload, which is
+// sent straight from the string the value was read into.
+struct response_frame{
+  char header[HEADER_SIZE_V2];
+  size_t header_size;
+  boost::shared_ptr<std::string> payload;
+};
+
+class db_session;
+
+class db_command : public boost::enable_shared_from_this<db_command> {
+public:
+  typedef boost::shared_ptr<db_command> pointer;
+
+public:
+  db_command();
+
+public:
+  // binds the command to the request just read from the session
+  void prepare(const boost::shared_ptr<db_session>& session, int request_id);
+
+  // the buffer the data_size bytes of request data are read into
+  char* receive_buffer(int data_size);
+
+  virtual void execute();
+
+  // answers the request without running it
+  void reject(int status);
+
+  // true if the command only works on the database captured when it was
+  // received, so it may run on the db executor concurrently with others
+  virtual bool can_pipeline() const{
+    return false;
+  }
+
+  leveldb::DB* database() const{
+    return _db.get();
+  }
+
+protected:
+
+  const char* data() const{
+    return _buf_size > 0 ? &_buffer[0] : NULL;
+  }
+
+  size_t buffer_size() const{
+    return _buf_size;
+  }
+
+  boost::shared_ptr<db_session>& session(){
+    return _session;
+  }
+
+  // the database selected on the session when this command was received
+  const boost::shared_ptr<leveldb::DB>& current_db() const{
+    return _db;
+  }
+
+  // sends the response and lets go of the session and the database,
+  // the command is not touched any more by this request afterwards
+  void response(int status);
+
+  void response(int status, const boost::shared_ptr<std::string>& payload);
+
+  virtual void process_data() = 0;
+
+private:
+  db_command(const db_command&);
+  db_command& operator = (const db_command&);
+
+private:
+  boost::shared_ptr<db_session> _session;
+  boost::shared_ptr<leveldb::DB> _db;
+  std::vector<char> _buffer;
+  size_t _buf_size;
+  int _protocol;
+  int _request_id;
+};
+
+class db_session : public boost::enable_shared_from_this<db_session>{
+public:
+  typedef boost::shared_ptr<db_session> pointer;
+
+private:
+  db_session(boost::asio::io_service& io, bool use_strand, db_executor& executor, db_group_commit& group_commit)
+    : _executor(executor), _group_commit(group_commit), _io_service(io), _socket(io), _strand(use_strand ? new boost::asio::io_service::strand(io) : NULL), _current_db(), _cursors(MAX_SESSION_CURSORS), _command(), _commands(), _discard(), _data_size(0), _request_id(0),
+    _protocol(PROTOCOL_V1), _pending(0), _reading(false), _writing(0), _responses(), _write_buffers(){
+  }
+
+private:
+  void read_header();
+  void header_read(const boost::system::error_code& error, size_t bytes_transferred);
+  void data_read(const boost::system::error_code& error, size_t bytes_transferred);
+  void read_complete();
+  void send_status(int status);
+  void queue_response(const response_frame& frame);
+  void write_next();
+  void response_written(const boost::system::error_code& error, size_t bytes_transferred);
+
+  size_t header_size() const{
+    return _protocol == PROTOCOL_V2 ? HEADER_SIZE_V2 : HEADER_SIZE;
+  }
+
+  int max_pending() const{
+    return _protocol == PROTOCOL_V2 ? MAX_PIPELINED_REQUESTS : 1;
+  }
+
+  // hands out a pooled command once the request it served last has let go
+  // of it, or a new one
+  db_command::pointer acquire_command(int command);
+
+  // the handlers of the session run on its strand, if it has one
+  template<typename Handler>
+  void dispatch(Handler handler){
+    if(_strand){
+      _strand->dispatch(handler);
+    }else{
+      _io_service.dispatch(handler);
+    }
+  }
+
+  template<typename Handler>
+  void read_async(char* buffer, size_t size, Handler handler){
+    if(_strand){
+      boost::asio::async_read(_socket, boost::asio::buffer(buffer, size), _strand->wrap(handler));
+    }else{
+      boost::asio::async_read(_socket, boost::asio::buffer(buffer, size), handler);
+    }
+  }
+
+  template<typename Handler>
+  void write_async(Handler handler){
+    if(_strand){
+      boost::asio::async_write(_socket, _write_buffers, _strand->wrap(handler));
+    }else{
+      boost::asio::async_write(_socket, _write_buffers, handler);
+    }
+  }
+
+private:
+  static boost::shared_ptr<db_command> create_command(int command);
+
+public:
+  // a session on an io_service run by a single thread needs no strand
+  static pointer create(boost::asio::io_service& io, bool use_strand, db_executor& executor, db_group_commit& group_commit){
+    return pointer(new db_session(io, use_strand, executor, group_commit));
+  }
+
+public:
+  boost::shared_ptr<leveldb::DB> current_db(){
+    return _current_db;
+  }
+
+  tcp::socket& socket(){
+    return _socket;
+  }
+
+  db_executor& executor(){
+    return _executor;
+  }
+
+  db_group_commit& group_commit(){
+    return _group_commit;
+  }
+
+  db_cursor_table& cursors(){
+    return _cursors;
+  }
+
+  int protocol() const{
+    return _protocol;
+  }
+
+  void set_db(const boost::shared_ptr<leveldb::DB>& db){
+    _current_db = db;
+  }
+
+  void set_protocol(int protocol){
+    _protocol = protocol;
+  }
+
+  void start();
+
+  // queues a response frame, frames are written in the order they are sent
+  void send(const response_frame& frame);
+
+private:
+  db_executor& _executor;
+  db_group_commit& _group_commit;
+  boost::asio::io_service& _io_service;
+  tcp::socket _socket;
+  // serializes the session state between the reader, the writer and
+  // commands completing on other io threads, NULL if the io_service of the
+  // session is run by a single thread
+  boost::scoped_ptr<boost::asio::io_service::strand> _strand;
+  boost::shared_ptr<leveldb::DB> _current_db;
+  db_cursor_table _cursors;
+  db_command::pointer _command;
+  std::map<int, std::vector<db_command::pointer>> _commands;
+  // receives the data of unknown commands
+  std::vector<char> _discard;
+  int _data_size;
+  int _request_id;
+  int _protocol;
+  int _pending;
+  bool _reading;
+  // number of responses at the front of _responses being written
+  size_t _writing;
+  std::deque<response_frame> _responses;
+  std::vector<boost::asio::const_buffer> _write_buffers;
+  char _header[HEADER_SIZE_V2];
+};
+
+db_command::db_command()
+  : _session(), _db(), _buffer(), _buf_size(0), _protocol(PROTOCOL_V1), _request_id(0){
+}
+
+void db_command::prepare(const boost::shared_ptr<db_session>& session, int request_id){
+  _session = session;
+  _db = session->current_db();
+  _protocol = session->protocol();
+  _request_id = request_id;
+}
+
+char* db_command::receive_buffer(int data_size){
+  _buf_size = data_size;
+  if(_buffer.size() < _buf_size || _buffer.size() > MAX_POOLED_BUFFER_SIZE){
+    std::vector<char>(_buf_size).swap(_buffer);
+  }
+  return _buf_size > 0 ? &_buffer[0] : NULL;
+}
+
+void db_command::execute(){
+  this->process_data();
+}
+
+void db_command::reject(int status){
+  response(status);
+}
+
+void db_command::response(int status){
+  response(status, boost::shared_ptr<std::string>());
+}
+
+void db_command::response(int status, const boost::shared_ptr<std::string>& payload){
+  response_frame frame;
+  frame.header_size = encode_response_header(frame.header, _protocol, _request_id, status, payload ? (int)payload->size() : 0);
+  frame.payload = payload;
+  boost::shared_ptr<db_session> session;
+  session.swap(_session);
+  _db.reset();
+  session->send(frame);
+}
+
+void db_session::start() {
+  _reading = true;
+  dispatch(boost::bind(&db_session::read_header, shared_from_this()));
+}
+
+void db_session::read_header(){
+  read_async(_header, header_size(), boost::bind(&db_session::header_read, shared_from_this(),
+    boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void db_session::header_read(const boost::system::error_code& error, size_t /*bytes_transffered*/){
+  if(error){
+    // read header error, drop the connection
+    return;
+  }
+  const char* header = _header + 4;
+  _request_id = 0;
+  if(_protocol == PROTOCOL_V2){
+    _request_id = read_int(header);
+    header += 4;
+  }
+  _data_size = read_int(header);
+  _command = acquire_command(read_int(_header));
+  char* buffer = NULL;
+  if(_command){
+    buffer = _command->receive_buffer(_data_size > 0 ? _data_size : 0);
+  }else if(_data_size > 0){
+    if(_discard.size() < (size_t)_data_size){
+      _discard.resize(_data_size);
+    }
+    buffer = &_discard[0];
+  }
+  if(_data_size <= 0){
+    this->read_complete();
+    return;
+  }
+  read_async(buffer, _data_size, boost::bind(&db_session::data_read, shared_from_this(),
+    boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void db_session::data_read(const boost::system::error_code& error, size_t bytes_transferred){
+  if(!error){
+    this->read_complete();
+  }
+}
+
+void db_session::read_complete(){
+  ++_pending;
+  db_command::pointer db_cmd;
+  db_cmd.swap(_command);
+  if(db_cmd){
+    db_cmd->prepare(shared_from_this(), _request_id);
+    if(db_cmd->can_pipeline()){
+      // database calls may block, leave them to the db executor and go on
+      // reading the next request
+      if(!_executor.submit(db_cmd->database(), boost::bind(&db_command::execute, db_cmd))){
+        db_cmd->reject(RESULT_BUSY);
+      }
+    }else{
+      db_cmd->execute();
+    }
+  }else{
+    send_status(RESULT_BAD_COMMAND);
+  }
+
+  if(_pending < max_pending()){
+    read_header();
+  }else{
+    // too many requests in flight, resume reading once responses are written
+    _reading = false;
+  }
+}
+
+db_command::pointer db_session::acquire_command(int command){
+  std::map<int, std::vector<db_command::pointer>>::iterator pool = _commands.find(command);
+  if(pool != _commands.end()){
+    for(std::vector<db_command::pointer>::iterator item = pool->second.begin(); item != pool->second.end(); ++item){
+      if(item->unique()){
+        return *item;
+      }
+    }
+  }
+
+  db_command::pointer db_cmd = create_command(command);
+  if(db_cmd){
+    std::vector<db_command::pointer>& commands = _commands[command];
+    if(commands.size() < MAX_POOLED_COMMANDS){
+      commands.push_back(db_cmd);
+    }
+  }
+  return db_cmd;
+}
+
+void db_session::send_status(int status){
+  response_frame frame;
+  frame.header_size = encode_response_header(frame.header, _protocol, _request_id, status, 0);
+  send(frame);
+}
+
+void db_session::send(const response_frame& frame){
+  dispatch(boost::bind(&db_session::queue_response, shared_from_this(), frame));
+}
+
+void db_session::queue_response(const response_frame& frame){
+  _responses.push_back(frame);
+  if(_writing == 0){
+    write_next();
+  }
+}
+
+void db_session::write_next(){
+  // gather the headers and payloads of the queued responses into one write,
+  // push_back on the deque keeps the queued frames where they are
+  _write_buffers.clear();
+  std::deque<response_frame>::const_iterator frame = _responses.begin();
+  for(_writing = 0; frame != _responses.end() && _writing < MAX_GATHERED_RESPONSES; ++frame, ++_writing){
+    _write_buffers.push_back(boost::asio::buffer(frame->header, frame->header_size));
+    if(frame->payload && !frame->payload->empty()){
+      _write_buffers.push_back(boost::asio::buffer(frame->payload->data(), frame->payload->size()));
+    }
+  }
+  write_async(boost::bind(&db_session::response_written, shared_from_this(),
+    boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void db_session::response_written(const boost::system::error_code& error, size_t /*bytes_transferred*/){
+  if(error){
+    // io error drop the socket
+    boost::system::error_code ignored;
+    _socket.close(ignored);
+    _responses.clear();
+    _writing = 0;
+    return;
+  }
+  _responses.erase(_responses.begin(), _responses.begin() + _writing);
+  _pending -= (int)_writing;
+  _writing = 0;
+  if(!_reading && _pending < max_pending()){
+    _reading = true;
+    read_header();
+  }
+
+  if(!_responses.empty()){
+    write_next();
+  }
+}
+
+class login_command : public db_command{
+public:
+  login_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+
+void login_command::process_data(){
+  // for now, we don't have user database, just return OK to client
+  response(RESULT_OK);
+}
+
+class protocol_command : public db_command{
+public:
+  protocol_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+void protocol_command::process_data(){
+  if(buffer_size() < 4){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  int protocol = read_int(data());
+  if(protocol != PROTOCOL_V1 && protocol != PROTOCOL_V2){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  // the response still uses the frame format the request came in with,
+  // the next request is read with the new one
+  session()->set_protocol(protocol);
+  response(RESULT_OK);
+}
+
+class open_command : public db_command{
+public:
+  open_command(){
+  }
+
+protected:
+  virtual void process_data();
+
+private:
+  virtual int do_open(const std::string& db_name);
+};
+
+void open_command::process_data(){
+  if(buffer_size() < 4){
+    // error, invalid command data
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  const char* buf = data();
+  std::string db_name(buf, buf + buffer_size());
+  int status = do_open(db_name);
+  response(status);
+}
+
+int open_command::do_open(const std::string& db_name){
+  boost::shared_ptr<leveldb::DB> db = dbmgr.open_db(db_name);
+  if(db){
+    session()->set_db(db);
+    return RESULT_OK;
+  }
+  return RESULT_NO_DB;
+}
+
+class create_command : public open_command{
+public:
+  create_command(){
+  }
+
+private:
+  virtual int do_open(const std::string& db_name);
+};
+
+int create_command::do_open(const std::string& db_name){
+  if(dbmgr.create_db(db_name)){
+    return RESULT_OK;
+  }
+  return RESULT_CREAT_FAILED;
+}
+
+class tx_command : public db_command{
+public:
+  tx_command(){
+  }
+
+  virtual bool can_pipeline() const{
+    return true;
+  }
+
+protected:
+  virtual void process_data() = 0;
+
+  // completion of a write handed to the group commit
+  void written(const leveldb::Status& status);
+
+  db_group_commit::callback write_callback(){
+    return boost::bind(&tx_command::written, boost::static_pointer_cast<tx_command>(shared_from_this()), _1);
+  }
+};
+
+void tx_command::written(const leveldb::Status& status){
+  if(status.ok()){
+    response(RESULT_OK);
+    return;
+  }
+
+  if(status.IsNotFound()){
+    response(RESULT_NOT_FOUND);
+    return;
+  }
+
+  response(RESULT_DB_ERROR);
+}
+
+class put_command : public tx_command{
+public:
+  put_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+void put_command::process_data(){
+  if(!current_db()){
+    response(RESULT_NO_DB_SELECTED);
+    return;
+  }
+  int buf_size = buffer_size();
+  const char* buf = data();
+  if(buf_size < 8){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  int key_size = read_int(buf);
+  int value_size = read_int(buf + 4);
+  buf_size -= 8;
+  if(buf_size < key_size + value_size || key_size < 0 || value_size < 0){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  leveldb::Slice key(buf + 8, key_size);
+  leveldb::Slice value(buf + 8 + key_size, value_size);
+  session()->group_commit().put(current_db(), key, value, write_callback());
+}
+
+class delete_command : public tx_command{
+public:
+  delete_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+void delete_command::process_data(){
+  if(!current_db()){
+    response(RESULT_NO_DB_SELECTED);
+    return;
+  }
+
+  int buf_size = buffer_size();
+  const char* buf = data();
+  if(buf_size <= 0){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+
+  leveldb::Slice key(buf, buf_size);
+  session()->group_commit().remove(current_db(), key, write_callback());
+}
+
+class read_command : public tx_command{
+public:
+  read_command() : _value(){
+  }
+
+protected:
+  virtual void process_data();
+
+private:
+  // the value is read into the string the response is sent from, it is
+  // reused once the previous response has been written
+  boost::shared_ptr<std::string> _value;
+};
+
+void read_command::process_data(){
+  if(!current_db()){
+    response(RESULT_NO_DB_SELECTED);
+    return;
+  }
+  int buf_size = buffer_size();
+  const char* buf = data();
+  if(buf_size <= 0){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  leveldb::Slice key(buf, buf_size);
+  if(!_value || !_value.unique() || _value->capacity() > MAX_POOLED_BUFFER_SIZE){
+    _value = boost::make_shared<std::string>();
+  }
+  leveldb::Status status = current_db()->Get(leveldb::ReadOptions(), key, _value.get());
+
+  if(!status.ok()){
+    if(status.IsNotFound()){
+      response(RESULT_NOT_FOUND);
+    }else{
+      response(RESULT_DB_ERROR);
+    }
+    return;
+  }
+  response(RESULT_OK, _value);
+}
+
+class multi_read_command : public tx_command{
+public:
+  multi_read_command() : _keys(), _values(), _statuses(), _result(){
+  }
+
+protected:
+  virtual void process_data();
+
+private:
+  // kept along with the command so a pooled command reads without allocating
+  std::vector<leveldb::Slice> _keys;
+  std::vector<std::string> _values;
+  std::vector<leveldb::Status> _statuses;
+  boost::shared_ptr<std::string> _result;
+};
+
+void multi_read_command::process_data(){
+  if(!current_db()){
+    response(RESULT_NO_DB_SELECTED);
+    return;
+  }
+  int buf_size = buffer_size();
+  const char* buf = data();
+  if(buf_size < 8){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  int snapshot_id = read_int(buf);
+  int count = read_int(buf + 4);
+  buf += 8;
+  buf_size -= 8;
+  if(count <= 0 || count > MAX_MGET_KEYS){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  _keys.clear();
+  for(int i = 0; i < count; ++i){
+    int key_size = buf_size >= 4 ? read_int(buf) : -1;
+    if(key_size <= 0 || key_size > buf_size - 4){
+      response(RESULT_DATA_ERROR);
+      return;
+    }
+    _keys.push_back(leveldb::Slice(buf + 4, key_size));
+    buf += 4 + key_size;
+    buf_size -= 4 + key_size;
+  }
+
+  leveldb::ReadOptions options;
+  boost::shared_ptr<db_snapshot> snapshot;
+  if(snapshot_id != 0){
+    snapshot = session()->cursors().snapshot(snapshot_id);
+    if(!snapshot || snapshot->db() != current_db()){
+      response(RESULT_NOT_FOUND);
+      return;
+    }
+    options.snapshot = snapshot->snapshot();
+  }
+  if(_values.size() < (size_t)count){
+    _values.resize(count);
+    _statuses.resize(count);
+  }
+  current_db()->MultiGet(options, count, &_keys[0], &_values[0], &_statuses[0]);
+
+  if(!_result || !_result.unique() || _result->capacity() > MAX_POOLED_BUFFER_SIZE){
+    _result = boost::make_shared<std::string>();
+  }
+  _result->assign(4, '\0');
+  encode_int(&(*_result)[0], count);
+  char entry[8];
+  for(int i = 0; i < count; ++i){
+    int status = RESULT_OK;
+    if(_statuses[i].IsNotFound()){
+      status = RESULT_NOT_FOUND;
+    }else if(!_statuses[i].ok()){
+      status = RESULT_DB_ERROR;
+    }
+    const std::string& value = _values[i];
+    encode_int(entry, status);
+    encode_int(entry + 4, status == RESULT_OK ? (int)value.size() : 0);
+    _result->append(entry, 8);
+    if(status == RESULT_OK){
+      _result->append(value);
+    }
+    if(value.capacity() > MAX_POOLED_BUFFER_SIZE){
+      std::string().swap(_values[i]);
+    }
+  }
+  response(RESULT_OK, _result);
+}
+
+class batch_command : public tx_command{
+public:
+  batch_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+void batch_command::process_data(){
+  if(!current_db()){
+    response(RESULT_NO_DB_SELECTED);
+    return;
+  }
+  int buf_size = buffer_size();
+  const char* buf = data();
+  if(buf_size <= 0){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  int items_count = read_int(buf);
+  buf += 4;
+  buf_size -= 4;
+  if(items_count <= 0){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  leveldb::WriteBatch batch;
+  leveldb::Slice key;
+  leveldb::Slice value;
+  int key_size(0), value_size(0);
+  while(items_count > 0){
+    int command = read_int(buf);
+    buf += 4;
+    buf_size -= 4;
+    switch(command){
+    case COMMAND_PUT:
+      key_size = read_int(buf);
+      buf += 4;
+      buf_size -= 4;
+      value_size = read_int(buf);
+      buf += 4;
+      buf_size -= 4;
+      if(key_size + value_size > buf_size || key_size <= 0 || value_size <= 0){
+        response(RESULT_DATA_ERROR);
+        return;
+      }
+      key = leveldb::Slice(buf, key_size);
+      buf += key_size;
+      buf_size -= key_size;
+      value = leveldb::Slice(buf, value_size);
+      buf += value_size;
+      buf_size -= value_size;
+      batch.Put(key, value);
+      break;
+    case COMMAND_DELETE:
+      key_size = read_int(buf);
+      buf += 4;
+      buf_size -= 4;
+      if(key_size <= 0 || buf_size < key_size){
+        response(RESULT_DATA_ERROR);
+        return;
+      }
+      key = leveldb::Slice(buf, key_size);
+      batch.Delete(key);
+      break;
+    default:
+      response(RESULT_BAD_COMMAND);
+      return;
+    }
+    --items_count;
+  }//end while
+  session()->group_commit().write(current_db(), &batch, write_callback());
+}
+
+class close_command : public db_command{
+public:
+  close_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+void close_command::process_data(){
+  session()->set_db(boost::shared_ptr<leveldb::DB>(NULL));
+  response(RESULT_OK);
+  return;
+}
+
+class list_command : public db_command{
+public:
+  list_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+void list_command::process_data(){
+  response(RESULT_OK);
+}
+
+class stats_command : public db_command{
+public:
+  stats_command(){
+  }
+
+protected:
+  virtual void process_data();
+};
+
+void stats_command::process_data(){
+  db_executor_stats stats = session()->executor().stats();
+  std::ostringstream text;
+  text << "db.threads: " << stats.threads << "\n"
+    << "db.active_threads: " << stats.active_threads << "\n"
+    << "db.databases: " << stats.databases << "\n"
+    << "db.queue_depth: " << stats.queue_depth << "\n"
+    << "db.max_queue_depth: " << stats.max_queue_depth << "\n"
+    << "db.completed: " << stats.completed << "\n"
+    << "db.rejected: " << stats.rejected << "\n"
+    << "db.avg_wait_micros: " << (stats.completed > 0 ? stats.total_wait_micros / stats.completed : 0) << "\n"
+    << "db.max_wait_micros: " << stats.max_wait_micros << "\n";
+  response(RESULT_OK, boost::make_shared<std::string>(text.str()));
+}
+
+class cursor_command : public tx_command{
+protected:
+  // reads the next chunk of the cursor and answers with it, the cursor is
+  // closed once its range is done
+  void send_chunk(int cursor_id, const boost::shared_ptr<db_cursor>& cursor);
+};
+
+void cursor_command::send_chunk(int cursor_id, const boost::shared_ptr<db_cursor>& cursor){
+  boost::shared_ptr<std::string> chunk(new std::string(8, '\0'));
+  int count = 0;
+  bool more = false;
+  leveldb::Status status;
+  {
+    boost::mutex::scoped_lock lock(cursor->mutex());
+    more = cursor->next_chunk(chunk.get(), SCAN_CHUNK_BYTES, &count);
+    status = cursor->status();
+  }
+  if(!status.ok() || !more){
+    session()->cursors().remove_cursor(cursor_id);
+    cursor_id = 0;
+  }
+  if(!status.ok()){
+    response(RESULT_DB_ERROR);
+    return;
+  }
+  encode_int(&(*chunk)[0], cursor_id);
+  encode_int(&(*chunk)[4], count);
+  response(RESULT_OK, chunk);
+}
+
+class scan_command : public cursor_command{
+protected:
+  virtual void process_data();
+};
+
+void scan_command::process_data(){
+  if(!current_db()){
+    response(RESULT_NO_DB_SELECTED);
+    return;
+  }
+  int buf_size = buffer_size();
+  const char* buf = data();
+  if(buf_size < 20){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  int flags = read_int(buf);
+  int limit = read_int(buf + 4);
+  int snapshot_id = read_int(buf + 8);
+  int start_size = read_int(buf + 12);
+  buf += 16;
+  buf_size -= 16;
+  if(start_size < 0 || start_size > buf_size - 4){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  leveldb::Slice start(buf, start_size);
+  buf += start_size;
+  buf_size -= start_size;
+  int end_size = read_int(buf);
+  buf += 4;
+  buf_size -= 4;
+  if(end_size < 0 || end_size > buf_size){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  leveldb::Slice end(buf, end_size);
+
+  boost::shared_ptr<db_snapshot> snapshot;
+  if(snapshot_id != 0){
+    snapshot = session()->cursors().snapshot(snapshot_id);
+    if(!snapshot || snapshot->db() != current_db()){
+      response(RESULT_NOT_FOUND);
+      return;
+    }
+  }
+  boost::shared_ptr<db_cursor> cursor(new db_cursor(current_db(), snapshot, start, end, (flags & SCAN_REVERSE) != 0, (flags & SCAN_PREFIX) != 0, limit));
+  int cursor_id = session()->cursors().add_cursor(cursor);
+  if(cursor_id == 0){
+    response(RESULT_BUSY);
+    return;
+  }
+  send_chunk(cursor_id, cursor);
+}
+
+class scan_next_command : public cursor_command{
+protected:
+  virtual void process_data();
+};
+
+void scan_next_command::process_data(){
+  if(buffer_size() < 4){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  int cursor_id = read_int(data());
+  boost::shared_ptr<db_cursor> cursor(session()->cursors().cursor(cursor_id));
+  if(!cursor){
+    response(RESULT_NOT_FOUND);
+    return;
+  }
+  send_chunk(cursor_id, cursor);
+}
+
+class scan_close_command : public tx_command{
+protected:
+  virtual void process_data();
+};
+
+void scan_close_command::process_data(){
+  if(buffer_size() < 4){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  response(session()->cursors().remove_cursor(read_int(data())) ? RESULT_OK : RESULT_NOT_FOUND);
+}
+
+class snapshot_command : public tx_command{
+protected:
+  virtual void process_data();
+};
+
+void snapshot_command::process_data(){
+  if(!current_db()){
+    response(RESULT_NO_DB_SELECTED);
+    return;
+  }
+  int snapshot_id = session()->cursors().add_snapshot(boost::make_shared<db_snapshot>(current_db()));
+  if(snapshot_id == 0){
+    response(RESULT_BUSY);
+    return;
+  }
+  boost::shared_ptr<std::string> result(new std::string(4, '\0'));
+  encode_int(&(*result)[0], snapshot_id);
+  response(RESULT_OK, result);
+}
+
+class release_snapshot_command : public tx_command{
+protected:
+  virtual void process_data();
+};
+
+void release_snapshot_command::process_data(){
+  if(buffer_size() < 4){
+    response(RESULT_DATA_ERROR);
+    return;
+  }
+  response(session()->cursors().remove_snapshot(read_int(data())) ? RESULT_OK : RESULT_NOT_FOUND);
+}
+
+boost::shared_ptr<db_command> db_session::create_command(int command) {
+  switch (command)
+  {
+  case COMMAND_BATCH:
+    return boost::shared_ptr<db_command>(new batch_command());
+  case COMMAND_CLOSE:
+    return boost::shared_ptr<db_command>(new close_command());
+  case COMMAND_CREATE:
+    return boost::shared_ptr<db_command>(new ::create_command());
+  case COMMAND_GET:
+    return boost::shared_ptr<db_command>(new read_command());
+  case COMMAND_LIST:
+    return boost::shared_ptr<db_command>(new list_command());
+  case COMMAND_LOGIN:
+    return boost::shared_ptr<db_command>(new login_command());
+  case COMMAND_OPEN:
+    return boost::shared_ptr<db_command>(new open_command());
+  case COMMAND_PUT:
+    return boost::shared_ptr<db_command>(new put_command());
+  case COMMAND_DELETE:
+    return boost::shared_ptr<db_command>(new delete_command());
+  case COMMAND_PROTOCOL:
+    return boost::shared_ptr<db_command>(new protocol_command());
+  case COMMAND_STATS:
+    return boost::shared_ptr<db_command>(new stats_command());
+  case COMMAND_SCAN:
+    return boost::shared_ptr<db_command>(new scan_command());
+  case COMMAND_SCAN_NEXT:
+    return boost::shared_ptr<db_command>(new scan_next_command());
+  case COMMAND_SCAN_CLOSE:
+    return boost::shared_ptr<db_command>(new scan_close_command());
+  case COMMAND_SNAPSHOT:
+    return boost::shared_ptr<db_command>(new snapshot_command());
+  case COMMAND_RELEASE_SNAPSHOT:
+    return boost::shared_ptr<db_command>(new release_snapshot_command());
+  case COMMAND_MGET:
+    return boost::shared_ptr<db_command>(new multi_read_command());
+  default:
+    return boost::shared_ptr<db_command>();
+    break;
+  }
+}
+
+// Parses an endpoint given as "address:port", "[ipv6 address]:port" or
+// just "port" for all IPv4 addresses.
+bool parse_endpoint(const std::string& text, tcp::endpoint* endpoint){
+  std::string address("0.0.0.0");
+  std::string port(text);
+  std::string::size_type colon = text.rfind(':');
+  if(colon != std::string::npos){
+    address = text.substr(0, colon);
+    port = text.substr(colon + 1);
+    if(address.size() >= 2 && address[0] == '[' && address[address.size() - 1] == ']'){
+      address = address.substr(1, address.size() - 2);
+    }
+  }
+  int port_number = atoi(port.c_str());
+  if(port_number <= 0 || port_number > 65535){
+    return false;
+  }
+  boost::system::error_code error;
+  boost::asio::ip::address ip = boost::asio::ip::address::from_string(address, error);
+  if(error){
+    return false;
+  }
+  *endpoint = tcp::endpoint(ip, (unsigned short)port_number);
+  return true;
+}
+
+// Pins the calling thread to the given processor, where the platform allows.
+void pin_thread(unsigned int processor){
+#if defined(_WIN32)
+  SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << (processor % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(processor % CPU_SETSIZE, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+// Accepts the connections to one endpoint. The sessions are created on the
+// given io_services in turn, with their own strand if an io_service is run
+// by more than one thread.
+class db_tcp_server {
+public:
+  db_tcp_server(boost::asio::io_service& io, const tcp::endpoint& endpoint, bool reuse_port,
+    const std::vector<boost::asio::io_service*>& session_io, bool session_strands, db_executor& executor, db_group_commit& group_commit)
+    : _acceptor(io), _session_io(session_io), _next_io(0), _session_strands(session_strands), _executor(executor), _group_commit(group_commit){
+    _acceptor.open(endpoint.protocol());
+    _acceptor.set_option(tcp::acceptor::reuse_address(true));
+    if(endpoint.address().is_v6()){
+      // so [::] and 0.0.0.0 may be listened on side by side
+      _acceptor.set_option(boost::asio::ip::v6_only(true));
+    }
+#ifdef SO_REUSEPORT
+    if(reuse_port){
+      _acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    }
+#endif
+    _acceptor.bind(endpoint);
+    _acceptor.listen();
+  }
+
+public:
+
+  void stop(){
+    boost::system::error_code error;
+    _acceptor.close(error);
+  }
+
+  void start(){
+    // only one accept is outstanding at a time, so _next_io needs no lock
+    boost::asio::io_service& io = *_session_io[_next_io];
+    _next_io = (_next_io + 1) % _session_io.size();
+    db_session::pointer session = db_session::create(io, _session_strands, _executor, _group_commit);
+    _acceptor.async_accept(session->socket(), [this, session](const boost::system::error_code& error){
+      if(!error){
+        session->start();
+      }
+      if(error != boost::asio::error::operation_aborted){
+        start();
+      }
+    });
+  }
+private:
+  tcp::acceptor _acceptor;
+  std::vector<boost::asio::io_service*> _session_io;
+  size_t _next_io;
+  bool _session_strands;
+  db_executor& _executor;
+  db_group_commit& _group_commit;
+};
+
+// io threads
+//   io_contexts = 0   one io_service run by one thread per processor, the
+//                     handlers of a session run on its strand
+//   io_contexts = N   N io_services each run by its own thread, pinned to a
+//                     processor with pin_io_threads; a session stays on the
+//                     thread of its io_service and needs no strand
+// With N io_services and reuse_port, each io_service accepts on its own
+// SO_REUSEPORT socket per endpoint and the kernel spreads the connections,
+// otherwise the first io_service accepts and hands the connections out in
+// turn. The endpoints are the "listen" entries of leveldb.xml.
+class db_service_impl{
+public:
+  db_service_impl() : _io_services(), _io_work(), _executor(), _group_commit(), _tcp_servers(), _worker_threads(){
+  }
+
+public:
+  void start(){
+    using boost::property_tree::ptree;
+    unsigned int processors = boost::thread::hardware_concurrency();
+    if(processors == 0){
+      processors = 1;
+    }
+    ptree settings_tree;
+    try{
+      boost::property_tree::read_xml(get_executable_dir() + "leveldb.xml", settings_tree);
+    }catch(...){
+    }
+    start_db_workers(settings_tree, processors);
+    start_io(settings_tree, processors);
+  }
+
+  void stop(){
+    std::for_each(_tcp_servers.begin(), _tcp_servers.end(), [](boost::shared_ptr<db_tcp_server>& server){
+      server->stop();
+    });
+    _io_work.clear();
+    std::for_each(_io_services.begin(), _io_services.end(), [](boost::shared_ptr<boost::asio::io_service>& io){
+      io->stop();
+    });
+    std::for_each(_worker_threads.begin(), _worker_threads.end(), [](boost::shared_ptr<boost::thread>& thread){
+      thread->join();
+    });
+    _worker_threads.clear();
+    _tcp_servers.clear();
+    // the next start creates its own io_services, the stopped ones would
+    // return from run() at once
+    _io_services.clear();
+    if(_executor){
+      _executor->stop();
+    }
+  }
+
+private:
+  void start_db_workers(const boost::property_tree::ptree& settings_tree, size_t processors){
+    // database calls spend much of their time blocked on disk, so by default
+    // run twice as many db threads as io threads
+    int db_threads = (int)processors * 2;
+    int db_queue_size = DEFAULT_DB_QUEUE_SIZE;
+    // by default one database gets at most half of the db threads
+    int db_threads_per_db = 0;
+    // by default only writes queued up behind a running commit are grouped
+    int commit_window_micros = 0;
+    int commit_max_bytes = DEFAULT_COMMIT_MAX_BYTES;
+    bool sync_writes = false;
+    try{
+      db_threads = settings_tree.get<int>("leveldb.db_threads", db_threads);
+      db_queue_size = settings_tree.get<int>("leveldb.db_queue_size", db_queue_size);
+      db_threads_per_db = settings_tree.get<int>("leveldb.db_threads_per_db", db_threads_per_db);
+      commit_window_micros = settings_tree.get<int>("leveldb.commit_window_micros", commit_window_micros);
+      commit_max_bytes = settings_tree.get<int>("leveldb.commit_max_bytes", commit_max_bytes);
+      sync_writes = settings_tree.get<bool>("leveldb.sync_writes", sync_writes);
+    }catch(...){
+    }
+    if(_executor){
+      _executor->stop();
+    }
+    _executor.reset(new db_executor(db_threads > 0 ? db_threads : 1, db_queue_size > 0 ? db_queue_size : DEFAULT_DB_QUEUE_SIZE,
+      db_threads_per_db > 0 ? db_threads_per_db : 0));
+    _executor->start();
+    _group_commit.reset(new db_group_commit(commit_window_micros > 0 ? commit_window_micros : 0,
+      commit_max_bytes > 0 ? commit_max_bytes : DEFAULT_COMMIT_MAX_BYTES, sync_writes));
+  }
+
+  void start_io(const boost::property_tree::ptree& settings_tree, unsigned int processors){
+    using boost::property_tree::ptree;
+    int io_contexts = 0;
+    bool pin_io_threads = true;
+    bool reuse_port = true;
+    std::vector<tcp::endpoint> endpoints;
+    try{
+      io_contexts = settings_tree.get<int>("leveldb.io_contexts", io_contexts);
+      pin_io_threads = settings_tree.get<bool>("leveldb.pin_io_threads", pin_io_threads);
+      reuse_port = settings_tree.get<bool>("leveldb.reuse_port", reuse_port);
+      boost::optional<const ptree&> settings = settings_tree.get_child_optional("leveldb");
+      if(settings){
+        for(ptree::const_iterator item = settings->begin(); item != settings->end(); ++item){
+          tcp::endpoint endpoint;
+          if(item->first != "listen"){
+            continue;
+          }
+          if(parse_endpoint(item->second.get_value<std::string>(), &endpoint)){
+            endpoints.push_back(endpoint);
+          }else{
+            std::cerr << "ignoring the bad listen endpoint " << item->second.get_value<std::string>() << std::endl;
+          }
+        }
+      }
+    }catch(...){
+    }
+    if(endpoints.empty()){
+      endpoints.push_back(tcp::endpoint(tcp::v4(), DEFAULT_PORT));
+    }
+#ifndef SO_REUSEPORT
+    reuse_port = false;
+#endif
+
+    bool per_core = io_contexts > 0;
+    size_t contexts = per_core ? (size_t)io_contexts : 1;
+    std::vector<boost::asio::io_service*> session_io;
+    for(size_t i = 0; i < contexts; ++i){
+      boost::shared_ptr<boost::asio::io_service> io(new boost::asio::io_service(per_core ? 1 : (int)processors));
+      _io_services.push_back(io);
+      _io_work.push_back(boost::make_shared<boost::asio::io_service::work>(*io));
+      session_io.push_back(io.get());
+    }
+
+    std::for_each(endpoints.begin(), endpoints.end(), [&](const tcp::endpoint& endpoint){
+      if(per_core && reuse_port){
+        for(size_t i = 0; i < contexts; ++i){
+          std::vector<boost::asio::io_service*> own_io(1, session_io[i]);
+          _tcp_servers.push_back(boost::make_shared<db_tcp_server>(boost::ref(*session_io[i]), endpoint, true, own_io, false,
+            boost::ref(*_executor), boost::ref(*_group_commit)));
+        }
+      }else{
+        _tcp_servers.push_back(boost::make_shared<db_tcp_server>(boost::ref(*session_io[0]), endpoint, false, session_io, !per_core,
+          boost::ref(*_executor), boost::ref(*_group_commit)));
+      }
+    });
+    std::for_each(_tcp_servers.begin(), _tcp_servers.end(), [](boost::shared_ptr<db_tcp_server>& server){
+      server->start();
+    });
+
+    //start io threads
+    if(per_core){
+      for(size_t i = 0; i < contexts; ++i){
+        _worker_threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(
+          boost::bind(&db_service_impl::run_io, _io_services[i], pin_io_threads, (unsigned int)(i % processors)))));
+      }
+    }else{
+      for(unsigned int counter = 0; counter < processors; ++ counter){
+        _worker_threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(
+          boost::bind(&db_service_impl::run_io, _io_services[0], false, counter))));
+      }
+    }
+  }
+
+  static void run_io(const boost::shared_ptr<boost::asio::io_service>& io, bool pin, unsigned int processor){
+    if(pin){
+      pin_thread(processor);
+    }
+    io->run();
+  }
+
+private:
+  std::vector<boost::shared_ptr<boost::asio::io_service>> _io_services;
+  std::vector<boost::shared_ptr<boost::asio::io_service::work>> _io_work;
+  boost::shared_ptr<db_executor> _executor;
+  boost::shared_ptr<db_group_commit> _group_commit;
+  std::vector<boost::shared_ptr<db_tcp_server>> _tcp_servers;
+  std::vector<boost::shared_ptr<boost::thread>> _worker_threads;
+};
+
+db_service::db_service() : _impl(new db_service_impl)
+{
+}
+
+db_service::~db_service()
+{
+}
+
+bool db_service::start()
+{
+  _impl->start();
+  return true;
+}
+
+void db_service::stop()
+{
+  _impl->stop();
+}
\ No newline at end of file
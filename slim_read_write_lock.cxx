@@ -1,40 +1,87 @@
-#include "slim_read_write_lock.h"
-#include "win32_helper.h"
-#include <algorithm>
-
-slim_read_write_lock::slim_read_write_lock() {
-    InitializeSRWLock(& this->_lock);
-}
-
-slim_read_write_lock::~slim_read_write_lock() {
-}
-
-void slim_read_write_lock::acquire_read_lock() throw() {
-    AcquireSRWLockShared(&this->_lock);
-}
-
-void slim_read_write_lock::release_read_lock() throw() {
-    ReleaseSRWLockShared(&this->_lock);
-}
-
-void slim_read_write_lock::acquire_write_lock() throw() {
-    AcquireSRWLockExclusive(&this->_lock);
-}
-
-void slim_read_write_lock::release_write_lock() throw() {
-    ReleaseSRWLockExclusive(&this->_lock);
-}
-
-std::string get_executable_dir(){
-    char path[MAX_PATH];
-
-    if(! GetModuleFileNameA(NULL, path, MAX_PATH)){
-        return std::string("c:\\");
-    }
-    std::string exe_path(path);
-    std::string::const_reverse_iterator last_slash_pos = std::find(exe_path.rbegin(), exe_path.rend(), '\\');
-    if(last_slash_pos == exe_path.rend()){
-        return std::string("c:\\");
-    }
-    return std::string(exe_path.begin(), std::string::const_iterator(last_slash_pos.base()));
-}
\ No newline at end of file
+#include "slim_read_write_lock.h"
+#include "win32_helper.h"
+#ifndef _WIN32
+#include <limits.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+slim_read_write_lock::slim_read_write_lock() {
+    InitializeSRWLock(& this->_lock);
+}
+
+slim_read_write_lock::~slim_read_write_lock() {
+}
+
+void slim_read_write_lock::acquire_read_lock() throw() {
+    AcquireSRWLockShared(&this->_lock);
+}
+
+void slim_read_write_lock::release_read_lock() throw() {
+    ReleaseSRWLockShared(&this->_lock);
+}
+
+void slim_read_write_lock::acquire_write_lock() throw() {
+    AcquireSRWLockExclusive(&this->_lock);
+}
+
+void slim_read_write_lock::release_write_lock() throw() {
+    ReleaseSRWLockExclusive(&this->_lock);
+}
+
+std::string get_executable_dir(){
+    char path[MAX_PATH];
+
+    if(! GetModuleFileNameA(NULL, path, MAX_PATH)){
+        return std::string("c:\\");
+    }
+    std::string exe_path(path);
+    std::string::size_type last_slash_pos = exe_path.rfind('\\');
+    if(last_slash_pos == std::string::npos){
+        return std::string("c:\\");
+    }
+    return exe_path.substr(0, last_slash_pos + 1);
+}
+
+#else
+
+slim_read_write_lock::slim_read_write_lock() {
+    pthread_rwlock_init(&this->_lock, NULL);
+}
+
+slim_read_write_lock::~slim_read_write_lock() {
+    pthread_rwlock_destroy(&this->_lock);
+}
+
+void slim_read_write_lock::acquire_read_lock() throw() {
+    pthread_rwlock_rdlock(&this->_lock);
+}
+
+void slim_read_write_lock::release_read_lock() throw() {
+    pthread_rwlock_unlock(&this->_lock);
+}
+
+void slim_read_write_lock::acquire_write_lock() throw() {
+    pthread_rwlock_wrlock(&this->_lock);
+}
+
+void slim_read_write_lock::release_write_lock() throw() {
+    pthread_rwlock_unlock(&this->_lock);
+}
+
+std::string get_executable_dir(){
+    char path[PATH_MAX];
+    ssize_t size = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if(size <= 0){
+        return std::string("./");
+    }
+    std::string exe_path(path, size);
+    std::string::size_type last_slash_pos = exe_path.rfind('/');
+    if(last_slash_pos == std::string::npos){
+        return std::string("./");
+    }
+    return exe_path.substr(0, last_slash_pos + 1);
+}
+
+#endif
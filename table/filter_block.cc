@@ -4,7 +4,9 @@
 
 #include "table/filter_block.h"
 
+#include <string.h>
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -15,8 +17,32 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {
+void AppendPrefixFilterEntry(std::string* dst, const Slice& prefix) {
+  dst->append(prefix.data(), prefix.size());
+  dst->append(8, '\xff');
+}
+
+// Adds the entry for the prefix of "key" to the flattened keys, unless
+// it is the same as the last prefix added
+static void AddPrefix(const SliceTransform* prefix_extractor,
+                      const Slice& key, std::string* last_prefix,
+                      std::string* keys, std::vector<size_t>* start) {
+  if (prefix_extractor == NULL || !prefix_extractor->InDomain(key)) {
+    return;
+  }
+  Slice prefix = prefix_extractor->Transform(key);
+  if (!last_prefix->empty() && prefix == Slice(*last_prefix)) {
+    return;
+  }
+  last_prefix->assign(prefix.data(), prefix.size());
+  start->push_back(keys->size());
+  AppendPrefixFilterEntry(keys, prefix);
+}
+
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
+                                       const SliceTransform* prefix_extractor)
+    : policy_(policy),
+      prefix_extractor_(prefix_extractor) {
 }
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
@@ -31,6 +57,7 @@ void FilterBlockBuilder::AddKey(const Slice& key) {
   Slice k = key;
   start_.push_back(keys_.size());
   keys_.append(k.data(), k.size());
+  AddPrefix(prefix_extractor_, k, &last_prefix_, &keys_, &start_);
 }
 
 Slice FilterBlockBuilder::Finish() {
@@ -73,16 +100,70 @@ void FilterBlockBuilder::GenerateFilter() {
   tmp_keys_.clear();
   keys_.clear();
   start_.clear();
+  last_prefix_.clear();
+}
+
+FullFilterBuilder::FullFilterBuilder(const FilterPolicy* policy,
+                                     const SliceTransform* prefix_extractor)
+    : policy_(policy),
+      prefix_extractor_(prefix_extractor) {
+}
+
+void FullFilterBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+  AddPrefix(prefix_extractor_, key, &last_prefix_, &keys_, &start_);
 }
 
+Slice FullFilterBuilder::Finish() {
+  result_.clear();
+  const size_t num_keys = start_.size();
+  if (num_keys == 0) {
+    // An empty filter does not match any keys
+    return Slice(result_);
+  }
+
+  // Make list of keys from flattened key structure
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i+1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+  policy_->CreateFilter(&tmp_keys_[0], num_keys, &result_);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+  last_prefix_.clear();
+  return Slice(result_);
+}
+
+// Filter probes are cheapest when the filter starts on a cache line
+static const size_t kCacheLineSize = 64;
+
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
-                                     const Slice& contents)
+                                     const Slice& contents,
+                                     bool whole_table)
     : policy_(policy),
       data_(NULL),
       offset_(NULL),
       num_(0),
-      base_lg_(0) {
+      base_lg_(0),
+      whole_table_(whole_table) {
   size_t n = contents.size();
+  if (whole_table_) {
+    aligned_.resize(n + kCacheLineSize - 1);
+    char* start = &aligned_[0];
+    start += (kCacheLineSize -
+              reinterpret_cast<uintptr_t>(start) % kCacheLineSize) %
+             kCacheLineSize;
+    memcpy(start, contents.data(), n);
+    data_ = start;
+    filter_ = Slice(data_, n);
+    return;
+  }
   if (n < 5) return;  // 1 byte for base_lg_ and 4 for start of offset array
   base_lg_ = contents[n-1];
   uint32_t last_word = DecodeFixed32(contents.data() + n - 5);
@@ -93,6 +174,10 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
 }
 
 bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  if (whole_table_) {
+    // Empty filters do not match any keys
+    return !filter_.empty() && policy_->KeyMayMatch(key, filter_);
+  }
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index*4);
@@ -19,6 +19,14 @@
 namespace leveldb {
 
 class FilterPolicy;
+class SliceTransform;
+
+// With a prefix extractor, the filters also hold an entry for the
+// prefix of each key: the prefix followed by eight bytes of 0xff.  The
+// suffix keeps prefix entries apart from whole keys, and a filter
+// policy that strips the 8-byte trailer of internal keys sees the bare
+// prefix.  Appends the entry for "prefix" to *dst.
+extern void AppendPrefixFilterEntry(std::string* dst, const Slice& prefix);
 
 // A FilterBlockBuilder is used to construct all of the filters for a
 // particular Table.  It generates a single string which is stored as
@@ -28,7 +36,10 @@ class FilterPolicy;
 //      (StartBlock AddKey*)* Finish
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  // If prefix_extractor is non-NULL, the prefixes of the keys in its
+  // domain are added to the filters too (see AppendPrefixFilterEntry).
+  explicit FilterBlockBuilder(const FilterPolicy*,
+                              const SliceTransform* prefix_extractor = NULL);
 
   void StartBlock(uint64_t block_offset);
   void AddKey(const Slice& key);
@@ -38,8 +49,10 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const SliceTransform* prefix_extractor_;
   std::string keys_;              // Flattened key contents
   std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::string last_prefix_;       // Last prefix added to the current filter
   std::string result_;            // Filter data computed so far
   std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
   std::vector<uint32_t> filter_offsets_;
@@ -49,18 +62,67 @@ class FilterBlockBuilder {
   void operator=(const FilterBlockBuilder&);
 };
 
+// A FullFilterBuilder builds a single filter over all the keys added
+// to it.  The filter block of a table written with
+// Options::whole_table_filter is built this way, and so are the filter
+// partitions of a table with a partitioned index (see
+// Options::partition_index_and_filters), one per index partition.
+//
+// The sequence of calls to FullFilterBuilder must match the regexp:
+//      (AddKey* Finish)*
+class FullFilterBuilder {
+ public:
+  explicit FullFilterBuilder(const FilterPolicy*,
+                             const SliceTransform* prefix_extractor = NULL);
+
+  void AddKey(const Slice& key);
+
+  // Returns the filter over the keys added since the previous Finish().
+  // The result stays valid until the next call to AddKey().
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  const SliceTransform* prefix_extractor_;
+  std::string keys_;              // Flattened key contents
+  std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::string last_prefix_;       // Last prefix added to the filter
+  std::string result_;            // Last filter built
+  std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
+
+  // No copying allowed
+  FullFilterBuilder(const FullFilterBuilder&);
+  void operator=(const FullFilterBuilder&);
+};
+
 class FilterBlockReader {
  public:
  // REQUIRES: "contents" and *policy must stay live while *this is live.
-  FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  // If whole_table, "contents" is a single filter built by
+  // FullFilterBuilder; the reader then keeps a copy of it that starts on
+  // a cache line boundary, and "contents" need not stay live.
+  FilterBlockReader(const FilterPolicy* policy, const Slice& contents,
+                    bool whole_table = false);
+
+  // A whole table filter does not depend on block_offset.
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  bool whole_table() const { return whole_table_; }
+
  private:
   const FilterPolicy* policy_;
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
   size_t num_;          // Number of entries in offset array
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
+
+  const bool whole_table_;
+  std::string aligned_;  // Backs data_ if whole_table_
+  Slice filter_;         // The whole table filter
+
+  // No copying allowed
+  FilterBlockReader(const FilterBlockReader&);
+  void operator=(const FilterBlockReader&);
 };
 
 }
@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -121,6 +122,64 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, WholeTable) {
+  FullFilterBuilder builder(&policy_);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  builder.AddKey("box");
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+
+  // The reader keeps its own copy, starting on a cache line
+  std::string contents = block.ToString();
+  FilterBlockReader reader(&policy_, contents, true);
+  contents.assign(contents.size(), '\0');
+  ASSERT_TRUE(reader.whole_table());
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(100000, "bar"));
+  ASSERT_TRUE(reader.KeyMayMatch(3100, "box"));
+  ASSERT_TRUE(reader.KeyMayMatch(9000, "hello"));
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "missing"));
+  ASSERT_TRUE(! reader.KeyMayMatch(100000, "other"));
+
+  // An empty filter does not match any keys
+  FilterBlockReader empty(&policy_, builder.Finish(), true);
+  ASSERT_TRUE(! empty.KeyMayMatch(0, "foo"));
+}
+
+TEST(FilterBlockTest, PrefixEntries) {
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(3);
+  std::string foo_prefix, box_prefix;
+  AppendPrefixFilterEntry(&foo_prefix, "foo");
+  AppendPrefixFilterEntry(&box_prefix, "box");
+
+  FilterBlockBuilder builder(&policy_, prefix_extractor);
+  builder.StartBlock(100);
+  builder.AddKey("foo1");
+  builder.AddKey("foo2");
+  builder.AddKey("x");  // Outside the domain of the extractor
+  builder.StartBlock(3100);
+  builder.AddKey("box1");
+  Slice block = builder.Finish();
+  FilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(reader.KeyMayMatch(100, "foo1"));
+  ASSERT_TRUE(reader.KeyMayMatch(100, "x"));
+  ASSERT_TRUE(reader.KeyMayMatch(100, foo_prefix));
+  ASSERT_TRUE(! reader.KeyMayMatch(100, box_prefix));
+  ASSERT_TRUE(! reader.KeyMayMatch(100, "foo"));  // Not a whole key
+  ASSERT_TRUE(reader.KeyMayMatch(3100, box_prefix));
+  ASSERT_TRUE(! reader.KeyMayMatch(3100, foo_prefix));
+
+  FullFilterBuilder full_builder(&policy_, prefix_extractor);
+  full_builder.AddKey("foo1");
+  full_builder.AddKey("box1");
+  FilterBlockReader full_reader(&policy_, full_builder.Finish(), true);
+  ASSERT_TRUE(full_reader.KeyMayMatch(0, foo_prefix));
+  ASSERT_TRUE(full_reader.KeyMayMatch(0, box_prefix));
+  ASSERT_TRUE(! full_reader.KeyMayMatch(0, "x"));
+  delete prefix_extractor;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
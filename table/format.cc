@@ -30,35 +30,53 @@ Status BlockHandle::DecodeFrom(Slice* input) {
 }
 
 void Footer::EncodeTo(std::string* dst) const {
-#ifndef NDEBUG
   const size_t original_size = dst->size();
-#endif
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
-  dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
-  assert(dst->size() == original_size + kEncodedLength);
+  dst->resize(original_size + 2 * BlockHandle::kMaxEncodedLength);  // Padding
+  uint64_t magic = kTableMagicNumber;
+  if (index_type_ != kBlockIndex) {
+    PutFixed32(dst, index_type_);
+    magic = kIndexTypeTableMagicNumber;
+  }
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
+  assert(dst->size() == original_size +
+         (index_type_ == kBlockIndex ? kEncodedLength : kMaxEncodedLength));
 }
 
 Status Footer::DecodeFrom(Slice* input) {
-  const char* magic_ptr = input->data() + kEncodedLength - 8;
+  if (input->size() < kEncodedLength) {
+    return Status::Corruption("truncated sstable footer");
+  }
+  const char* magic_ptr = input->data() + input->size() - 8;
   const uint32_t magic_lo = DecodeFixed32(magic_ptr);
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  size_t length = kEncodedLength;
+  if (magic == kTableMagicNumber) {
+    index_type_ = kBlockIndex;
+  } else if (magic == kIndexTypeTableMagicNumber &&
+             input->size() >= kMaxEncodedLength) {
+    const uint32_t type = DecodeFixed32(magic_ptr - 4);
+    if (type != kPartitionedIndex) {
+      return Status::Corruption("unknown sstable index type");
+    }
+    index_type_ = static_cast<IndexType>(type);
+    length = kMaxEncodedLength;
+  } else {
     return Status::InvalidArgument("not an sstable (bad magic number)");
   }
 
-  Status result = metaindex_handle_.DecodeFrom(input);
+  Slice handles(magic_ptr + 8 - length, length);
+  Status result = metaindex_handle_.DecodeFrom(&handles);
   if (result.ok()) {
-    result = index_handle_.DecodeFrom(input);
+    result = index_handle_.DecodeFrom(&handles);
   }
   if (result.ok()) {
     // We skip over any leftover data (just padding for now) in "input"
-    const char* end = magic_ptr + 8;
-    *input = Slice(end, input->data() + input->size() - end);
+    *input = Slice(magic_ptr + 8, 0);
   }
   return result;
 }
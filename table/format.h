@@ -42,11 +42,21 @@ class BlockHandle {
   uint64_t size_;
 };
 
+// The kind of index a table has.  The entries of a block index map keys
+// to data blocks.  The entries of a partitioned index map keys to index
+// partitions (blocks whose entries map keys to data blocks), followed by
+// the handle of the filter partition for the same keys when the table has
+// partitioned filters.
+enum IndexType {
+  kBlockIndex = 0,
+  kPartitionedIndex = 1
+};
+
 // Footer encapsulates the fixed information stored at the tail
 // end of every table file.
 class Footer {
  public:
-  Footer() { }
+  Footer() : index_type_(kBlockIndex) { }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -60,19 +70,31 @@ class Footer {
     index_handle_ = h;
   }
 
+  // The kind of index the index handle points to
+  IndexType index_type() const { return index_type_; }
+  void set_index_type(IndexType type) { index_type_ = type; }
+
   void EncodeTo(std::string* dst) const;
+
+  // Decodes the footer at the end of "input", which must hold at least
+  // the last kEncodedLength bytes of the table file, and should hold the
+  // last kMaxEncodedLength bytes if the file is that long.
   Status DecodeFrom(Slice* input);
 
   // Encoded length of a Footer.  Note that the serialization of a
-  // Footer will always occupy exactly this many bytes.  It consists
-  // of two block handles and a magic number.
+  // Footer with a block index will always occupy exactly this many
+  // bytes.  It consists of two block handles and a magic number.
+  // Footers with any other index type add the type before a magic
+  // number of their own, so that older readers reject their tables.
   enum {
-    kEncodedLength = 2*BlockHandle::kMaxEncodedLength + 8
+    kEncodedLength = 2*BlockHandle::kMaxEncodedLength + 8,
+    kMaxEncodedLength = kEncodedLength + 4
   };
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  IndexType index_type_;
 };
 
 // kTableMagicNumber was picked by running
@@ -80,6 +102,9 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables whose footer records an index type
+static const uint64_t kIndexTypeTableMagicNumber = 0x88e241b785f4cff7ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
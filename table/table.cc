@@ -9,6 +9,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -30,11 +31,128 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  size_t filter_size;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+
+  // With options.cache_index_and_filter_blocks, index_block and filter
+  // are NULL and the blocks at these handles live in the block cache.
+  bool cache_index_and_filter;
+  BlockHandle index_handle;
+  BlockHandle filter_handle;
+  bool has_filter;
+
+  // The filter is a single filter over the whole table (see
+  // Options::whole_table_filter), checked before the index.
+  bool whole_table_filter;
+
+  // index_block is the top-level index of a partitioned index.  If
+  // has_partitioned_filter, its entries also carry the handles of the
+  // filter partitions.
+  bool partitioned_index;
+  bool has_partitioned_filter;
+
+  // The filters also hold the prefixes computed by
+  // options.prefix_extractor.
+  bool prefix_filtered;
+};
+
+// A filter in the block cache, together with the data it reads from
+struct CachedFilter {
+  FilterBlockReader* reader;
+  const char* data;  // NULL if not heap allocated
+};
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+// A filter partition, in the block cache or read for a single lookup
+struct FilterPartition {
+  Slice data;
+  const char* owned;  // NULL if not heap allocated
 };
 
+static void DeleteFilterPartition(const Slice& key, void* value) {
+  FilterPartition* partition = reinterpret_cast<FilterPartition*>(value);
+  delete [] partition->owned;
+  delete partition;
+}
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  CachedFilter* filter = reinterpret_cast<CachedFilter*>(value);
+  delete filter->reader;
+  delete [] filter->data;
+  delete filter;
+}
+
+static void ReleaseBlock(void* arg, void* h) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+  cache->Release(handle);
+}
+
+static Slice BlockCacheKey(uint64_t cache_id, const BlockHandle& handle,
+                           char* buf) {
+  EncodeFixed64(buf, cache_id);
+  EncodeFixed64(buf+8, handle.offset());
+  return Slice(buf, 16);
+}
+
+// Looks up the index block at "handle" in the block cache, reading it
+// and inserting it with high priority if it is not there.
+static Cache::Handle* LoadIndexBlock(const Options& options,
+                                     RandomAccessFile* file,
+                                     uint64_t cache_id,
+                                     const ReadOptions& read_options,
+                                     const BlockHandle& handle,
+                                     Status* s) {
+  char cache_key_buffer[16];
+  Slice key = BlockCacheKey(cache_id, handle, cache_key_buffer);
+  Cache::Handle* cache_handle = options.block_cache->Lookup(key);
+  if (cache_handle == NULL) {
+    BlockContents contents;
+    *s = ReadBlock(file, read_options, handle, &contents);
+    if (s->ok()) {
+      Block* block = new Block(contents);
+      cache_handle = options.block_cache->Insert(
+          key, block, block->size(), &DeleteCachedBlock, Cache::HIGH);
+    }
+  }
+  return cache_handle;
+}
+
+// Like LoadIndexBlock() for the filter block, but returns NULL on
+// errors: the filter is not needed for correctness.
+static Cache::Handle* LoadFilter(const Options& options,
+                                 RandomAccessFile* file,
+                                 uint64_t cache_id,
+                                 const BlockHandle& handle,
+                                 bool whole_table) {
+  char cache_key_buffer[16];
+  Slice key = BlockCacheKey(cache_id, handle, cache_key_buffer);
+  Cache::Handle* cache_handle = options.block_cache->Lookup(key);
+  if (cache_handle == NULL) {
+    BlockContents block;
+    if (ReadBlock(file, ReadOptions(), handle, &block).ok()) {
+      CachedFilter* filter = new CachedFilter;
+      filter->reader = new FilterBlockReader(options.filter_policy, block.data,
+                                             whole_table);
+      filter->data = block.heap_allocated ? block.data.data() : NULL;
+      if (whole_table) {
+        // The reader made its own copy
+        delete [] filter->data;
+        filter->data = NULL;
+      }
+      cache_handle = options.block_cache->Insert(
+          key, filter, block.data.size(), &DeleteCachedFilter, Cache::HIGH);
+    }
+  }
+  return cache_handle;
+}
+
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
@@ -44,9 +162,11 @@ Status Table::Open(const Options& options,
     return Status::InvalidArgument("file is too short to be an sstable");
   }
 
-  char footer_space[Footer::kEncodedLength];
+  char footer_space[Footer::kMaxEncodedLength];
+  const size_t footer_length = static_cast<size_t>(
+      size < Footer::kMaxEncodedLength ? size : Footer::kMaxEncodedLength);
   Slice footer_input;
-  Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
+  Status s = file->Read(size - footer_length, footer_length,
                         &footer_input, footer_space);
   if (!s.ok()) return s;
 
@@ -74,7 +194,26 @@ Status Table::Open(const Options& options,
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
+    rep->filter_size = 0;
     rep->filter = NULL;
+    rep->cache_index_and_filter =
+        options.cache_index_and_filter_blocks && options.block_cache != NULL;
+    rep->index_handle = footer.index_handle();
+    rep->has_filter = false;
+    rep->whole_table_filter = false;
+    rep->prefix_filtered = false;
+    rep->partitioned_index = (footer.index_type() == kPartitionedIndex);
+    rep->has_partitioned_filter = false;
+    if (rep->cache_index_and_filter) {
+      // Hand the index block over to the cache
+      char cache_key_buffer[16];
+      Slice key = BlockCacheKey(rep->cache_id, rep->index_handle,
+                                cache_key_buffer);
+      options.block_cache->Release(options.block_cache->Insert(
+          key, index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::HIGH));
+      rep->index_block = NULL;
+    }
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   } else {
@@ -104,19 +243,55 @@ void Table::ReadMeta(const Footer& footer) {
   key.append(rep_->options.filter_policy->Name());
   iter->Seek(key);
   if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+    ReadFilter(iter->value(), false);
+  } else {
+    key = "fullfilter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), true);
+    }
+  }
+  if (rep_->partitioned_index) {
+    key = "partitionedfilter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      rep_->has_partitioned_filter = true;
+    }
+  }
+  if (rep_->options.prefix_extractor != NULL) {
+    key = "prefixextractor.";
+    key.append(rep_->options.prefix_extractor->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      rep_->prefix_filtered = true;
+    }
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool whole_table) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
     return;
   }
 
+  if (rep_->cache_index_and_filter) {
+    rep_->filter_handle = filter_handle;
+    rep_->has_filter = true;
+    rep_->whole_table_filter = whole_table;
+    Cache::Handle* cache_handle = LoadFilter(rep_->options, rep_->file,
+                                             rep_->cache_id, filter_handle,
+                                             whole_table);
+    if (cache_handle != NULL) {
+      rep_->options.block_cache->Release(cache_handle);
+    }
+    return;
+  }
+
   // We might want to unify with ReadBlock() if we start
   // requiring checksum verification in Table::Open.
   ReadOptions opt;
@@ -124,29 +299,34 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
-  if (block.heap_allocated) {
+  rep_->whole_table_filter = whole_table;
+  rep_->filter_size = block.data.size();
+  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data,
+                                       whole_table);
+  if (whole_table) {
+    // The reader made its own copy
+    if (block.heap_allocated) {
+      delete [] block.data.data();
+    }
+  } else if (block.heap_allocated) {
     rep_->filter_data = block.data.data();     // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
 Table::~Table() {
   delete rep_;
 }
 
-static void DeleteBlock(void* arg, void* ignored) {
-  delete reinterpret_cast<Block*>(arg);
-}
-
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+size_t Table::ApproximateMemoryUsage() const {
+  size_t usage = sizeof(*rep_) + rep_->filter_size;
+  if (rep_->index_block != NULL) {
+    usage += rep_->index_block->size();
+  }
+  return usage;
 }
 
-static void ReleaseBlock(void* arg, void* h) {
-  Cache* cache = reinterpret_cast<Cache*>(arg);
-  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-  cache->Release(handle);
+static void DeleteBlock(void* arg, void* ignored) {
+  delete reinterpret_cast<Block*>(arg);
 }
 
 // Convert an index iterator value (i.e., an encoded BlockHandle)
@@ -154,7 +334,23 @@ static void ReleaseBlock(void* arg, void* h) {
 Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
+  return ReadBlockIterator(reinterpret_cast<Table*>(arg), options,
+                           index_value, false);
+}
+
+// Like BlockReader(), for the values of a top-level index, which point
+// at index partitions.
+Iterator* Table::IndexPartitionReader(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& index_value) {
+  return ReadBlockIterator(reinterpret_cast<Table*>(arg), options,
+                           index_value, true);
+}
+
+Iterator* Table::ReadBlockIterator(Table* table,
+                                   const ReadOptions& options,
+                                   const Slice& index_value,
+                                   bool index_partition) {
   Cache* block_cache = table->rep_->options.block_cache;
   Block* block = NULL;
   Cache::Handle* cache_handle = NULL;
@@ -169,9 +365,8 @@ Iterator* Table::BlockReader(void* arg,
     BlockContents contents;
     if (block_cache != NULL) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer+8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Slice key = BlockCacheKey(table->rep_->cache_id, handle,
+                                cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
@@ -181,7 +376,8 @@ Iterator* Table::BlockReader(void* arg,
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
+                key, block, block->size(), &DeleteCachedBlock,
+                index_partition ? Cache::HIGH : Cache::LOW);
           }
         }
       }
@@ -207,23 +403,278 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+Iterator* Table::NewIndexBlockIterator(const ReadOptions& options) const {
+  if (rep_->index_block != NULL) {
+    return rep_->index_block->NewIterator(rep_->options.comparator);
+  }
+  Status s;
+  Cache* block_cache = rep_->options.block_cache;
+  Cache::Handle* cache_handle = LoadIndexBlock(
+      rep_->options, rep_->file, rep_->cache_id, options, rep_->index_handle,
+      &s);
+  if (cache_handle == NULL) {
+    return NewErrorIterator(s);
+  }
+  Block* block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+  Iterator* iter = block->NewIterator(rep_->options.comparator);
+  iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  return iter;
+}
+
+// Returns an iterator whose values are the handles of the data blocks,
+// over the index partitions of a partitioned index.
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* index_iter = NewIndexBlockIterator(options);
+  if (!rep_->partitioned_index) {
+    return index_iter;
+  }
+  return NewTwoLevelIterator(index_iter, &Table::IndexPartitionReader,
+                             const_cast<Table*>(this), options);
+}
+
+// Checks "key" against the filter partition named by a top-level index
+// entry.  Errors are treated as potential matches.
+bool Table::PartitionMayMatch(const ReadOptions& options,
+                              const Slice& top_level_value,
+                              const Slice& key) const {
+  Slice input = top_level_value;
+  BlockHandle partition_handle, filter_handle;
+  if (!rep_->has_partitioned_filter ||
+      !partition_handle.DecodeFrom(&input).ok() ||
+      !filter_handle.DecodeFrom(&input).ok()) {
+    return true;
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  Cache::Handle* cache_handle = NULL;
+  FilterPartition* partition = NULL;
+  char cache_key_buffer[16];
+  Slice cache_key;
+  if (block_cache != NULL) {
+    cache_key = BlockCacheKey(rep_->cache_id, filter_handle, cache_key_buffer);
+    cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != NULL) {
+      partition = reinterpret_cast<FilterPartition*>(
+          block_cache->Value(cache_handle));
+    }
+  }
+  if (partition == NULL) {
+    BlockContents contents;
+    if (!ReadBlock(rep_->file, options, filter_handle, &contents).ok()) {
+      return true;
+    }
+    partition = new FilterPartition;
+    partition->data = contents.data;
+    partition->owned = contents.heap_allocated ? contents.data.data() : NULL;
+    if (block_cache != NULL && options.fill_cache) {
+      cache_handle = block_cache->Insert(cache_key, partition,
+                                         contents.data.size(),
+                                         &DeleteFilterPartition, Cache::HIGH);
+    }
+  }
+
+  const bool result =
+      rep_->options.filter_policy->KeyMayMatch(key, partition->data);
+  if (cache_handle != NULL) {
+    block_cache->Release(cache_handle);
+  } else {
+    DeleteFilterPartition(Slice(), partition);
+  }
+  return result;
+}
+
+// Returns false if the filters rule out that the table holds any key
+// at or after "target" with the same prefix.  Those keys start in the
+// block (or index partition) that the index finds for target or at the
+// front of the next one, since index keys may fall between two blocks,
+// so at most two filters are checked.  Errors are treated as potential
+// matches.
+bool Table::PrefixMayMatch(void* arg, const ReadOptions& options,
+                           const Slice& target) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Rep* rep = table->rep_;
+  const SliceTransform* prefix_extractor = rep->options.prefix_extractor;
+  if (!rep->prefix_filtered || !prefix_extractor->InDomain(target)) {
+    return true;
+  }
+  std::string entry;
+  AppendPrefixFilterEntry(&entry, prefix_extractor->Transform(target));
+
+  if (rep->partitioned_index) {
+    if (!rep->has_partitioned_filter) {
+      return true;
+    }
+    Iterator* top = table->NewIndexBlockIterator(options);
+    top->Seek(target);
+    bool may_match = false;
+    for (int i = 0; i < 2 && top->Valid() && !may_match; i++) {
+      may_match = table->PartitionMayMatch(options, top->value(), entry);
+      top->Next();
+    }
+    if (!top->status().ok()) {
+      may_match = true;
+    }
+    delete top;
+    return may_match;
+  }
+
+  FilterBlockReader* filter = rep->filter;
+  Cache::Handle* filter_cache_handle = NULL;
+  if (rep->has_filter) {
+    filter_cache_handle = LoadFilter(rep->options, rep->file, rep->cache_id,
+                                     rep->filter_handle,
+                                     rep->whole_table_filter);
+    if (filter_cache_handle != NULL) {
+      filter = reinterpret_cast<CachedFilter*>(
+          rep->options.block_cache->Value(filter_cache_handle))->reader;
+    }
+  }
+  bool may_match = true;
+  if (filter != NULL && filter->whole_table()) {
+    may_match = filter->KeyMayMatch(0, entry);
+  } else if (filter != NULL) {
+    Iterator* iiter = table->NewIndexIterator(options);
+    iiter->Seek(target);
+    may_match = false;
+    for (int i = 0; i < 2 && iiter->Valid() && !may_match; i++) {
+      Slice handle_value = iiter->value();
+      BlockHandle handle;
+      may_match = !handle.DecodeFrom(&handle_value).ok() ||
+                  filter->KeyMayMatch(handle.offset(), entry);
+      iiter->Next();
+    }
+    if (!iiter->status().ok()) {
+      may_match = true;
+    }
+    delete iiter;
+  }
+  if (filter_cache_handle != NULL) {
+    rep->options.block_cache->Release(filter_cache_handle);
+  }
+  return may_match;
+}
+
+namespace {
+// With ReadOptions::prefix_seek, wraps the iterator of a table whose
+// filters hold prefixes: a Seek() to a target whose prefix the filters
+// rule out leaves the iterator invalid without reading any data block.
+class PrefixFilterIterator : public Iterator {
+ public:
+  typedef bool (*MayMatchFunction)(void*, const ReadOptions&, const Slice&);
+
+  PrefixFilterIterator(Iterator* iter, MayMatchFunction may_match, void* arg,
+                       const ReadOptions& options)
+      : iter_(iter),
+        may_match_(may_match),
+        arg_(arg),
+        options_(options),
+        filtered_(false) {
+  }
+
+  virtual ~PrefixFilterIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const {
+    return !filtered_ && iter_->Valid();
+  }
+  virtual void Seek(const Slice& target) {
+    filtered_ = !(*may_match_)(arg_, options_, target);
+    if (!filtered_) {
+      iter_->Seek(target);
+    }
+  }
+  virtual void SeekToFirst() {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  virtual void SeekToLast() {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  virtual void Next() {
+    assert(Valid());
+    iter_->Next();
+  }
+  virtual void Prev() {
+    assert(Valid());
+    iter_->Prev();
+  }
+  virtual Slice key() const {
+    assert(Valid());
+    return iter_->key();
+  }
+  virtual Slice value() const {
+    assert(Valid());
+    return iter_->value();
+  }
+  virtual Status status() const {
+    return iter_->status();
+  }
+
+ private:
+  Iterator* iter_;
+  MayMatchFunction may_match_;
+  void* arg_;
+  const ReadOptions options_;
+  bool filtered_;
+};
+}  // namespace
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
+  Iterator* iter = NewTwoLevelIterator(
+      NewIndexIterator(options),
       &Table::BlockReader, const_cast<Table*>(this), options);
+  if (options.prefix_seek && rep_->prefix_filtered) {
+    iter = new PrefixFilterIterator(iter, &Table::PrefixMayMatch,
+                                    const_cast<Table*>(this), options);
+  }
+  return iter;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
                           void (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  FilterBlockReader* filter = rep_->filter;
+  Cache::Handle* filter_cache_handle = NULL;
+  if (rep_->has_filter) {
+    filter_cache_handle = LoadFilter(rep_->options, rep_->file, rep_->cache_id,
+                                     rep_->filter_handle,
+                                     rep_->whole_table_filter);
+    if (filter_cache_handle != NULL) {
+      filter = reinterpret_cast<CachedFilter*>(
+          rep_->options.block_cache->Value(filter_cache_handle))->reader;
+    }
+  }
+  if (filter != NULL && filter->whole_table() && !filter->KeyMayMatch(0, k)) {
+    // Not found, and the index was not needed to tell
+    if (filter_cache_handle != NULL) {
+      rep_->options.block_cache->Release(filter_cache_handle);
+    }
+    return s;
+  }
+
+  Iterator* iiter;
+  if (rep_->partitioned_index) {
+    // Check the filter partition before reading the index partition
+    Iterator* top = NewIndexBlockIterator(options);
+    top->Seek(k);
+    if (!top->Valid() || !PartitionMayMatch(options, top->value(), k)) {
+      s = top->status();
+      delete top;
+      return s;
+    }
+    iiter = IndexPartitionReader(this, options, top->value());
+    delete top;
+  } else {
+    iiter = NewIndexIterator(options);
+  }
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != NULL &&
+    if (filter != NULL && !filter->whole_table() &&
         handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
@@ -237,6 +688,9 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
       delete block_iter;
     }
   }
+  if (filter_cache_handle != NULL) {
+    rep_->options.block_cache->Release(filter_cache_handle);
+  }
   if (s.ok()) {
     s = iiter->status();
   }
@@ -246,8 +700,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
 
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
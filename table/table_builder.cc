@@ -9,6 +9,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -29,6 +30,16 @@ struct TableBuilder::Rep {
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  FullFilterBuilder* full_filter;  // With options.whole_table_filter
+
+  // With options.partition_index_and_filters, index_block holds the
+  // entries of the current index partition, whose last key is
+  // last_index_key, and top_level_index indexes the partitions written
+  // so far.  filter_partition collects the keys of the current partition.
+  bool partitioned;
+  BlockBuilder top_level_index;
+  std::string last_index_key;
+  FullFilterBuilder* filter_partition;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -53,8 +64,22 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == NULL ? NULL
-                     : new FilterBlockBuilder(opt.filter_policy)),
+        filter_block(opt.filter_policy == NULL ||
+                     opt.partition_index_and_filters ||
+                     opt.whole_table_filter ? NULL
+                     : new FilterBlockBuilder(opt.filter_policy,
+                                              opt.prefix_extractor)),
+        full_filter(opt.filter_policy == NULL ||
+                    opt.partition_index_and_filters ||
+                    !opt.whole_table_filter ? NULL
+                    : new FullFilterBuilder(opt.filter_policy,
+                                            opt.prefix_extractor)),
+        partitioned(opt.partition_index_and_filters),
+        top_level_index(&index_block_options),
+        filter_partition(opt.filter_policy == NULL ||
+                         !opt.partition_index_and_filters ? NULL
+                         : new FullFilterBuilder(opt.filter_policy,
+                                                 opt.prefix_extractor)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -70,6 +95,8 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter;
+  delete rep_->filter_partition;
   delete rep_;
 }
 
@@ -104,11 +131,24 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->partitioned) {
+      r->last_index_key = r->last_key;
+      if (r->index_block.CurrentSizeEstimate() >=
+          r->options.metadata_block_size) {
+        FlushIndexPartition();
+      }
+    }
   }
 
   if (r->filter_block != NULL) {
     r->filter_block->AddKey(key);
   }
+  if (r->full_filter != NULL) {
+    r->full_filter->AddKey(key);
+  }
+  if (r->filter_partition != NULL) {
+    r->filter_partition->AddKey(key);
+  }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
@@ -192,6 +232,26 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   }
 }
 
+// Writes the current index partition and its filter partition, and
+// indexes them in top_level_index under the last key of the partition.
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  if (!ok() || r->index_block.empty()) return;
+  BlockHandle partition_handle;
+  WriteBlock(&r->index_block, &partition_handle);
+  std::string handle_encoding;
+  partition_handle.EncodeTo(&handle_encoding);
+  if (ok() && r->filter_partition != NULL) {
+    BlockHandle filter_handle;
+    WriteRawBlock(r->filter_partition->Finish(), kNoCompression,
+                  &filter_handle);
+    filter_handle.EncodeTo(&handle_encoding);
+  }
+  if (ok()) {
+    r->top_level_index.Add(r->last_index_key, Slice(handle_encoding));
+  }
+}
+
 Status TableBuilder::status() const {
   return rep_->status;
 }
@@ -209,6 +269,10 @@ Status TableBuilder::Finish() {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
+  if (ok() && r->full_filter != NULL) {
+    WriteRawBlock(r->full_filter->Finish(), kNoCompression,
+                  &filter_block_handle);
+  }
 
   // Write metaindex block
   if (ok()) {
@@ -221,6 +285,30 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->full_filter != NULL) {
+      // Add mapping from "fullfilter.Name" to location of filter data
+      std::string key = "fullfilter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (r->filter_partition != NULL) {
+      // The filter partitions are found through the index; this entry
+      // tells readers which policy built them
+      std::string key = "partitionedfilter.";
+      key.append(r->options.filter_policy->Name());
+      meta_index_block.Add(key, Slice());
+    }
+
+    if (r->options.filter_policy != NULL &&
+        r->options.prefix_extractor != NULL) {
+      // The filters hold prefixes; this entry tells readers which
+      // transform computed them
+      std::string key = "prefixextractor.";
+      key.append(r->options.prefix_extractor->Name());
+      meta_index_block.Add(key, Slice());
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -234,8 +322,16 @@ Status TableBuilder::Finish() {
       r->pending_handle.EncodeTo(&handle_encoding);
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
+      r->last_index_key = r->last_key;
+    }
+    if (r->partitioned) {
+      FlushIndexPartition();
+      if (ok()) {
+        WriteBlock(&r->top_level_index, &index_block_handle);
+      }
+    } else {
+      WriteBlock(&r->index_block, &index_block_handle);
     }
-    WriteBlock(&r->index_block, &index_block_handle);
   }
 
   // Write footer
@@ -243,6 +339,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_index_type(r->partitioned ? kPartitionedIndex : kBlockIndex);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -16,6 +16,7 @@
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -218,6 +219,56 @@ class BlockConstructor: public Constructor {
   BlockConstructor();
 };
 
+// Spreads the data over several blocks, in runs of consecutive keys,
+// and merges them back together with a merging iterator.
+class MergingConstructor: public Constructor {
+ public:
+  explicit MergingConstructor(const Comparator* cmp)
+      : Constructor(cmp),
+        comparator_(cmp) {
+    for (int i = 0; i < kNumChildren; i++) {
+      children_[i] = new BlockConstructor(cmp);
+    }
+  }
+  ~MergingConstructor() {
+    for (int i = 0; i < kNumChildren; i++) {
+      delete children_[i];
+    }
+  }
+  virtual Status FinishImpl(const Options& options, const KVMap& data) {
+    std::vector<KVMap> parts(kNumChildren, KVMap(STLLessThan(comparator_)));
+    Random rnd(301);
+    int child = 0;
+    for (KVMap::const_iterator it = data.begin();
+         it != data.end();
+         ++it) {
+      if (rnd.OneIn(4)) {
+        child = rnd.Uniform(kNumChildren);
+      }
+      parts[child][it->first] = it->second;
+    }
+    for (int i = 0; i < kNumChildren; i++) {
+      Status s = children_[i]->FinishImpl(options, parts[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  virtual Iterator* NewIterator() const {
+    Iterator* list[kNumChildren];
+    for (int i = 0; i < kNumChildren; i++) {
+      list[i] = children_[i]->NewIterator();
+    }
+    return NewMergingIterator(comparator_, list, kNumChildren);
+  }
+
+ private:
+  enum { kNumChildren = 11 };
+  const Comparator* comparator_;
+  BlockConstructor* children_[kNumChildren];
+};
+
 class TableConstructor: public Constructor {
  public:
   TableConstructor(const Comparator* cmp)
@@ -399,6 +450,7 @@ class DBConstructor: public Constructor {
 enum TestType {
   TABLE_TEST,
   BLOCK_TEST,
+  MERGING_TEST,
   MEMTABLE_TEST,
   DB_TEST
 };
@@ -407,6 +459,7 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool partitioned_index;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -416,6 +469,9 @@ static const TestArgs kTestArgList[] = {
   { TABLE_TEST, true, 16 },
   { TABLE_TEST, true, 1 },
   { TABLE_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, true },
+  { TABLE_TEST, false, 1, true },
+  { TABLE_TEST, true, 16, true },
 
   { BLOCK_TEST, false, 16 },
   { BLOCK_TEST, false, 1 },
@@ -424,6 +480,9 @@ static const TestArgs kTestArgList[] = {
   { BLOCK_TEST, true, 1 },
   { BLOCK_TEST, true, 1024 },
 
+  { MERGING_TEST, false, 16 },
+  { MERGING_TEST, true, 16 },
+
   // Restart interval does not matter for memtables
   { MEMTABLE_TEST, false, 16 },
   { MEMTABLE_TEST, true, 16 },
@@ -447,6 +506,8 @@ class Harness {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.partition_index_and_filters = args.partitioned_index;
+    options_.metadata_block_size = 64;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -457,6 +518,9 @@ class Harness {
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
+      case MERGING_TEST:
+        constructor_ = new MergingConstructor(options_.comparator);
+        break;
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
@@ -735,7 +799,7 @@ TEST(Harness, Randomized) {
 
 TEST(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = { DB_TEST, false, 16 };
+  TestArgs args = { DB_TEST, false, 16, false };
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -827,6 +891,29 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
 
 }
 
+TEST(TableTest, ApproximateOffsetOfPartitioned) {
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%03d", i);
+    c.Add(key, std::string(1000, 'x'));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 64;
+  c.Finish(options, &keys, &kvmap);
+
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k000"),      0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k050"),  50000,  52000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k099"),  99000, 101000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),  100000, 104000));
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
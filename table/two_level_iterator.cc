@@ -59,6 +59,7 @@ class TwoLevelIterator: public Iterator {
   }
   void SkipEmptyDataBlocksForward();
   void SkipEmptyDataBlocksBackward();
+  void SkipToPrefixForward(const Slice& target);
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
 
@@ -92,7 +93,11 @@ void TwoLevelIterator::Seek(const Slice& target) {
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.Seek(target);
-  SkipEmptyDataBlocksForward();
+  if (options_.prefix_seek) {
+    SkipToPrefixForward(target);
+  } else {
+    SkipEmptyDataBlocksForward();
+  }
 }
 
 void TwoLevelIterator::SeekToFirst() {
@@ -135,6 +140,25 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
   }
 }
 
+// With options_.prefix_seek, the keys at or after target that share its
+// prefix start in the block the index found for target or at the front
+// of the next one (an index key may fall between two blocks).  Blocks
+// are never empty, so if neither yields a key, a filter has ruled the
+// prefix out, and looking no further saves loading the blocks after it.
+void TwoLevelIterator::SkipToPrefixForward(const Slice& target) {
+  if (data_iter_.iter() != NULL && data_iter_.Valid()) {
+    return;
+  }
+  if (index_iter_.Valid()) {
+    index_iter_.Next();
+    InitDataBlock();
+    if (data_iter_.iter() != NULL) data_iter_.Seek(target);
+  }
+  if (data_iter_.iter() != NULL && !data_iter_.Valid()) {
+    SetDataIterator(NULL);
+  }
+}
+
 void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
   while (data_iter_.iter() == NULL || !data_iter_.Valid()) {
     // Move to next block
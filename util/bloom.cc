@@ -4,9 +4,16 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <string.h>
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LEVELDB_BLOOM_SSE2 1
+#endif
+
 namespace leveldb {
 
 namespace {
@@ -86,10 +93,135 @@ class BloomFilterPolicy : public FilterPolicy {
     return true;
   }
 };
+
+// A bloom filter split into 64-byte lines.  The hash of a key picks one
+// line, and all k probes for the key fall into it: probe j sets one bit
+// in 32-bit word (w + j) % 16 of the line, for a hash-derived starting
+// word w.  A lookup therefore touches a single cache line, and with SSE2
+// it tests all k bits with four 16-byte compares.  For the same number
+// of bits per key the false positive rate is slightly higher than with
+// BloomFilterPolicy.
+//
+// Filter layout: num_lines * 64 bytes of lines, followed by one byte
+// holding k.
+class CacheLocalBloomFilterPolicy : public FilterPolicy {
+ private:
+  enum {
+    kLineBytes = 64,
+    kLineBits = kLineBytes * 8,
+    kWordsPerLine = kLineBytes / 4,
+    kMaxProbes = kWordsPerLine
+  };
+
+  size_t bits_per_key_;
+  size_t k_;
+
+  static uint32_t LineFor(uint32_t h, size_t num_lines) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+  }
+
+  // Calls fn(bit) for the position within its line of each of the k
+  // bits for the key with hash h.
+  template <typename Fn>
+  static void ForEachProbe(uint32_t h, size_t k, Fn& fn) {
+    uint32_t b = h * 0x9e3779b9u;
+    const uint32_t first_word = b >> 28;
+    for (size_t j = 0; j < k; j++) {
+      b *= 0x9e3779b9u;
+      fn((((first_word + j) % kWordsPerLine) << 5) | (b >> 27));
+    }
+  }
+
+  struct SetBit {
+    char* line;
+    void operator()(uint32_t bit) { line[bit >> 3] |= (1 << (bit & 7)); }
+  };
+
+  struct TestBit {
+    const char* line;
+    bool match;
+    void operator()(uint32_t bit) {
+      match = match && (line[bit >> 3] & (1 << (bit & 7))) != 0;
+    }
+  };
+
+ public:
+  explicit CacheLocalBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > kMaxProbes) k_ = kMaxProbes;
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.CacheLocalBloomFilter";
+  }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    const size_t bits = n * bits_per_key_;
+    size_t num_lines = (bits + kLineBits - 1) / kLineBits;
+    if (num_lines == 0) num_lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (size_t i = 0; i < (size_t)n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      SetBit set;
+      set.line = array + LineFor(h, num_lines) * kLineBytes;
+      ForEachProbe(h, k_, set);
+    }
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const {
+    const size_t len = bloom_filter.size();
+    if (len < 1 + kLineBytes || (len - 1) % kLineBytes != 0) {
+      // Not a filter of this policy (the empty filter matches nothing).
+      return len != 0;
+    }
+    const size_t k = static_cast<unsigned char>(bloom_filter[len-1]);
+    if (k > kMaxProbes) {
+      return true;  // Reserved for new encodings
+    }
+
+    const uint32_t h = BloomHash(key);
+    const size_t num_lines = (len - 1) / kLineBytes;
+    const char* line = bloom_filter.data() + LineFor(h, num_lines) * kLineBytes;
+#if defined(LEVELDB_BLOOM_SSE2)
+    // The line matches if (line & mask) == mask, with mask holding the
+    // k probed bits.
+    char mask_bytes[kLineBytes];
+    memset(mask_bytes, 0, sizeof(mask_bytes));
+    SetBit set;
+    set.line = mask_bytes;
+    ForEachProbe(h, k, set);
+    __m128i all = _mm_set1_epi8(static_cast<char>(0xff));
+    for (int i = 0; i < kLineBytes; i += 16) {
+      const __m128i m = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(mask_bytes + i));
+      const __m128i l = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(line + i));
+      all = _mm_and_si128(all, _mm_cmpeq_epi8(_mm_and_si128(l, m), m));
+    }
+    return _mm_movemask_epi8(all) == 0xffff;
+#else
+    TestBit test;
+    test.line = line;
+    test.match = true;
+    ForEachProbe(h, k, test);
+    return test.match;
+#endif
+  }
+};
 }
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewCacheLocalBloomFilterPolicy(int bits_per_key) {
+  return new CacheLocalBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
@@ -20,12 +20,16 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest {
  private:
+  const bool cache_local_;  // Test NewCacheLocalBloomFilterPolicy()
   const FilterPolicy* policy_;
   std::string filter_;
   std::vector<std::string> keys_;
 
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) { }
+  explicit BloomTest(bool cache_local = false)
+      : cache_local_(cache_local),
+        policy_(cache_local ? NewCacheLocalBloomFilterPolicy(10)
+                            : NewBloomFilterPolicy(10)) { }
 
   ~BloomTest() {
     delete policy_;
@@ -83,14 +87,27 @@ class BloomTest {
     }
     return result / 10000.0;
   }
+
+  // The checks both filter policies must pass
+  void CheckEmptyFilter();
+  void CheckSmall();
+  void CheckVaryingLengths();
 };
 
-TEST(BloomTest, EmptyFilter) {
+// Runs the checks of BloomTest against the cache-local filter
+class CacheLocalBloomTest : public BloomTest {
+ public:
+  CacheLocalBloomTest() : BloomTest(true) { }
+};
+
+void BloomTest::CheckEmptyFilter() {
   ASSERT_TRUE(! Matches("hello"));
   ASSERT_TRUE(! Matches("world"));
 }
+TEST(BloomTest, EmptyFilter) { CheckEmptyFilter(); }
+TEST(CacheLocalBloomTest, CacheLocalEmptyFilter) { CheckEmptyFilter(); }
 
-TEST(BloomTest, Small) {
+void BloomTest::CheckSmall() {
   Add("hello");
   Add("world");
   ASSERT_TRUE(Matches("hello"));
@@ -98,6 +115,8 @@ TEST(BloomTest, Small) {
   ASSERT_TRUE(! Matches("x"));
   ASSERT_TRUE(! Matches("foo"));
 }
+TEST(BloomTest, Small) { CheckSmall(); }
+TEST(CacheLocalBloomTest, CacheLocalSmall) { CheckSmall(); }
 
 static int NextLength(int length) {
   if (length < 10) {
@@ -112,7 +131,7 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST(BloomTest, VaryingLengths) {
+void BloomTest::CheckVaryingLengths() {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -126,7 +145,12 @@ TEST(BloomTest, VaryingLengths) {
     }
     Build();
 
-    ASSERT_LE(FilterSize(), (length * 10 / 8) + 40) << length;
+    if (cache_local_) {
+      // Rounded up to whole 64-byte lines, plus the probe count
+      ASSERT_LE(FilterSize(), (length * 10 / 8) + 64 + 1) << length;
+    } else {
+      ASSERT_LE(FilterSize(), (length * 10 / 8) + 40) << length;
+    }
 
     // All added keys must match
     for (int i = 0; i < length; i++) {
@@ -150,6 +174,8 @@ TEST(BloomTest, VaryingLengths) {
   }
   ASSERT_LE(mediocre_filters, good_filters/5);
 }
+TEST(BloomTest, VaryingLengths) { CheckVaryingLengths(); }
+TEST(CacheLocalBloomTest, CacheLocalVaryingLengths) { CheckVaryingLengths(); }
 
 // Different bits-per-byte
 
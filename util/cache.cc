@@ -16,6 +16,12 @@ namespace leveldb {
 Cache::~Cache() {
 }
 
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
 namespace {
 
 // LRU cache implementation
@@ -32,6 +38,8 @@ struct LRUHandle {
   size_t key_length;
   uint32_t refs;
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool high_pri;           // Inserted with Cache::HIGH priority
+  bool in_high_pri_pool;   // Currently counted against the high-pri pool
   char key_data[1];   // Beginning of key
 
   Slice key() const {
@@ -137,41 +145,62 @@ class LRUCache {
   LRUCache();
   ~LRUCache();
 
-  // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  // Separate from constructor so caller can easily make an array of LRUCache.
+  // The hash table grows as needed, so estimated_entry_charge is unused.
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge,
+                   double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    high_pri_pool_capacity_ = static_cast<size_t>(
+        capacity * high_pri_pool_ratio);
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
 
  private:
   void LRU_Remove(LRUHandle* e);
   void LRU_Append(LRUHandle* e);
+  void MaintainPoolSize();
   void Unref(LRUHandle* e);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_pool_capacity_;
 
   // mutex_ protects the following state.
-  port::Mutex mutex_;
+  mutable port::Mutex mutex_;
   size_t usage_;
+  size_t high_pri_pool_usage_;
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
+  // The entries from lru.next up to lru_low_pri_ are the low priority
+  // ones, and the newer entries make up the high priority pool.
   LRUHandle lru_;
+  LRUHandle* lru_low_pri_;
 
   HandleTable table_;
 };
 
 LRUCache::LRUCache()
-    : usage_(0) {
+    : capacity_(0),
+      high_pri_pool_capacity_(0),
+      usage_(0),
+      high_pri_pool_usage_(0) {
   // Make empty circular linked list
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  lru_low_pri_ = &lru_;
 }
 
 LRUCache::~LRUCache() {
@@ -194,16 +223,45 @@ void LRUCache::Unref(LRUHandle* e) {
 }
 
 void LRUCache::LRU_Remove(LRUHandle* e) {
+  if (lru_low_pri_ == e) {
+    lru_low_pri_ = e->prev;
+  }
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->in_high_pri_pool) {
+    high_pri_pool_usage_ -= e->charge;
+  }
 }
 
 void LRUCache::LRU_Append(LRUHandle* e) {
-  // Make "e" newest entry by inserting just before lru_
-  e->next = &lru_;
-  e->prev = lru_.prev;
+  if (e->high_pri && high_pri_pool_capacity_ > 0) {
+    // Make "e" newest entry by inserting just before lru_
+    e->next = &lru_;
+    e->prev = lru_.prev;
+    e->in_high_pri_pool = true;
+    high_pri_pool_usage_ += e->charge;
+  } else {
+    // Make "e" newest low priority entry by inserting just after
+    // lru_low_pri_.  Without a high priority pool that is the newest entry.
+    e->next = lru_low_pri_->next;
+    e->prev = lru_low_pri_;
+    e->in_high_pri_pool = false;
+    lru_low_pri_ = e;
+  }
   e->prev->next = e;
   e->next->prev = e;
+  MaintainPoolSize();
+}
+
+// Moves the oldest entries of the high priority pool over to the low
+// priority part of the list until the pool fits its capacity again.
+void LRUCache::MaintainPoolSize() {
+  while (high_pri_pool_usage_ > high_pri_pool_capacity_) {
+    lru_low_pri_ = lru_low_pri_->next;
+    assert(lru_low_pri_ != &lru_);
+    lru_low_pri_->in_high_pri_pool = false;
+    high_pri_pool_usage_ -= lru_low_pri_->charge;
+  }
 }
 
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
@@ -224,7 +282,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e = reinterpret_cast<LRUHandle*>(
@@ -235,6 +294,7 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->refs = 2;  // One from LRUCache, one for the returned handle
+  e->high_pri = (priority == Cache::HIGH);
   memcpy(e->key_data, key.data(), key.size());
   LRU_Append(e);
   usage_ += charge;
@@ -264,12 +324,372 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
   }
 }
 
+// CLOCK cache implementation
+
+// An entry of a CLOCK cache shard.  The entries of a shard are slots of
+// one array that is allocated up front and never freed, so any thread
+// may look at the "meta" word of any slot without a lock.  The other
+// fields are written by the thread that owns the slot in the
+// construction state and may only be read by a thread that holds a
+// reference to the slot.
+struct ClockHandle {
+  port::AtomicPointer meta;           // State, clock countdown and refs
+  port::AtomicPointer displacements;  // # of entries that probed past here
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  char* key_data;
+  size_t key_length;
+  size_t charge;
+  uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool detached;      // Heap-allocated entry that is in no table
+  bool high_pri;      // Inserted with Cache::HIGH priority
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// Layout of ClockHandle::meta.  A slot is owned by a single thread in
+// the construction state; only visible slots can be found by lookups
+// and only they gain references, so an invisible slot is freed by
+// whoever drops its last reference.
+static const uintptr_t kStateMask = 3;
+static const uintptr_t kStateEmpty = 0;
+static const uintptr_t kStateConstruction = 1;
+static const uintptr_t kStateVisible = 2;
+static const uintptr_t kStateInvisible = 3;
+static const int kClockShift = 2;
+static const uintptr_t kClockMask = 3 << kClockShift;
+static const uintptr_t kMaxCountdown = 3;    // Set by every hit
+static const uintptr_t kInitialCountdown = 1;
+static const int kRefShift = 4;
+static const uintptr_t kOneRef = 1 << kRefShift;
+
+static inline uintptr_t Load(const port::AtomicPointer& p) {
+  return reinterpret_cast<uintptr_t>(p.Acquire_Load());
+}
+
+static inline bool CompareAndSwap(port::AtomicPointer* p,
+                                  uintptr_t expected, uintptr_t v) {
+  return p->CompareAndSwap(reinterpret_cast<void*>(expected),
+                           reinterpret_cast<void*>(v));
+}
+
+// Adds "delta" (modulo the word size) and returns the new value.
+static inline uintptr_t FetchAdd(port::AtomicPointer* p, uintptr_t delta) {
+  while (true) {
+    const uintptr_t old = Load(*p);
+    if (CompareAndSwap(p, old, old + delta)) {
+      return old + delta;
+    }
+  }
+}
+
+// A single shard of a CLOCK cache: an open addressing hash table of
+// ClockHandle slots, probed by double hashing.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCache.  Sizes the table for capacity / estimated_entry_charge
+  // entries.
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge,
+                   double high_pri_pool_ratio);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash,
+                        void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  size_t TotalCharge() const { return Load(usage_); }
+
+ private:
+  uint32_t Step(uint32_t hash) const {
+    // Odd, so that the probe sequence visits every slot
+    return ((hash * 0x9e3779b9u) >> 16) | 1;
+  }
+
+  bool Ref(ClockHandle* h);
+  void Touch(ClockHandle* h);
+  void Unref(ClockHandle* h);
+  void Free(ClockHandle* h);
+  void MakeInvisible(ClockHandle* h);
+  void EvictLocked(size_t charge);
+
+  // Initialized before use.
+  size_t capacity_;
+  size_t high_pri_pool_capacity_;
+  uint32_t length_;
+  uint32_t max_occupancy_;
+  ClockHandle* slots_;
+
+  port::AtomicPointer usage_;      // Sum of the charges of live entries
+  port::AtomicPointer high_pri_usage_;  // Part of usage_ at HIGH priority
+  port::AtomicPointer occupancy_;  // # of slots that are not empty
+
+  // mutex_ serializes Insert() and Erase(), and protects the following.
+  port::Mutex mutex_;
+  uint32_t clock_hand_;
+};
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      high_pri_pool_capacity_(0),
+      length_(0),
+      max_occupancy_(0),
+      slots_(NULL),
+      usage_(NULL),
+      high_pri_usage_(NULL),
+      occupancy_(NULL),
+      clock_hand_(0) {
+}
+
+ClockCache::~ClockCache() {
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uintptr_t meta = Load(h->meta);
+    if ((meta & kStateMask) == kStateVisible) {
+      assert((meta >> kRefShift) == 0);  // Error if caller has an unreleased handle
+      Free(h);
+    } else {
+      assert(meta == kStateEmpty);
+    }
+  }
+  delete[] slots_;
+}
+
+void ClockCache::SetCapacity(size_t capacity, size_t estimated_entry_charge,
+                             double high_pri_pool_ratio) {
+  assert(slots_ == NULL);
+  capacity_ = capacity;
+  high_pri_pool_capacity_ = static_cast<size_t>(
+      capacity * high_pri_pool_ratio);
+  // Aim for a load factor of about 0.7, and never let more than 7/8 of
+  // the slots fill up so that probe sequences stay short.
+  const size_t entries =
+      capacity / (estimated_entry_charge > 0 ? estimated_entry_charge : 1);
+  const size_t wanted = entries + entries * 3 / 7 + 1;
+  length_ = 16;
+  while (length_ < wanted && length_ < (1u << 30)) {
+    length_ *= 2;
+  }
+  max_occupancy_ = length_ - length_ / 8;
+  slots_ = new ClockHandle[length_];
+  for (uint32_t i = 0; i < length_; i++) {
+    slots_[i].meta.NoBarrier_Store(NULL);
+    slots_[i].displacements.NoBarrier_Store(NULL);
+    slots_[i].detached = false;
+  }
+}
+
+// Takes a reference to "h" if it is visible.
+bool ClockCache::Ref(ClockHandle* h) {
+  while (true) {
+    const uintptr_t meta = Load(h->meta);
+    if ((meta & kStateMask) != kStateVisible) {
+      return false;
+    }
+    if (CompareAndSwap(&h->meta, meta, meta + kOneRef)) {
+      return true;
+    }
+  }
+}
+
+// Marks "h", which the caller holds a reference to, as recently used.
+// Best effort: losing a race with another update of h->meta is fine.
+void ClockCache::Touch(ClockHandle* h) {
+  const uintptr_t meta = Load(h->meta);
+  if ((meta & kClockMask) != kClockMask &&
+      (meta & kStateMask) == kStateVisible) {
+    CompareAndSwap(&h->meta, meta, meta | kClockMask);
+  }
+}
+
+void ClockCache::Unref(ClockHandle* h) {
+  const uintptr_t meta = FetchAdd(&h->meta, 0 - kOneRef);
+  assert(((meta + kOneRef) >> kRefShift) > 0);
+  if (meta == kStateInvisible) {
+    // That was the last reference to an erased entry.  Nobody can take
+    // another one, so the slot is ours.
+    h->meta.NoBarrier_Store(reinterpret_cast<void*>(kStateConstruction));
+    Free(h);
+  }
+}
+
+// REQUIRES: h is in the construction state or detached.
+void ClockCache::Free(ClockHandle* h) {
+  FetchAdd(&usage_, 0 - h->charge);
+  if (h->high_pri) {
+    FetchAdd(&high_pri_usage_, 0 - h->charge);
+  }
+  (*h->deleter)(h->key(), h->value);
+  delete[] h->key_data;
+  if (h->detached) {
+    delete h;
+    return;
+  }
+  const uint32_t mask = length_ - 1;
+  const uint32_t step = Step(h->hash);
+  for (uint32_t pos = h->hash & mask; &slots_[pos] != h;
+       pos = (pos + step) & mask) {
+    FetchAdd(&slots_[pos].displacements, 0 - uintptr_t(1));
+  }
+  h->meta.Release_Store(reinterpret_cast<void*>(kStateEmpty));
+  FetchAdd(&occupancy_, 0 - uintptr_t(1));
+}
+
+// Removes "h" from the table.  The caller holds a reference to it.
+void ClockCache::MakeInvisible(ClockHandle* h) {
+  while (true) {
+    const uintptr_t meta = Load(h->meta);
+    assert((meta & kStateMask) == kStateVisible);
+    const uintptr_t invisible =
+        (meta & ~(kStateMask | kClockMask)) | kStateInvisible;
+    if (CompareAndSwap(&h->meta, meta, invisible)) {
+      return;
+    }
+  }
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  const uint32_t mask = length_ - 1;
+  const uint32_t step = Step(hash);
+  uint32_t pos = hash & mask;
+  for (uint32_t probes = 0; probes < length_; probes++) {
+    ClockHandle* h = &slots_[pos];
+    if (Ref(h)) {
+      if (h->hash == hash && key == h->key()) {
+        Touch(h);
+        return reinterpret_cast<Cache::Handle*>(h);
+      }
+      Unref(h);
+    }
+    if (Load(h->displacements) == 0) {
+      // No entry that hashed before this slot lives beyond it
+      break;
+    }
+    pos = (pos + step) & mask;
+  }
+  return NULL;
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+// Sweeps the clock hand over the table, evicting unreferenced entries
+// whose countdown has run out, until "charge" more fits into the shard
+// and a slot is free, or every entry has been passed enough times to
+// have run out.  HIGH priority entries are left alone while they fit
+// into the high priority pool.
+void ClockCache::EvictLocked(size_t charge) {
+  mutex_.AssertHeld();
+  const uint64_t max_steps = uint64_t(length_) * (kMaxCountdown + 1);
+  for (uint64_t steps = 0;
+       steps < max_steps &&
+           (Load(usage_) + charge > capacity_ ||
+            Load(occupancy_) >= max_occupancy_);
+       steps++) {
+    ClockHandle* h = &slots_[clock_hand_];
+    clock_hand_ = (clock_hand_ + 1) & (length_ - 1);
+    const uintptr_t meta = Load(h->meta);
+    if ((meta & kStateMask) != kStateVisible || (meta >> kRefShift) != 0) {
+      continue;
+    }
+    if (h->high_pri && Load(high_pri_usage_) <= high_pri_pool_capacity_) {
+      continue;
+    }
+    if ((meta & kClockMask) != 0) {
+      CompareAndSwap(&h->meta, meta, meta - (1 << kClockShift));
+    } else if (CompareAndSwap(&h->meta, meta, kStateConstruction)) {
+      Free(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCache::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
+  MutexLock l(&mutex_);
+
+  ClockHandle* old = reinterpret_cast<ClockHandle*>(Lookup(key, hash));
+  if (old != NULL) {
+    MakeInvisible(old);
+    Unref(old);
+  }
+  EvictLocked(charge);
+
+  const uint32_t mask = length_ - 1;
+  const uint32_t step = Step(hash);
+  ClockHandle* e = NULL;
+  if (Load(occupancy_) < length_) {
+    uint32_t pos = hash & mask;
+    for (uint32_t probes = 0; probes < length_; probes++) {
+      if (CompareAndSwap(&slots_[pos].meta, kStateEmpty, kStateConstruction)) {
+        e = &slots_[pos];
+        break;
+      }
+      pos = (pos + step) & mask;
+    }
+  }
+  if (e != NULL) {
+    FetchAdd(&occupancy_, 1);
+    for (uint32_t pos = hash & mask; &slots_[pos] != e;
+         pos = (pos + step) & mask) {
+      FetchAdd(&slots_[pos].displacements, 1);
+    }
+    e->detached = false;
+  } else {
+    // Every slot is taken by a pinned entry; hand out an entry that
+    // lives only as long as the returned handle.
+    e = new ClockHandle;
+    e->displacements.NoBarrier_Store(NULL);
+    e->detached = true;
+  }
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->key_data = new char[key.size() > 0 ? key.size() : 1];
+  memcpy(e->key_data, key.data(), key.size());
+  e->hash = hash;
+  e->high_pri = (priority == Cache::HIGH && high_pri_pool_capacity_ > 0);
+  FetchAdd(&usage_, charge);
+  if (e->high_pri) {
+    FetchAdd(&high_pri_usage_, charge);
+  }
+
+  // Publish the entry with one reference for the returned handle
+  const uintptr_t meta = e->detached ?
+      kStateInvisible :
+      kStateVisible | (kInitialCountdown << kClockShift);
+  e->meta.Release_Store(reinterpret_cast<void*>(meta + kOneRef));
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockHandle* e = reinterpret_cast<ClockHandle*>(Lookup(key, hash));
+  if (e != NULL) {
+    MakeInvisible(e);
+    Unref(e);
+  }
+}
+
 static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+static const int kMaxShardBits = 20;
 
-class ShardedLRUCache : public Cache {
+// A cache split into shards by the top bits of the key hash.  ShardType
+// is a single-shard cache of EntryType handles.
+template <class ShardType, class EntryType>
+class ShardedCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  const int num_shard_bits_;
+  ShardType* shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -277,30 +697,45 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) {
-    return hash >> (32 - kNumShardBits);
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0;
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
-      : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+  ShardedCache(size_t capacity, size_t estimated_entry_charge,
+               int num_shard_bits, double high_pri_pool_ratio)
+      : num_shard_bits_(num_shard_bits < 0 ? 0 :
+                        num_shard_bits > kMaxShardBits ? kMaxShardBits :
+                        num_shard_bits),
+        last_id_(0) {
+    const int num_shards = 1 << num_shard_bits_;
+    shard_ = new ShardType[num_shards];
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    for (int s = 0; s < num_shards; s++) {
+      shard_[s].SetCapacity(per_shard, estimated_entry_charge,
+                            high_pri_pool_ratio);
     }
   }
-  virtual ~ShardedLRUCache() { }
+  virtual ~ShardedCache() {
+    delete[] shard_;
+  }
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, LOW);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   virtual Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
     return shard_[Shard(hash)].Lookup(key, hash);
   }
   virtual void Release(Handle* handle) {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
+    EntryType* h = reinterpret_cast<EntryType*>(handle);
     shard_[Shard(h->hash)].Release(handle);
   }
   virtual void Erase(const Slice& key) {
@@ -308,18 +743,46 @@ class ShardedLRUCache : public Cache {
     shard_[Shard(hash)].Erase(key, hash);
   }
   virtual void* Value(Handle* handle) {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+    return reinterpret_cast<EntryType*>(handle)->value;
   }
   virtual uint64_t NewId() {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
+  virtual size_t TotalCharge() const {
+    size_t total = 0;
+    for (int s = 0; s < (1 << num_shard_bits_); s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
 };
 
 }  // end anonymous namespace
 
 Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+  return NewLRUCache(capacity, kNumShardBits);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  return NewLRUCache(capacity, num_shard_bits, 0.0);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                   double high_pri_pool_ratio) {
+  return new ShardedCache<LRUCache, LRUHandle>(
+      capacity, 0, num_shard_bits, high_pri_pool_ratio);
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                     int num_shard_bits) {
+  return NewClockCache(capacity, estimated_entry_charge, num_shard_bits, 0.0);
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                     int num_shard_bits, double high_pri_pool_ratio) {
+  return new ShardedCache<ClockCache, ClockHandle>(
+      capacity, estimated_entry_charge, num_shard_bits, high_pri_pool_ratio);
 }
 
 }  // namespace leveldb
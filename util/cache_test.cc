@@ -5,7 +5,11 @@
 #include "leveldb/cache.h"
 
 #include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -35,12 +39,21 @@ class CacheTest {
   static const int kCacheSize = 1000;
   std::vector<int> deleted_keys_;
   std::vector<int> deleted_values_;
+  const bool clock_;  // Test the CLOCK cache instead of the LRU one
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) {
+  explicit CacheTest(bool clock = false)
+      : clock_(clock), cache_(NewCache(kCacheSize, 4)) {
     current_ = this;
   }
 
+  Cache* NewCache(size_t capacity, int num_shard_bits,
+                  double high_pri_pool_ratio = 0.0) {
+    return clock_ ? NewClockCache(capacity, 1, num_shard_bits,
+                                  high_pri_pool_ratio)
+                  : NewLRUCache(capacity, num_shard_bits, high_pri_pool_ratio);
+  }
+
   ~CacheTest() {
     delete cache_;
   }
@@ -62,10 +75,29 @@ class CacheTest {
   void Erase(int key) {
     cache_->Erase(EncodeKey(key));
   }
+
+  // The checks every kind of cache must pass
+  void CheckHitAndMiss();
+  void CheckErase();
+  void CheckEntriesArePinned();
+  void CheckEvictionPolicy();
+  void CheckHeavyEntries();
+  void CheckNewId();
+  void CheckShardBits();
+  void CheckPinnedEntriesOverflowTable();
+  void CheckHighPriorityPool();
+  void CheckTotalCharge();
+  void CheckConcurrentAccess();
 };
 CacheTest* CacheTest::current_;
 
-TEST(CacheTest, HitAndMiss) {
+// Runs the checks of CacheTest against the CLOCK cache
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() : CacheTest(true) { }
+};
+
+void CacheTest::CheckHitAndMiss() {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -87,8 +119,10 @@ TEST(CacheTest, HitAndMiss) {
   ASSERT_EQ(100, deleted_keys_[0]);
   ASSERT_EQ(101, deleted_values_[0]);
 }
+TEST(CacheTest, HitAndMiss) { CheckHitAndMiss(); }
+TEST(ClockCacheTest, ClockHitAndMiss) { CheckHitAndMiss(); }
 
-TEST(CacheTest, Erase) {
+void CacheTest::CheckErase() {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,8 +140,10 @@ TEST(CacheTest, Erase) {
   ASSERT_EQ(201, Lookup(200));
   ASSERT_EQ(1, deleted_keys_.size());
 }
+TEST(CacheTest, Erase) { CheckErase(); }
+TEST(ClockCacheTest, ClockErase) { CheckErase(); }
 
-TEST(CacheTest, EntriesArePinned) {
+void CacheTest::CheckEntriesArePinned() {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,8 +167,10 @@ TEST(CacheTest, EntriesArePinned) {
   ASSERT_EQ(100, deleted_keys_[1]);
   ASSERT_EQ(102, deleted_values_[1]);
 }
+TEST(CacheTest, EntriesArePinned) { CheckEntriesArePinned(); }
+TEST(ClockCacheTest, ClockEntriesArePinned) { CheckEntriesArePinned(); }
 
-TEST(CacheTest, EvictionPolicy) {
+void CacheTest::CheckEvictionPolicy() {
   Insert(100, 101);
   Insert(200, 201);
 
@@ -145,8 +183,10 @@ TEST(CacheTest, EvictionPolicy) {
   ASSERT_EQ(101, Lookup(100));
   ASSERT_EQ(-1, Lookup(200));
 }
+TEST(CacheTest, EvictionPolicy) { CheckEvictionPolicy(); }
+TEST(ClockCacheTest, ClockEvictionPolicy) { CheckEvictionPolicy(); }
 
-TEST(CacheTest, HeavyEntries) {
+void CacheTest::CheckHeavyEntries() {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -172,12 +212,175 @@ TEST(CacheTest, HeavyEntries) {
   }
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
 }
+TEST(CacheTest, HeavyEntries) { CheckHeavyEntries(); }
+TEST(ClockCacheTest, ClockHeavyEntries) { CheckHeavyEntries(); }
 
-TEST(CacheTest, NewId) {
+void CacheTest::CheckNewId() {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
+TEST(CacheTest, NewId) { CheckNewId(); }
+TEST(ClockCacheTest, ClockNewId) { CheckNewId(); }
+
+void CacheTest::CheckShardBits() {
+  for (int bits = -1; bits <= 8; bits++) {
+    Cache* cache = NewCache(kCacheSize, bits);
+    for (int i = 0; i < 100; i++) {
+      cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i + 1000), 1,
+                                   &CacheTest::Deleter));
+    }
+    for (int i = 0; i < 100; i++) {
+      Cache::Handle* h = cache->Lookup(EncodeKey(i));
+      ASSERT_TRUE(h != NULL);
+      ASSERT_EQ(i + 1000, DecodeValue(cache->Value(h)));
+      cache->Release(h);
+    }
+    delete cache;
+  }
+}
+TEST(CacheTest, ShardBits) { CheckShardBits(); }
+TEST(ClockCacheTest, ClockShardBits) { CheckShardBits(); }
+
+void CacheTest::CheckPinnedEntriesOverflowTable() {
+  // A table sized for few entries still hands out every inserted entry
+  Cache* cache = NewCache(16, 0);
+  std::vector<Cache::Handle*> handles;
+  for (int i = 0; i < 100; i++) {
+    handles.push_back(cache->Insert(EncodeKey(i), EncodeValue(i + 1000), 1,
+                                    &CacheTest::Deleter));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(i + 1000, DecodeValue(cache->Value(handles[i])));
+  }
+  ASSERT_EQ(0, deleted_keys_.size());
+  for (int i = 0; i < 100; i++) {
+    cache->Release(handles[i]);
+  }
+  delete cache;
+  ASSERT_EQ(100, deleted_keys_.size());
+}
+TEST(CacheTest, PinnedEntriesOverflowTable) { CheckPinnedEntriesOverflowTable(); }
+TEST(ClockCacheTest, ClockPinnedEntriesOverflowTable) { CheckPinnedEntriesOverflowTable(); }
+
+void CacheTest::CheckHighPriorityPool() {
+  // High priority entries that fit into their pool outlive a stream of
+  // low priority ones; the entries beyond the pool age as usual.
+  Cache* cache = NewCache(100, 0, 0.2);
+  for (int i = 0; i < 30; i++) {
+    cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i + 1000), 1,
+                                 &CacheTest::Deleter, Cache::HIGH));
+  }
+  for (int i = 100; i < 400; i++) {
+    cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i + 1000), 1,
+                                 &CacheTest::Deleter, Cache::LOW));
+  }
+  int high_pri_cached = 0;
+  for (int i = 0; i < 30; i++) {
+    Cache::Handle* h = cache->Lookup(EncodeKey(i));
+    if (h != NULL) {
+      high_pri_cached++;
+      cache->Release(h);
+    }
+  }
+  ASSERT_GE(high_pri_cached, 20);
+  ASSERT_LT(high_pri_cached, 30);
+  ASSERT_LE(cache->TotalCharge(), 100);
+  delete cache;
+}
+TEST(CacheTest, HighPriorityPool) { CheckHighPriorityPool(); }
+TEST(ClockCacheTest, ClockHighPriorityPool) { CheckHighPriorityPool(); }
+
+void CacheTest::CheckTotalCharge() {
+  ASSERT_EQ(0, cache_->TotalCharge());
+  Insert(100, 101, 10);
+  Insert(200, 201, 20);
+  ASSERT_EQ(30, cache_->TotalCharge());
+  Cache::Handle* h = cache_->Lookup(EncodeKey(100));
+  Erase(100);
+  ASSERT_EQ(30, cache_->TotalCharge());  // Still referenced
+  cache_->Release(h);
+  ASSERT_EQ(20, cache_->TotalCharge());
+}
+TEST(CacheTest, TotalCharge) { CheckTotalCharge(); }
+TEST(ClockCacheTest, ClockTotalCharge) { CheckTotalCharge(); }
+
+namespace {
+
+struct ConcurrentState {
+  Cache* cache;
+  port::Mutex mu;
+  int started;             // Guarded by mu
+  int remaining;           // Guarded by mu
+  port::AtomicPointer errors;
+};
+
+const int kConcurrentKeys = 200;
+const int kConcurrentOps = 20000;
+
+void NoopDeleter(const Slice& key, void* v) {
+}
+
+void ConcurrentWorker(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  Cache* cache = state->cache;
+  uint32_t seed;
+  {
+    MutexLock l(&state->mu);
+    seed = 301 + state->started++;
+  }
+  Random rnd(seed);
+  for (int i = 0; i < kConcurrentOps; i++) {
+    const int k = rnd.Uniform(kConcurrentKeys);
+    const std::string key = EncodeKey(k);
+    Cache::Handle* h = NULL;
+    switch (rnd.Uniform(8)) {
+      case 0:
+        cache->Erase(key);
+        break;
+      case 1:
+        h = cache->Insert(key, EncodeValue(k), 1, &NoopDeleter);
+        break;
+      default:
+        h = cache->Lookup(key);
+        break;
+    }
+    if (h != NULL) {
+      if (DecodeValue(cache->Value(h)) != k) {
+        state->errors.Release_Store(state);
+      }
+      cache->Release(h);
+    }
+  }
+  MutexLock l(&state->mu);
+  state->remaining--;
+}
+
+}  // namespace
+
+void CacheTest::CheckConcurrentAccess() {
+  // Lookups, inserts and erases of the same keys from several threads
+  // must always see the value that belongs to the key
+  ConcurrentState state;
+  state.cache = NewCache(kConcurrentKeys / 2, 4);
+  state.started = 0;
+  state.remaining = 4;
+  state.errors.Release_Store(NULL);
+  for (int i = 0; i < 4; i++) {
+    Env::Default()->StartThread(&ConcurrentWorker, &state);
+  }
+  while (true) {
+    {
+      MutexLock l(&state.mu);
+      if (state.remaining == 0) break;
+    }
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(state.errors.Acquire_Load() == NULL);
+  delete state.cache;
+}
+TEST(CacheTest, ConcurrentAccess) { CheckConcurrentAccess(); }
+TEST(ClockCacheTest, ClockConcurrentAccess) { CheckConcurrentAccess(); }
 
 }  // namespace leveldb
 
@@ -3,13 +3,29 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 //
 // A portable implementation of crc32c, optimized to handle
-// four bytes at a time.
+// four bytes at a time, and an implementation on top of the SSE4.2
+// crc32 instruction that Extend() picks at runtime when the CPU has it.
 
 #include "util/crc32c.h"
 
 #include <stdint.h>
 #include "util/coding.h"
 
+#if defined(_M_X64) || defined(_M_IX86) || \
+    defined(__x86_64__) || defined(__i386__)
+#define LEVELDB_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define LEVELDB_CRC32C_TARGET
+#else
+#include <cpuid.h>
+// Lets the compiler emit crc32 in these functions only, so the rest of
+// the library still runs on CPUs without SSE4.2.
+#define LEVELDB_CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#endif
+
 namespace leveldb {
 namespace crc32c {
 
@@ -283,7 +299,7 @@ static inline uint32_t LE_LOAD32(const uint8_t *p) {
   return DecodeFixed32(reinterpret_cast<const char*>(p));
 }
 
-uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+uint32_t ExtendPortable(uint32_t crc, const char* buf, size_t size) {
   const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
   const uint8_t *e = p + size;
   uint32_t l = crc ^ 0xffffffffu;
@@ -328,5 +344,197 @@ uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
   return l ^ 0xffffffffu;
 }
 
+#if defined(LEVELDB_CRC32C_SSE42)
+
+// Buffers of at least 3*kLongBlock (3*kShortBlock) bytes are split
+// into three streams of kLongBlock (kShortBlock) bytes whose crc32
+// instructions do not depend on each other, so the CPU overlaps them
+// instead of waiting out the latency of each one.  The three partial
+// crcs are then combined by shifting the first ones over the bytes
+// that follow them, which the zeros tables below do a byte at a time.
+static const size_t kLongBlock = 8192;
+static const size_t kShortBlock = 256;
+
+static uint32_t long_zeros_[4][256];
+static uint32_t short_zeros_[4][256];
+
+// Multiplies the 32x32 matrix mat over GF(2) by the vector vec.
+static uint32_t GF2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec != 0) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void GF2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = GF2MatrixTimes(mat, mat[n]);
+  }
+}
+
+// Stores in op the matrix that advances a crc register over len zero
+// bytes.  REQUIRES: len > 0.
+static void ZerosOperator(uint32_t* op, size_t len) {
+  // odd is the operator for a single zero bit: shift right and reduce
+  // by the reflected Castagnoli polynomial.
+  uint32_t odd[32];
+  odd[0] = 0x82f63b78u;
+  uint32_t row = 1;
+  for (int n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  GF2MatrixSquare(op, odd);   // two zero bits
+  GF2MatrixSquare(odd, op);   // four zero bits
+
+  // Square once per bit of len, starting from eight zero bits.
+  while (true) {
+    GF2MatrixSquare(op, odd);
+    len >>= 1;
+    if (len == 0) {
+      return;
+    }
+    GF2MatrixSquare(odd, op);
+    len >>= 1;
+    if (len == 0) {
+      break;
+    }
+  }
+  for (int n = 0; n < 32; n++) {
+    op[n] = odd[n];
+  }
+}
+
+// Fills zeros so that Shift(zeros, crc) advances crc over len zero bytes.
+// len must be a power of two, which is all the block sizes above need.
+static void BuildZerosTable(uint32_t zeros[4][256], size_t len) {
+  uint32_t op[32];
+  ZerosOperator(op, len);
+  for (uint32_t n = 0; n < 256; n++) {
+    zeros[0][n] = GF2MatrixTimes(op, n);
+    zeros[1][n] = GF2MatrixTimes(op, n << 8);
+    zeros[2][n] = GF2MatrixTimes(op, n << 16);
+    zeros[3][n] = GF2MatrixTimes(op, n << 24);
+  }
+}
+
+static inline uint32_t Shift(const uint32_t zeros[4][256], uint32_t crc) {
+  return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+         zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+#if defined(_M_X64) || defined(__x86_64__)
+typedef uint64_t CrcWord;
+#define CRC32C_WORD(crc, p) static_cast<uint32_t>( \
+    _mm_crc32_u64((crc), *reinterpret_cast<const uint64_t*>(p)))
+#else
+typedef uint32_t CrcWord;
+#define CRC32C_WORD(crc, p) \
+    _mm_crc32_u32((crc), *reinterpret_cast<const uint32_t*>(p))
+#endif
+
+// Runs the three streams of block bytes each, starting at p, and
+// returns crc extended over all 3*block bytes.
+LEVELDB_CRC32C_TARGET
+static inline uint32_t ExtendThreeWay(uint32_t crc, const uint8_t* p,
+                                      size_t block,
+                                      const uint32_t zeros[4][256]) {
+  uint32_t crc1 = 0;
+  uint32_t crc2 = 0;
+  const uint8_t* end = p + block;
+  do {
+    crc = CRC32C_WORD(crc, p);
+    crc1 = CRC32C_WORD(crc1, p + block);
+    crc2 = CRC32C_WORD(crc2, p + 2 * block);
+    p += sizeof(CrcWord);
+  } while (p < end);
+  crc = Shift(zeros, crc) ^ crc1;
+  return Shift(zeros, crc) ^ crc2;
+}
+
+LEVELDB_CRC32C_TARGET
+uint32_t ExtendHardware(uint32_t crc, const char* buf, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  uint32_t l = crc ^ 0xffffffffu;
+
+  // Process bytes until p is word aligned
+  while (size > 0 &&
+         (reinterpret_cast<uintptr_t>(p) & (sizeof(CrcWord) - 1)) != 0) {
+    l = _mm_crc32_u8(l, *p++);
+    size--;
+  }
+  while (size >= 3 * kLongBlock) {
+    l = ExtendThreeWay(l, p, kLongBlock, long_zeros_);
+    p += 3 * kLongBlock;
+    size -= 3 * kLongBlock;
+  }
+  while (size >= 3 * kShortBlock) {
+    l = ExtendThreeWay(l, p, kShortBlock, short_zeros_);
+    p += 3 * kShortBlock;
+    size -= 3 * kShortBlock;
+  }
+  // Process the remaining words, then the last few bytes
+  while (size >= sizeof(CrcWord)) {
+    l = CRC32C_WORD(l, p);
+    p += sizeof(CrcWord);
+    size -= sizeof(CrcWord);
+  }
+  while (size > 0) {
+    l = _mm_crc32_u8(l, *p++);
+    size--;
+  }
+  return l ^ 0xffffffffu;
+}
+
+#undef CRC32C_WORD
+
+static bool CpuHasSse42() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+static bool InitHardware() {
+  BuildZerosTable(long_zeros_, kLongBlock);
+  BuildZerosTable(short_zeros_, kShortBlock);
+  return CpuHasSse42();
+}
+
+#else
+
+uint32_t ExtendHardware(uint32_t crc, const char* buf, size_t size) {
+  return ExtendPortable(crc, buf, size);
+}
+
+static bool InitHardware() {
+  return false;
+}
+
+#endif  // defined(LEVELDB_CRC32C_SSE42)
+
+// Decided once while the library is loaded.  Until then (i.e. from
+// other static initializers) Extend() sees false and safely uses the
+// portable code.
+static const bool use_hardware_ = InitHardware();
+
+bool IsHardwareAccelerated() {
+  return use_hardware_;
+}
+
+uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+  return use_hardware_ ? ExtendHardware(crc, buf, size)
+                       : ExtendPortable(crc, buf, size);
+}
+
 }  // namespace crc32c
 }  // namespace leveldb
@@ -16,6 +16,16 @@ namespace crc32c {
 // crc32c of a stream of data.
 extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// Returns true if Extend() runs on the SSE4.2 crc32 instruction, which
+// it uses whenever the CPU supports it.
+extern bool IsHardwareAccelerated();
+
+// The two implementations Extend() chooses between.  Exposed so tests
+// and benchmarks can run each of them directly.
+// REQUIRES: IsHardwareAccelerated() for ExtendHardware().
+extern uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+extern uint32_t ExtendHardware(uint32_t init_crc, const char* data, size_t n);
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) {
   return Extend(0, data, n);
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "util/crc32c.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -56,6 +57,42 @@ TEST(CRC, Extend) {
             Extend(Value("hello ", 6), "world", 5));
 }
 
+TEST(CRC, Implementations) {
+  // Both implementations must match the reference results above.
+  char buf[32];
+  memset(buf, 0xff, sizeof(buf));
+  ASSERT_EQ(0x62a8ab43, ExtendPortable(0, buf, sizeof(buf)));
+  for (int i = 0; i < 32; i++) {
+    buf[i] = i;
+  }
+  ASSERT_EQ(0x46dd794e, ExtendPortable(0, buf, sizeof(buf)));
+  if (!IsHardwareAccelerated()) {
+    fprintf(stderr, "skipping hardware crc32c: not supported by this CPU\n");
+    return;
+  }
+  ASSERT_EQ(0x46dd794e, ExtendHardware(0, buf, sizeof(buf)));
+  memset(buf, 0xff, sizeof(buf));
+  ASSERT_EQ(0x62a8ab43, ExtendHardware(0, buf, sizeof(buf)));
+
+  // Cover every alignment and the three-way paths for short and long
+  // blocks, which start at 768 and 24576 bytes.
+  Random rnd(301);
+  std::string data;
+  for (int i = 0; i < 100000; i++) {
+    data.push_back(static_cast<char>(rnd.Uniform(256)));
+  }
+  const size_t sizes[] = { 0, 1, 7, 8, 9, 100, 767, 768, 769, 1000, 4096,
+                           24575, 24576, 24577, 60000, 99990 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (size_t offset = 0; offset < 9; offset++) {
+      const char* p = data.data() + offset;
+      const uint32_t init = rnd.Next();
+      ASSERT_EQ(ExtendPortable(init, p, sizes[i]),
+                ExtendHardware(init, p, sizes[i]));
+    }
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
@@ -9,6 +9,25 @@ namespace leveldb {
 Env::~Env() {
 }
 
+void Env::Schedule(void (*function)(void*), void* arg, Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number, Priority pri) {
+}
+
+int Env::GetBackgroundThreads(Priority pri) {
+  return 0;
+}
+
+int Env::GetThreadPoolQueueLen(Priority pri) {
+  return 0;
+}
+
+int Env::GetThreadPoolActiveThreads(Priority pri) {
+  return 0;
+}
+
 SequentialFile::~SequentialFile() {
 }
 
@@ -2,7 +2,6 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
-#include <deque>
 #include <set>
 #include <dirent.h>
 #include <errno.h>
@@ -26,6 +25,7 @@
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/posix_logger.h"
+#include "util/thread_pool.h"
 
 namespace leveldb {
 
@@ -538,7 +538,29 @@ class PosixEnv : public Env {
     return result;
   }
 
-  virtual void Schedule(void (*function)(void*), void* arg);
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    Schedule(function, arg, LOW);
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg, Priority pri) {
+    pools_[pri]->Schedule(function, arg);
+  }
+
+  virtual void SetBackgroundThreads(int number, Priority pri) {
+    pools_[pri]->SetThreads(number);
+  }
+
+  virtual int GetBackgroundThreads(Priority pri) {
+    return pools_[pri]->Threads();
+  }
+
+  virtual int GetThreadPoolQueueLen(Priority pri) {
+    return pools_[pri]->QueueLength();
+  }
+
+  virtual int GetThreadPoolActiveThreads(Priority pri) {
+    return pools_[pri]->ActiveThreads();
+  }
 
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
@@ -592,74 +614,20 @@ class PosixEnv : public Env {
     }
   }
 
-  // BGThread() is the body of the background thread
-  void BGThread();
-  static void* BGThreadWrapper(void* arg) {
-    reinterpret_cast<PosixEnv*>(arg)->BGThread();
-    return NULL;
-  }
-
   size_t page_size_;
-  pthread_mutex_t mu_;
-  pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
 
-  // Entry per Schedule() call
-  struct BGItem { void* arg; void (*function)(void*); };
-  typedef std::deque<BGItem> BGQueue;
-  BGQueue queue_;
+  // Background threads, indexed by Priority
+  ThreadPool* pools_[2];
 
   PosixLockTable locks_;
   MmapLimiter mmap_limit_;
 };
 
-PosixEnv::PosixEnv() : page_size_(getpagesize()),
-                       started_bgthread_(false) {
-  PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
-  PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
-}
-
-void PosixEnv::Schedule(void (*function)(void*), void* arg) {
-  PthreadCall("lock", pthread_mutex_lock(&mu_));
-
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
-    PthreadCall(
-        "create thread",
-        pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
-  }
-
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
-  }
-
-  // Add to priority queue
-  queue_.push_back(BGItem());
-  queue_.back().function = function;
-  queue_.back().arg = arg;
-
-  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
-}
-
-void PosixEnv::BGThread() {
-  while (true) {
-    // Wait until there is an item that is ready to run
-    PthreadCall("lock", pthread_mutex_lock(&mu_));
-    while (queue_.empty()) {
-      PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
-    }
-
-    void (*function)(void*) = queue_.front().function;
-    void* arg = queue_.front().arg;
-    queue_.pop_front();
-
-    PthreadCall("unlock", pthread_mutex_unlock(&mu_));
-    (*function)(arg);
-  }
+PosixEnv::PosixEnv() : page_size_(getpagesize()) {
+  // One thread for each pool by default: compactions run one at a time
+  // and memtable flushes do not wait for them.
+  pools_[LOW] = new ThreadPool(this, 1);
+  pools_[HIGH] = new ThreadPool(this, 1);
 }
 
 namespace {
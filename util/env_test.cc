@@ -64,6 +64,77 @@ TEST(EnvPosixTest, RunMany) {
   ASSERT_EQ(4, reinterpret_cast<uintptr_t>(cur));
 }
 
+// Blocks the thread running it until "released" is set.
+struct Sleeper {
+  port::AtomicPointer started;
+  port::AtomicPointer released;
+
+  Sleeper() : started(NULL), released(NULL) { }
+
+  static void Run(void* v) {
+    Sleeper* s = reinterpret_cast<Sleeper*>(v);
+    s->started.Release_Store(s);
+    while (s->released.Acquire_Load() == NULL) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+  }
+};
+
+TEST(EnvPosixTest, HighPriorityRunsWhileLowIsBusy) {
+  ASSERT_EQ(1, env_->GetBackgroundThreads(Env::LOW));
+  Sleeper sleeper;
+  env_->Schedule(&Sleeper::Run, &sleeper, Env::LOW);
+  port::AtomicPointer low_called(NULL);
+  env_->Schedule(&SetBool, &low_called, Env::LOW);
+  port::AtomicPointer high_called(NULL);
+  env_->Schedule(&SetBool, &high_called, Env::HIGH);
+
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(sleeper.started.Acquire_Load() != NULL);
+  ASSERT_TRUE(high_called.NoBarrier_Load() != NULL);
+  ASSERT_TRUE(low_called.NoBarrier_Load() == NULL);
+  ASSERT_EQ(1, env_->GetThreadPoolActiveThreads(Env::LOW));
+  ASSERT_EQ(1, env_->GetThreadPoolQueueLen(Env::LOW));
+  ASSERT_EQ(0, env_->GetThreadPoolActiveThreads(Env::HIGH));
+  ASSERT_EQ(0, env_->GetThreadPoolQueueLen(Env::HIGH));
+
+  sleeper.released.Release_Store(&sleeper);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(low_called.NoBarrier_Load() != NULL);
+  ASSERT_EQ(0, env_->GetThreadPoolActiveThreads(Env::LOW));
+  ASSERT_EQ(0, env_->GetThreadPoolQueueLen(Env::LOW));
+}
+
+TEST(EnvPosixTest, SetBackgroundThreads) {
+  Sleeper sleepers[3];
+  env_->SetBackgroundThreads(3, Env::LOW);
+  ASSERT_EQ(3, env_->GetBackgroundThreads(Env::LOW));
+  for (int i = 0; i < 3; i++) {
+    env_->Schedule(&Sleeper::Run, &sleepers[i], Env::LOW);
+  }
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_EQ(3, env_->GetThreadPoolActiveThreads(Env::LOW));
+  ASSERT_EQ(0, env_->GetThreadPoolQueueLen(Env::LOW));
+
+  // Shrinking the pool lets the running jobs finish and leaves a single
+  // thread for the next ones.
+  env_->SetBackgroundThreads(1, Env::LOW);
+  ASSERT_EQ(1, env_->GetBackgroundThreads(Env::LOW));
+  for (int i = 0; i < 3; i++) {
+    sleepers[i].released.Release_Store(&sleepers[i]);
+  }
+  Sleeper again[2];
+  env_->Schedule(&Sleeper::Run, &again[0], Env::LOW);
+  env_->Schedule(&Sleeper::Run, &again[1], Env::LOW);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_EQ(1, env_->GetThreadPoolActiveThreads(Env::LOW));
+  ASSERT_EQ(1, env_->GetThreadPoolQueueLen(Env::LOW));
+  again[0].released.Release_Store(&again[0]);
+  again[1].released.Release_Store(&again[1]);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_EQ(0, env_->GetThreadPoolActiveThreads(Env::LOW));
+}
+
 struct State {
   port::Mutex mu;
   int val;
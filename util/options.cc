@@ -17,12 +17,29 @@ Options::Options()
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      max_write_buffer_number(2),
+      merge_write_buffers(false),
+      level0_slowdown_writes_trigger(8),
+      level0_stop_writes_trigger(12),
+      soft_pending_compaction_bytes_limit(64ull << 30),
+      hard_pending_compaction_bytes_limit(256ull << 30),
+      delayed_write_rate(16 << 20),
       max_open_files(1000),
+      max_subcompactions(1),
+      max_background_compactions(1),
+      max_background_flushes(1),
+      allow_concurrent_memtable_write(true),
+      enable_pipelined_write(false),
       block_cache(NULL),
+      cache_index_and_filter_blocks(false),
       block_size(4096),
       block_restart_interval(16),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      whole_table_filter(false),
+      prefix_extractor(NULL),
+      partition_index_and_filters(false),
+      metadata_block_size(4096) {
 }
 
 
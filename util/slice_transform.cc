@@ -0,0 +1,90 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/slice_transform.h"
+
+#include <string>
+#include "leveldb/slice.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+SliceTransform::~SliceTransform() { }
+
+namespace {
+class FixedPrefixTransform : public SliceTransform {
+ private:
+  size_t prefix_len_;
+  std::string name_;
+
+ public:
+  explicit FixedPrefixTransform(size_t prefix_len)
+      : prefix_len_(prefix_len) {
+    name_ = "leveldb.FixedPrefix.";
+    AppendNumberTo(&name_, prefix_len);
+  }
+
+  virtual const char* Name() const {
+    return name_.c_str();
+  }
+
+  virtual Slice Transform(const Slice& key) const {
+    return Slice(key.data(), prefix_len_);
+  }
+
+  virtual bool InDomain(const Slice& key) const {
+    return key.size() >= prefix_len_;
+  }
+};
+
+class DelimitedPrefixTransform : public SliceTransform {
+ private:
+  char delimiter_;
+  int n_;
+  std::string name_;
+
+  // Returns the length of the prefix of key, or 0 if it has none
+  size_t PrefixLength(const Slice& key) const {
+    int found = 0;
+    for (size_t i = 0; i < key.size(); i++) {
+      if (key[i] == delimiter_ && ++found == n_) {
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+
+ public:
+  DelimitedPrefixTransform(char delimiter, int n)
+      : delimiter_(delimiter),
+        n_(n) {
+    name_ = "leveldb.DelimitedPrefix.";
+    AppendNumberTo(&name_, static_cast<unsigned char>(delimiter));
+    name_.push_back('.');
+    AppendNumberTo(&name_, n);
+  }
+
+  virtual const char* Name() const {
+    return name_.c_str();
+  }
+
+  virtual Slice Transform(const Slice& key) const {
+    return Slice(key.data(), PrefixLength(key));
+  }
+
+  virtual bool InDomain(const Slice& key) const {
+    return n_ > 0 && PrefixLength(key) > 0;
+  }
+};
+}
+
+const SliceTransform* NewFixedPrefixTransform(size_t prefix_len) {
+  return new FixedPrefixTransform(prefix_len);
+}
+
+const SliceTransform* NewDelimitedPrefixTransform(char delimiter, int n) {
+  return new DelimitedPrefixTransform(delimiter, n);
+}
+
+}  // namespace leveldb
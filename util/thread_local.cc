@@ -0,0 +1,176 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// The slots of one thread, indexed by ThreadLocalPtr id.  Only the
+// thread itself resizes entries, and only while holding the global
+// mutex, so other threads may reach them under the mutex.
+struct ThreadData {
+  std::vector<port::AtomicPointer> entries;
+  ThreadData* next;
+  ThreadData* prev;
+};
+
+static void* Exchange(port::AtomicPointer* slot, void* ptr) {
+  void* old;
+  do {
+    old = slot->Acquire_Load();
+  } while (!slot->CompareAndSwap(old, ptr));
+  return old;
+}
+
+class StaticMeta {
+ public:
+  StaticMeta() : next_id_(0) {
+    head_.next = &head_;
+    head_.prev = &head_;
+    port::NewThreadKey(&key_, &OnThreadExit);
+  }
+
+  uint32_t NewId(ThreadLocalPtr::UnrefHandler handler) {
+    MutexLock l(&mu_);
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else {
+      id = next_id_++;
+      handlers_.resize(next_id_);
+    }
+    handlers_[id] = handler;
+    return id;
+  }
+
+  void ReclaimId(uint32_t id) {
+    MutexLock l(&mu_);
+    ThreadLocalPtr::UnrefHandler handler = handlers_[id];
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        void* ptr = Exchange(&t->entries[id], NULL);
+        if (ptr != NULL && handler != NULL) {
+          (*handler)(ptr);
+        }
+      }
+    }
+    handlers_[id] = NULL;
+    free_ids_.push_back(id);
+  }
+
+  // Return the slot "id" of the calling thread.
+  port::AtomicPointer* Slot(uint32_t id) {
+    ThreadData* t = reinterpret_cast<ThreadData*>(port::GetThreadValue(key_));
+    if (t == NULL || id >= t->entries.size()) {
+      t = Register(t);
+    }
+    return &t->entries[id];
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement) {
+    MutexLock l(&mu_);
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        void* ptr = Exchange(&t->entries[id], replacement);
+        if (ptr != NULL) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+ private:
+  // Create the slots of the calling thread, or grow them to cover every
+  // id handed out so far.
+  ThreadData* Register(ThreadData* t) {
+    MutexLock l(&mu_);
+    if (t == NULL) {
+      t = new ThreadData;
+      t->next = &head_;
+      t->prev = head_.prev;
+      head_.prev->next = t;
+      head_.prev = t;
+      port::SetThreadValue(key_, t);
+    }
+    t->entries.resize(next_id_, port::AtomicPointer(NULL));
+    return t;
+  }
+
+  static void OnThreadExit(void* arg);
+
+  port::Mutex mu_;
+  ThreadData head_;              // Circular list of the threads with slots
+  uint32_t next_id_;
+  std::vector<uint32_t> free_ids_;
+  std::vector<ThreadLocalPtr::UnrefHandler> handlers_;
+  port::ThreadKey key_;
+};
+
+// Never deleted: threads may still exit after static destructors ran.
+static StaticMeta* meta = NULL;
+static port::OnceType meta_once = LEVELDB_ONCE_INIT;
+
+static void InitMeta() {
+  meta = new StaticMeta;
+}
+
+static StaticMeta* Meta() {
+  port::InitOnce(&meta_once, &InitMeta);
+  return meta;
+}
+
+void StaticMeta::OnThreadExit(void* arg) {
+  ThreadData* t = reinterpret_cast<ThreadData*>(arg);
+  StaticMeta* m = Meta();
+  {
+    MutexLock l(&m->mu_);
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    for (size_t id = 0; id < t->entries.size(); id++) {
+      void* ptr = t->entries[id].NoBarrier_Load();
+      if (ptr != NULL && m->handlers_[id] != NULL) {
+        (*m->handlers_[id])(ptr);
+      }
+    }
+  }
+  delete t;
+}
+
+}  // namespace
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(Meta()->NewId(handler)) {
+}
+
+ThreadLocalPtr::~ThreadLocalPtr() {
+  Meta()->ReclaimId(id_);
+}
+
+void* ThreadLocalPtr::Get() const {
+  return Meta()->Slot(id_)->Acquire_Load();
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  Meta()->Slot(id_)->Release_Store(ptr);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Exchange(Meta()->Slot(id_), ptr);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* expected, void* ptr) {
+  return Meta()->Slot(id_)->CompareAndSwap(expected, ptr);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Meta()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
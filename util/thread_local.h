@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A ThreadLocalPtr holds one pointer per thread.  Unlike a thread-local
+// variable it is an object, so every DB can have its own, and its owner
+// can take back the pointers of all threads at once with Scrape().
+//
+// All ThreadLocalPtrs share a single platform thread key and a global
+// mutex.  Get(), Reset(), Swap() and CompareAndSwap() only touch the
+// calling thread's slot and do not lock, except the first time a thread
+// uses a ThreadLocalPtr.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace leveldb {
+
+class ThreadLocalPtr {
+ public:
+  // Called with a thread's pointer when the thread exits and when the
+  // ThreadLocalPtr is destroyed, unless the pointer is NULL.  Runs while
+  // the global mutex is held, so it must not block on other threads.
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = NULL);
+  ~ThreadLocalPtr();
+
+  // Return the pointer of the calling thread, NULL if it has not set one.
+  void* Get() const;
+
+  // Set the pointer of the calling thread.
+  void Reset(void* ptr);
+
+  // Set the pointer of the calling thread and return its old value.
+  void* Swap(void* ptr);
+
+  // Set the pointer of the calling thread to "ptr" iff it is "expected"
+  // and return whether it did.  Fails if another thread has replaced the
+  // pointer through Scrape() since the caller last set it.
+  bool CompareAndSwap(void* expected, void* ptr);
+
+  // Replace the pointers of all threads with "replacement" and append
+  // the old ones that were not NULL to *ptrs.  The UnrefHandler is not
+  // called for them: they are the caller's now.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  const uint32_t id_;
+
+  // No copying allowed
+  ThreadLocalPtr(const ThreadLocalPtr&);
+  void operator=(const ThreadLocalPtr&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
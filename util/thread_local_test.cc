@@ -0,0 +1,164 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class ThreadLocalTest { };
+
+// Counts the calls of the UnrefHandler
+static port::Mutex unref_mu;
+static int unref_count = 0;
+
+static void CountUnref(void* ptr) {
+  MutexLock l(&unref_mu);
+  unref_count++;
+}
+
+static int UnrefCount() {
+  MutexLock l(&unref_mu);
+  return unref_count;
+}
+
+namespace {
+struct ThreadState {
+  ThreadLocalPtr* tls;
+  void* value;
+  port::Mutex mu;
+  port::CondVar cv;
+  bool set;        // The thread has set its value
+  bool release;    // The thread may set its value again and exit
+
+  explicit ThreadState(ThreadLocalPtr* t, void* v)
+      : tls(t), value(v), cv(&mu), set(false), release(false) { }
+};
+}  // namespace
+
+// Sets its value, checks that it reads its own value back, waits until
+// the test releases it, and sets its value again before it exits.
+static void SetAndWait(void* arg) {
+  ThreadState* state = reinterpret_cast<ThreadState*>(arg);
+  ASSERT_TRUE(state->tls->Get() == NULL);
+  state->tls->Reset(state->value);
+  ASSERT_EQ(state->value, state->tls->Get());
+
+  MutexLock l(&state->mu);
+  state->set = true;
+  state->cv.SignalAll();
+  while (!state->release) {
+    state->cv.Wait();
+  }
+  state->tls->Reset(state->value);
+}
+
+// Waits until the UnrefHandler has been called n times.
+static void WaitForUnrefs(int n) {
+  for (int i = 0; i < 5000 && UnrefCount() < n; i++) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ(n, UnrefCount());
+}
+
+TEST(ThreadLocalTest, GetSwapCompareAndSwap) {
+  ThreadLocalPtr tls;
+  int a, b;
+  ASSERT_TRUE(tls.Get() == NULL);
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+  ASSERT_TRUE(!tls.CompareAndSwap(&a, NULL));
+  ASSERT_EQ(&b, tls.Get());
+  ASSERT_TRUE(tls.CompareAndSwap(&b, &a));
+  ASSERT_EQ(&a, tls.Get());
+
+  // Another instance has a slot of its own
+  ThreadLocalPtr other;
+  ASSERT_TRUE(other.Get() == NULL);
+  other.Reset(&b);
+  ASSERT_EQ(&a, tls.Get());
+}
+
+TEST(ThreadLocalTest, PerThreadAndScrape) {
+  const int kThreads = 4;
+  int values[kThreads];
+  ThreadLocalPtr tls(&CountUnref);
+  ThreadState* states[kThreads];
+  for (int i = 0; i < kThreads; i++) {
+    states[i] = new ThreadState(&tls, &values[i]);
+    Env::Default()->StartThread(&SetAndWait, states[i]);
+  }
+  for (int i = 0; i < kThreads; i++) {
+    MutexLock l(&states[i]->mu);
+    while (!states[i]->set) {
+      states[i]->cv.Wait();
+    }
+  }
+
+  // Every thread has its own value, and this thread has none
+  ASSERT_TRUE(tls.Get() == NULL);
+  int mine;
+  tls.Reset(&mine);
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, NULL);
+  ASSERT_EQ(kThreads + 1, ptrs.size());
+  for (int i = 0; i < kThreads; i++) {
+    ASSERT_TRUE(std::find(ptrs.begin(), ptrs.end(), &values[i]) != ptrs.end());
+  }
+  ASSERT_TRUE(tls.Get() == NULL);
+  ASSERT_TRUE(!tls.CompareAndSwap(&mine, NULL));
+  ASSERT_EQ(0, UnrefCount());
+
+  // The values the threads set again go to the UnrefHandler when the
+  // threads exit
+  const int base = UnrefCount();
+  for (int i = 0; i < kThreads; i++) {
+    MutexLock l(&states[i]->mu);
+    states[i]->release = true;
+    states[i]->cv.SignalAll();
+  }
+  WaitForUnrefs(base + kThreads);
+  for (int i = 0; i < kThreads; i++) {
+    delete states[i];
+  }
+}
+
+TEST(ThreadLocalTest, UnrefOnExitAndDestroy) {
+  const int base = UnrefCount();
+  ThreadLocalPtr* tls = new ThreadLocalPtr(&CountUnref);
+  int value;
+  ThreadState state(tls, &value);
+  Env::Default()->StartThread(&SetAndWait, &state);
+  {
+    MutexLock l(&state.mu);
+    while (!state.set) {
+      state.cv.Wait();
+    }
+    state.release = true;
+    state.cv.SignalAll();
+  }
+  WaitForUnrefs(base + 1);
+
+  // Destroying the ThreadLocalPtr hands over the values still set
+  tls->Reset(&value);
+  delete tls;
+  ASSERT_EQ(base + 2, UnrefCount());
+
+  // A new ThreadLocalPtr may reuse the id but starts out empty
+  ThreadLocalPtr fresh;
+  ASSERT_TRUE(fresh.Get() == NULL);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_pool.h"
+
+#include "leveldb/env.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+ThreadPool::ThreadPool(Env* env, int threads)
+    : env_(env),
+      cv_(&mu_),
+      threads_(threads < 1 ? 1 : threads),
+      live_threads_(0),
+      active_threads_(0),
+      exiting_(false) {
+}
+
+ThreadPool::~ThreadPool() {
+  MutexLock l(&mu_);
+  exiting_ = true;
+  cv_.SignalAll();
+  while (live_threads_ > 0) {
+    cv_.Wait();
+  }
+}
+
+void ThreadPool::Schedule(void (*function)(void*), void* arg) {
+  MutexLock l(&mu_);
+  Job job;
+  job.function = function;
+  job.arg = arg;
+  queue_.push_back(job);
+
+  // Start the threads missing.  Threads are only started once there is
+  // work for them, and an idle thread is woken up for the job.
+  while (live_threads_ < threads_) {
+    live_threads_++;
+    env_->StartThread(&ThreadPool::ThreadMain, this);
+  }
+  cv_.SignalAll();
+}
+
+void ThreadPool::SetThreads(int threads) {
+  MutexLock l(&mu_);
+  threads_ = (threads < 1 ? 1 : threads);
+  while (!queue_.empty() && live_threads_ < threads_) {
+    live_threads_++;
+    env_->StartThread(&ThreadPool::ThreadMain, this);
+  }
+  // Threads above the new number exit
+  cv_.SignalAll();
+}
+
+int ThreadPool::Threads() {
+  MutexLock l(&mu_);
+  return threads_;
+}
+
+int ThreadPool::QueueLength() {
+  MutexLock l(&mu_);
+  return static_cast<int>(queue_.size());
+}
+
+int ThreadPool::ActiveThreads() {
+  MutexLock l(&mu_);
+  return active_threads_;
+}
+
+void ThreadPool::ThreadMain(void* pool) {
+  reinterpret_cast<ThreadPool*>(pool)->Run();
+}
+
+void ThreadPool::Run() {
+  mu_.Lock();
+  while (true) {
+    while (queue_.empty() && !exiting_ && live_threads_ <= threads_) {
+      cv_.Wait();
+    }
+    if (live_threads_ > threads_ || (queue_.empty() && exiting_)) {
+      break;
+    }
+    Job job = queue_.front();
+    queue_.pop_front();
+    active_threads_++;
+    mu_.Unlock();
+    (*job.function)(job.arg);
+    mu_.Lock();
+    active_threads_--;
+  }
+  live_threads_--;
+  cv_.SignalAll();
+  mu_.Unlock();
+}
+
+}  // namespace leveldb
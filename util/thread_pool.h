@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
+
+#include <deque>
+#include "port/port.h"
+
+namespace leveldb {
+
+class Env;
+
+// A set of threads running the jobs queued with Schedule() in the order
+// they were queued.  The threads are started by an Env when the first
+// job is queued.  The number of threads may be changed at any time;
+// threads above the new number exit once they finish their current job.
+// Safe for concurrent use.
+class ThreadPool {
+ public:
+  // Threads are started with env->StartThread().
+  ThreadPool(Env* env, int threads);
+
+  // Waits for the queued jobs to run and for the threads to exit.
+  ~ThreadPool();
+
+  void Schedule(void (*function)(void*), void* arg);
+
+  // Set the number of threads, at least one.
+  void SetThreads(int threads);
+
+  int Threads();
+
+  // Number of jobs waiting for a thread.
+  int QueueLength();
+
+  // Number of threads running a job.
+  int ActiveThreads();
+
+ private:
+  struct Job {
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void ThreadMain(void* pool);
+  void Run();
+
+  Env* const env_;
+  port::Mutex mu_;
+  port::CondVar cv_;          // Signalled when a job is queued, the number
+                              // of threads changes or a thread exits
+  int threads_;               // Number of threads wanted
+  int live_threads_;          // Number of threads started and not exited
+  int active_threads_;
+  bool exiting_;
+  std::deque<Job> queue_;
+
+  // No copying allowed
+  ThreadPool(const ThreadPool&);
+  void operator=(const ThreadPool&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
@@ -1,4 +1,4 @@
-#pragma
-#include <string>
-
+#pragma once
+#include <string>
+
 extern std::string get_executable_dir();
\ No newline at end of file